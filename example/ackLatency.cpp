@@ -0,0 +1,142 @@
+#include "../src/client/Client.hpp"
+#include "../src/server/Server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+
+// Measures how long a ClientMessageActionAck takes over loopback while a big
+// ClientMessageMapTileData is streaming to the same client. Every round, the
+// client asks for a map with a chat message, waits a moment so the map is
+// underway, then sends an action. The ack time is how long the client waited
+// for the ack; the map time is how long it waited for the map. Kernel buffers
+// are kept small, like a slow link, so most of the map waits in the server's
+// write queue. The whole row sends maps as a single message, so acks wait
+// behind them; the chunked row sends them in fragments, so acks only wait for
+// the fragment being written. Prints CSV
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/// Get the p-th percentile of sorted times, in microseconds
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p / 100.0 * sorted.size()));
+    return sorted[index];
+}
+
+/// Server loop. Answers every chat message with a map, and every action with
+/// an ack, writing whatever the sockets take in between
+void serve(Server& server, std::atomic<bool>& running, uint64_t mapSize) {
+    MapPlane plane(mapSize, std::vector<MapPoint>(mapSize, {'#', false, {Color::WHITE, Color::MAGENTA}}));
+    
+    while(running) {
+        auto messages = server.receive(1);
+        for(auto it = messages.begin(); it != messages.end(); it++) {
+            if((*it)->type == GameMessageType::DoChat)
+                server.addMessage(ClientMessageMapTileData(MapPlane(plane), mapSize, mapSize), (*it)->sender);
+            else if((*it)->type == GameMessageType::DoAction)
+                server.addMessage(ClientMessageActionAck(true), (*it)->sender);
+        }
+        
+        server.sendMessages(0);
+    }
+}
+
+/// Run rounds with a chunk size and print a CSV row
+void measure(const std::string& name, size_t chunkSize, uint16_t port, int rounds, uint64_t mapSize) {
+    // Small kernel buffers, so the map can't hide in them
+    SocketProfile profile = SocketProfile::lowLatency();
+    profile.sendBufferSize = 32 * 1024;
+    profile.receiveBufferSize = 32 * 1024;
+    
+    ServerConfig config(port);
+    config.profile = profile;
+    config.chunkSize = chunkSize;
+    Server server(config);
+    std::atomic<bool> running(true);
+    std::thread serverThread(serve, std::ref(server), std::ref(running), mapSize);
+    
+    std::vector<double> ackTimes, mapTimes;
+    {
+        Client client("127.0.0.1", port, 5000);
+        client.applyProfile(profile);
+        
+        for(int r = 0; r < rounds; r++) {
+            // Ask for a map, and give it time to get underway
+            auto mapStart = Clock::now();
+            client.addMessage(ClientMessageDoChat("map"));
+            client.sendMessages(-1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            
+            auto ackStart = Clock::now();
+            client.addMessage(ClientMessageDoAction(MoveAction(eDirection::UP)));
+            client.sendMessages(-1);
+            
+            // Wait for the ack and the map
+            bool gotAck = false, gotMap = false;
+            while(!(gotAck && gotMap) && client.isSocketOpen()) {
+                client.receiveMessages(1000);
+                auto messages = client.getMessages();
+                auto now = Clock::now();
+                for(auto it = messages.begin(); it != messages.end(); it++) {
+                    if((*it)->type == GameMessageType::ActionAck && !gotAck) {
+                        ackTimes.push_back(std::chrono::duration<double, std::micro>(now - ackStart).count());
+                        gotAck = true;
+                    }
+                    else if((*it)->type == GameMessageType::MapTileData && !gotMap) {
+                        mapTimes.push_back(std::chrono::duration<double, std::micro>(now - mapStart).count());
+                        gotMap = true;
+                    }
+                }
+            }
+        }
+    }
+    
+    running = false;
+    serverThread.join();
+    
+    std::sort(ackTimes.begin(), ackTimes.end());
+    std::sort(mapTimes.begin(), mapTimes.end());
+    if(ackTimes.empty() || mapTimes.empty()) {
+        std::cout << name << ",0,,,," << std::endl;
+        return;
+    }
+    
+    std::cout << name << ','
+              << std::min(ackTimes.size(), mapTimes.size()) << ','
+              << std::fixed << std::setprecision(1)
+              << percentile(ackTimes, 50) << ','
+              << percentile(ackTimes, 99) << ','
+              << percentile(mapTimes, 50) << ','
+              << percentile(mapTimes, 99) << std::endl;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = 7777;
+    int rounds = 100;
+    uint64_t mapSize = 300;
+    for(int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if(arg == "--port" && a + 1 < argc)
+            port = std::stoi(argv[++a]);
+        else if(arg == "--rounds" && a + 1 < argc)
+            rounds = std::stoi(argv[++a]);
+        else if(arg == "--map-size" && a + 1 < argc)
+            mapSize = std::stoull(argv[++a]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--port n] [--rounds n] [--map-size tiles]" << std::endl;
+            return 1;
+        }
+    }
+    
+    Socket::initSocketApi();
+    
+    std::cout << "mode,rounds,ack_p50_us,ack_p99_us,map_p50_us,map_p99_us" << std::endl;
+    
+    // Each mode gets its own port, so closed connections don't get in the way
+    measure("whole", 0, port, rounds, mapSize);
+    measure("chunked", 16 * 1024, port + 1, rounds, mapSize);
+    
+    Socket::cleanupSocketApi();
+    return 0;
+}
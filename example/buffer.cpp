@@ -1,63 +1,389 @@
 #include "../src/networking/Buffer.hpp"
+#include "../src/networking/BufferPool.hpp"
 #include <iostream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
-using namespace std;
-int main() {
-    uint8_t a = 67;
-    uint16_t b = 1337;
-    uint32_t c = 999999;
-    uint64_t d = 123123123123;
-    int8_t e = -67;
-    int16_t f = -1337;
-    int32_t g = -999999;
-    int64_t h = -123123123123;
-    int8_t i = 67;
-    int16_t j = 1337;
-    int32_t k = 999999;
-    int64_t l = 123123123123;
-    Buffer buffer;
-    buffer.insert(a);
-    buffer.insert(b);
-    buffer.insert(c);
-    buffer.insert(d);
-    buffer.insert(e);
-    buffer.insert(f);
-    buffer.insert(g);
-    buffer.insert(h);
-    buffer.insert(i);
-    buffer.insert(j);
-    buffer.insert(k);
-    buffer.insert(l);
-    uint8_t A;
-    uint16_t B;
-    uint32_t C;
-    uint64_t D;
-    int8_t E, I;
-    int16_t F, J;
-    int32_t G, K;
-    int64_t H, L;
-    buffer.pop(A);
-    buffer.pop(B);
-    buffer.pop(C);
-    buffer.pop(D);
-    buffer.pop(E);
-    buffer.pop(F);
-    buffer.pop(G);
-    buffer.pop(H);
-    buffer.pop(I);
-    buffer.pop(J);
-    buffer.pop(K);
-    buffer.pop(L);
-    cout << (uintmax_t)a << " -> " << (uintmax_t)A << endl;
-    cout << (uintmax_t)b << " -> " << (uintmax_t)B << endl;
-    cout << (uintmax_t)c << " -> " << (uintmax_t)C << endl;
-    cout << (uintmax_t)d << " -> " << (uintmax_t)D << endl;
-    cout << (intmax_t)e << " -> " << (intmax_t)E << endl;
-    cout << (intmax_t)f << " -> " << (intmax_t)F << endl;
-    cout << (intmax_t)g << " -> " << (intmax_t)G << endl;
-    cout << (intmax_t)h << " -> " << (intmax_t)H << endl;
-    cout << (intmax_t)i << " -> " << (intmax_t)I << endl;
-    cout << (intmax_t)j << " -> " << (intmax_t)J << endl;
-    cout << (intmax_t)k << " -> " << (intmax_t)K << endl;
-    cout << (intmax_t)l << " -> " << (intmax_t)L << endl;
+// Buffer benchmark. Prints one result per line as CSV (default) or JSON
+// lines (--json), so that different Buffer backends can be compared on the
+// same machine. Usage:
+//     buffer [--json] [--label name] [--scale n]
+// --label sets the value of the backend column (default "ring+pool")
+// --scale multiplies the amount of work done by every benchmark (default 1)
+
+/// Heap allocations done since the program started. Counted by replacing the
+/// global operator new
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+/// Keeps the compiler from optimising away benchmarked reads
+static volatile uint64_t sink;
+
+/// Largest number of separate memory chunks the contents of a buffer were
+/// split into, sampled after each message operation. The ring buffer never
+/// uses more than 2
+static size_t maxChunks;
+
+/// Sample the chunk count of a buffer
+void sampleChunks(Buffer& buffer) {
+    BufferView view = buffer.peek(buffer.size());
+    size_t chunks = (view.firstSize > 0 ? 1 : 0) + (view.secondSize > 0 ? 1 : 0);
+    if(chunks > maxChunks)
+        maxChunks = chunks;
+}
+
+/// Output settings
+static bool jsonOutput = false;
+static std::string label = "ring+pool";
+
+/// A benchmark result
+struct Result {
+    std::string benchmark;
+    std::string width;
+    uint64_t operations;
+    uint64_t bytes;
+    double seconds;
+    uint64_t allocations;
+    uint64_t poolHits;
+    uint64_t poolMisses;
+    size_t maxChunks;
+};
+
+void printHeader() {
+    if(!jsonOutput)
+        std::cout << "backend,benchmark,width,operations,bytes,seconds,ops_per_sec,mib_per_sec,allocs_per_op,pool_hits,pool_misses,max_chunks" << std::endl;
+}
+
+void printResult(const Result& result) {
+    double opsPerSec = result.operations / result.seconds;
+    double mibPerSec = result.bytes / result.seconds / (1024.0 * 1024.0);
+    double allocsPerOp = static_cast<double>(result.allocations) / result.operations;
+    
+    if(jsonOutput) {
+        std::cout << "{\"backend\":\"" << label
+                  << "\",\"benchmark\":\"" << result.benchmark
+                  << "\",\"width\":\"" << result.width
+                  << "\",\"operations\":" << result.operations
+                  << ",\"bytes\":" << result.bytes
+                  << ",\"seconds\":" << result.seconds
+                  << ",\"ops_per_sec\":" << opsPerSec
+                  << ",\"mib_per_sec\":" << mibPerSec
+                  << ",\"allocs_per_op\":" << allocsPerOp
+                  << ",\"pool_hits\":" << result.poolHits
+                  << ",\"pool_misses\":" << result.poolMisses
+                  << ",\"max_chunks\":" << result.maxChunks
+                  << "}" << std::endl;
+    }
+    else {
+        std::cout << label << ','
+                  << result.benchmark << ','
+                  << result.width << ','
+                  << result.operations << ','
+                  << result.bytes << ','
+                  << result.seconds << ','
+                  << opsPerSec << ','
+                  << mibPerSec << ','
+                  << allocsPerOp << ','
+                  << result.poolHits << ','
+                  << result.poolMisses << ','
+                  << result.maxChunks << std::endl;
+    }
+}
+
+/// Run a benchmark body and measure time, allocations and pool usage.
+/// body returns the amount of bytes processed
+template<typename F> void run(std::string benchmark, std::string width, uint64_t operations, F body) {
+    BufferPool::resetStats();
+    maxChunks = 0;
+    uint64_t allocationsBefore = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+    
+    uint64_t bytes = body();
+    
+    auto end = std::chrono::steady_clock::now();
+    uint64_t allocations = allocationCount - allocationsBefore;
+    auto stats = BufferPool::stats();
+    
+    printResult({
+        benchmark,
+        width,
+        operations,
+        bytes,
+        std::chrono::duration<double>(end - start).count(),
+        allocations,
+        stats.hits,
+        stats.misses,
+        maxChunks
+    });
+}
+
+/// Insert, get and pop throughput for one integer type
+template<typename T> void integerBenchmarks(std::string width, uint64_t operations) {
+    // Values are inserted and consumed in batches, as with real messages
+    const uint64_t batch = 1024;
+    
+    run("insert", width, operations, [&]() {
+        Buffer buffer;
+        for(uint64_t i = 0; i < operations; i++) {
+            buffer.insert(static_cast<T>(i));
+            if(buffer.size() >= batch * sizeof(T))
+                buffer.erase(buffer.size());
+        }
+        return operations * sizeof(T);
+    });
+    
+    run("get", width, operations, [&]() {
+        Buffer buffer;
+        for(uint64_t i = 0; i < batch; i++)
+            buffer.insert(static_cast<T>(i));
+        
+        T value;
+        uint64_t total = 0;
+        for(uint64_t i = 0; i < operations; i++) {
+            buffer.get(value, (i % batch) * sizeof(T));
+            total += static_cast<uint64_t>(value);
+        }
+        sink = total;
+        return operations * sizeof(T);
+    });
+    
+    run("pop", width, operations, [&]() {
+        Buffer buffer;
+        T value;
+        uint64_t total = 0;
+        for(uint64_t i = 0; i < operations; i += batch) {
+            for(uint64_t j = 0; j < batch; j++)
+                buffer.insert(static_cast<T>(j));
+            sampleChunks(buffer);
+            for(uint64_t j = 0; j < batch; j++) {
+                buffer.pop(value);
+                total += static_cast<uint64_t>(value);
+            }
+        }
+        sink = total;
+        return operations * sizeof(T);
+    });
+}
+
+/// Encode a MapTileData-like message (100x100 map) to a buffer, the way
+/// ClientMessageMapTileData does: 2 dimensions, then 3 bytes per tile
+void insertTileData(Buffer& buffer) {
+    const uint64_t width = 100, height = 100;
+    buffer.insert(static_cast<uint16_t>(3));
+    buffer.insert(static_cast<uint64_t>(16 + 3 * width * height));
+    buffer.insert(width);
+    buffer.insert(height);
+    std::vector<uint8_t> tiles(3 * width * height, '#');
+    buffer.insert(tiles);
+}
+
+/// Parse a MapTileData-like message from a buffer, field by field
+void popTileData(Buffer& buffer) {
+    uint16_t type;
+    uint64_t dataSize, width, height;
+    buffer.pop(type);
+    buffer.pop(dataSize);
+    buffer.pop(width);
+    buffer.pop(height);
+    
+    uint8_t tile;
+    uint64_t total = 0;
+    for(uint64_t t = 0; t < 3 * width * height; t++) {
+        buffer.pop(tile);
+        total += tile;
+    }
+    sink = total;
+}
+
+/// Encode a MapObjectData-like message (50 objects with a 6x6 texture) to a
+/// buffer, field by field
+void insertObjectData(Buffer& buffer) {
+    const uint64_t objects = 50, texSize = 6;
+    buffer.insert(static_cast<uint16_t>(4));
+    buffer.insert(static_cast<uint64_t>(8 + objects * (28 + texSize * (8 + 3 * texSize))));
+    buffer.insert(objects);
+    for(uint64_t o = 0; o < objects; o++) {
+        buffer.insert(static_cast<uint8_t>('e'));
+        buffer.insert(static_cast<uint8_t>(0x91));
+        buffer.insert(static_cast<int64_t>(o));
+        buffer.insert(static_cast<int64_t>(2 * o));
+        buffer.insert(static_cast<uint8_t>(1));
+        buffer.insert(static_cast<uint8_t>(0));
+        buffer.insert(texSize);
+        for(uint64_t r = 0; r < texSize; r++) {
+            buffer.insert(texSize);
+            for(uint64_t c = 0; c < texSize; c++) {
+                buffer.insert(static_cast<uint8_t>('A'));
+                buffer.insert(static_cast<uint8_t>(7));
+                buffer.insert(static_cast<uint8_t>(1));
+            }
+        }
+    }
+}
+
+/// Parse a MapObjectData-like message from a buffer, field by field
+void popObjectData(Buffer& buffer) {
+    uint16_t type;
+    uint64_t dataSize, objects;
+    buffer.pop(type);
+    buffer.pop(dataSize);
+    buffer.pop(objects);
+    
+    uint64_t total = 0;
+    for(uint64_t o = 0; o < objects; o++) {
+        uint8_t character, omniByte, textColor, bgColor;
+        int64_t posX, posY;
+        uint64_t texHeight;
+        buffer.pop(character);
+        buffer.pop(omniByte);
+        buffer.pop(posX);
+        buffer.pop(posY);
+        buffer.pop(textColor);
+        buffer.pop(bgColor);
+        buffer.pop(texHeight);
+        for(uint64_t r = 0; r < texHeight; r++) {
+            uint64_t rowWidth;
+            buffer.pop(rowWidth);
+            for(uint64_t c = 0; c < 3 * rowWidth; c++) {
+                uint8_t point;
+                buffer.pop(point);
+                total += point;
+            }
+        }
+        total += posX + posY;
+    }
+    sink = total;
+}
+
+/// Message workloads. Every operation is one message encoded into a buffer
+/// and then parsed back out of it
+void messageBenchmarks(uint64_t messages) {
+    run("tile_data", "message", messages, [&]() {
+        Buffer buffer;
+        uint64_t bytes = 0;
+        for(uint64_t m = 0; m < messages; m++) {
+            insertTileData(buffer);
+            bytes += buffer.size();
+            sampleChunks(buffer);
+            popTileData(buffer);
+        }
+        return bytes;
+    });
+    
+    run("object_data", "message", messages, [&]() {
+        Buffer buffer;
+        uint64_t bytes = 0;
+        for(uint64_t m = 0; m < messages; m++) {
+            insertObjectData(buffer);
+            bytes += buffer.size();
+            sampleChunks(buffer);
+            popObjectData(buffer);
+        }
+        return bytes;
+    });
+    
+    // A turn for 64 players: each write buffer gets an object update and
+    // then gets drained, like Server::sendMessages does
+    run("object_data_64_players", "turn", messages, [&]() {
+        std::vector<Buffer> wBuffers(64);
+        uint64_t bytes = 0;
+        for(uint64_t m = 0; m < messages; m++) {
+            for(auto& wBuffer : wBuffers)
+                insertObjectData(wBuffer);
+            for(auto& wBuffer : wBuffers) {
+                bytes += wBuffer.size();
+                sampleChunks(wBuffer);
+                wBuffer.erase(wBuffer.size());
+            }
+        }
+        return bytes;
+    });
+    
+    // Same messages, parsed while a second message is still arriving (so the
+    // ring buffer wraps around)
+    run("mixed_interleaved", "message", messages, [&]() {
+        Buffer buffer;
+        uint64_t bytes = 0;
+        insertObjectData(buffer);
+        for(uint64_t m = 0; m < messages; m++) {
+            if(m % 2)
+                insertTileData(buffer);
+            else
+                insertObjectData(buffer);
+            
+            bytes += buffer.size();
+            sampleChunks(buffer);
+            
+            // Parse the oldest message
+            uint16_t type;
+            buffer.get(type);
+            if(type == 3)
+                popTileData(buffer);
+            else
+                popObjectData(buffer);
+        }
+        return bytes;
+    });
+}
+
+int main(int argc, char** argv) {
+    uint64_t scale = 1;
+    for(int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if(arg == "--json")
+            jsonOutput = true;
+        else if(arg == "--label" && a + 1 < argc)
+            label = argv[++a];
+        else if(arg == "--scale" && a + 1 < argc)
+            scale = std::stoull(argv[++a]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--json] [--label name] [--scale n]" << std::endl;
+            return 1;
+        }
+    }
+    
+    const uint64_t operations = 4000000 * scale;
+    const uint64_t messages = 200 * scale;
+    
+    printHeader();
+    integerBenchmarks<uint8_t>("uint8", operations);
+    integerBenchmarks<uint16_t>("uint16", operations);
+    integerBenchmarks<uint32_t>("uint32", operations);
+    integerBenchmarks<uint64_t>("uint64", operations);
+    integerBenchmarks<int8_t>("int8", operations);
+    integerBenchmarks<int16_t>("int16", operations);
+    integerBenchmarks<int32_t>("int32", operations);
+    integerBenchmarks<int64_t>("int64", operations);
+    messageBenchmarks(messages);
+    
+    return 0;
 }
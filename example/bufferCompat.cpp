@@ -0,0 +1,254 @@
+#include "../src/networking/Buffer.hpp"
+#include <iostream>
+#include <deque>
+#include <random>
+#include <limits>
+
+/// Reference implementation of the original Buffer backend (a deque of byte
+/// chunks, with byte-by-byte integer encoding). Used to check that the ring
+/// buffer backend produces byte-for-byte identical output
+class DequeBuffer {
+    std::deque<std::vector<uint8_t>> chunks;
+    size_t curSize = 0;
+    
+    std::vector<uint8_t> getBytes(size_t byteCount, size_t offset) {
+        std::vector<uint8_t> merged;
+        for(auto it = chunks.begin(); it != chunks.end() && byteCount > 0; it++) {
+            if(offset >= it->size()) {
+                offset -= it->size();
+                continue;
+            }
+            
+            size_t bytesToRead = std::min(it->size() - offset, byteCount);
+            merged.insert(merged.end(), it->begin() + offset, it->begin() + offset + bytesToRead);
+            byteCount -= bytesToRead;
+            offset = 0;
+        }
+        
+        return merged;
+    }
+    
+    void orUIntToCBuffer(uintmax_t integer, size_t n, uint8_t* cBuffer) {
+        for(size_t i = 0; i < n; i++) {
+            cBuffer[i] |= static_cast<uint8_t>(integer & 0xFF);
+            integer >>= 8;
+        }
+    }
+    
+    void orIntToCBuffer(intmax_t integer, size_t n, uint8_t* cBuffer) {
+        if(integer == INTMAX_MIN) {
+            cBuffer[n - 1] |= 0b10000000;
+            return;
+        }
+        
+        if(integer < 0)
+            orUIntToCBuffer(~static_cast<uintmax_t>(-integer) + 1, n, cBuffer);
+        else
+            orUIntToCBuffer(static_cast<uintmax_t>(integer), n, cBuffer);
+    }
+
+public:
+    size_t size() {
+        return curSize;
+    }
+    
+    void erase(size_t byteCount) {
+        curSize -= byteCount;
+        while(byteCount > 0) {
+            auto& front = chunks.front();
+            if(front.size() > byteCount) {
+                front.erase(front.begin(), front.begin() + byteCount);
+                break;
+            }
+            
+            byteCount -= front.size();
+            chunks.pop_front();
+        }
+    }
+    
+    void insert(const std::vector<uint8_t>& bytes) {
+        if(!bytes.empty()) {
+            chunks.push_back(bytes);
+            curSize += bytes.size();
+        }
+    }
+    
+    template<typename T> void insertUInt(T integer) {
+        std::vector<uint8_t> bytes(sizeof(T), 0);
+        orUIntToCBuffer(integer, sizeof(T), bytes.data());
+        insert(bytes);
+    }
+    
+    template<typename T> void insertInt(T integer) {
+        std::vector<uint8_t> bytes(sizeof(T), 0);
+        orIntToCBuffer(integer, sizeof(T), bytes.data());
+        insert(bytes);
+    }
+    
+    std::vector<uint8_t> get(size_t byteCount, size_t offset) {
+        return getBytes(byteCount, offset);
+    }
+};
+
+/// Check if the ring buffer and the reference buffer have identical contents
+bool sameContents(Buffer& buffer, DequeBuffer& reference) {
+    if(buffer.size() != reference.size())
+        return false;
+    
+    std::vector<uint8_t> bytes;
+    buffer.get(bytes, buffer.size());
+    return bytes == reference.get(reference.size(), 0);
+}
+
+int main() {
+    std::mt19937_64 rng(1337);
+    Buffer buffer;
+    DequeBuffer reference;
+    
+    // Values to encode. Includes limits, which used to be special cases
+    std::vector<int64_t> values = {
+        0, 1, -1, 67, -67, 1337, -1337, 999999, -999999, 123123123123,
+        -123123123123,
+        std::numeric_limits<int8_t>::min(), std::numeric_limits<int8_t>::max(),
+        std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(),
+        std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max(),
+        std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()
+    };
+    
+    // Do random operations on both buffers and compare the results
+    size_t operations = 200000;
+    for(size_t op = 0; op < operations; op++) {
+        int64_t value = rng() % 2 ? values[rng() % values.size()] : static_cast<int64_t>(rng());
+        switch(rng() % 12) {
+            case 0:
+                buffer.insert(static_cast<uint8_t>(value));
+                reference.insertUInt(static_cast<uint8_t>(value));
+                break;
+            case 1:
+                buffer.insert(static_cast<uint16_t>(value));
+                reference.insertUInt(static_cast<uint16_t>(value));
+                break;
+            case 2:
+                buffer.insert(static_cast<uint32_t>(value));
+                reference.insertUInt(static_cast<uint32_t>(value));
+                break;
+            case 3:
+                buffer.insert(static_cast<uint64_t>(value));
+                reference.insertUInt(static_cast<uint64_t>(value));
+                break;
+            case 4:
+                buffer.insert(static_cast<int8_t>(value));
+                reference.insertInt(static_cast<int8_t>(value));
+                break;
+            case 5:
+                buffer.insert(static_cast<int16_t>(value));
+                reference.insertInt(static_cast<int16_t>(value));
+                break;
+            case 6:
+                buffer.insert(static_cast<int32_t>(value));
+                reference.insertInt(static_cast<int32_t>(value));
+                break;
+            case 7:
+                buffer.insert(static_cast<int64_t>(value));
+                reference.insertInt(static_cast<int64_t>(value));
+                break;
+            case 8:
+                {
+                    // Insert a byte vector of up to 300 bytes
+                    std::vector<uint8_t> bytes(rng() % 300);
+                    for(auto& byte : bytes)
+                        byte = static_cast<uint8_t>(rng());
+                    buffer.insert(bytes);
+                    reference.insert(bytes);
+                }
+                break;
+            case 9:
+                {
+                    // Insert a string of up to 64 bytes
+                    std::string string(rng() % 64, static_cast<char>(rng()));
+                    buffer.insert(string);
+                    reference.insert(std::vector<uint8_t>(string.begin(), string.end()));
+                }
+                break;
+            case 10:
+                {
+                    // Erase some data
+                    if(buffer.size() == 0)
+                        break;
+                    
+                    size_t byteCount = rng() % (buffer.size() + 1);
+                    buffer.erase(byteCount);
+                    reference.erase(byteCount);
+                }
+                break;
+            case 11:
+                {
+                    // Pop an int64_t and check that it re-encodes to the same bytes
+                    if(buffer.size() < 8)
+                        break;
+                    
+                    auto expected = reference.get(8, 0);
+                    int64_t popped;
+                    buffer.pop(popped);
+                    reference.erase(8);
+                    
+                    Buffer check;
+                    check.insert(popped);
+                    std::vector<uint8_t> actual;
+                    check.get(actual, 8);
+                    if(actual != expected) {
+                        std::cout << "Mismatch: popped int64_t differs at operation " << op << std::endl;
+                        return 1;
+                    }
+                }
+                break;
+        }
+        
+        // Keep the buffers from growing forever
+        if(buffer.size() > 64 * 1024) {
+            size_t byteCount = buffer.size() - 1024;
+            buffer.erase(byteCount);
+            reference.erase(byteCount);
+        }
+        
+        // Compare a random window every operation and everything every so
+        // often, since comparing everything is slow
+        if(buffer.size() != reference.size()) {
+            std::cout << "Mismatch: size differs at operation " << op << std::endl;
+            return 1;
+        }
+        
+        if(buffer.size() > 0) {
+            size_t offset = rng() % buffer.size();
+            size_t byteCount = rng() % (buffer.size() - offset + 1);
+            std::vector<uint8_t> bytes;
+            buffer.get(bytes, byteCount, offset);
+            if(bytes != reference.get(byteCount, offset)) {
+                std::cout << "Mismatch: window at " << offset << " differs at operation " << op << std::endl;
+                return 1;
+            }
+            
+            // Same window, but through a view
+            std::vector<uint8_t> viewBytes;
+            BufferCursor cursor(buffer.peek(byteCount, offset));
+            cursor.read(viewBytes, byteCount);
+            if(viewBytes != bytes) {
+                std::cout << "Mismatch: view at " << offset << " differs at operation " << op << std::endl;
+                return 1;
+            }
+        }
+        
+        if(op % 1000 == 0 && !sameContents(buffer, reference)) {
+            std::cout << "Mismatch: contents differ at operation " << op << std::endl;
+            return 1;
+        }
+    }
+    
+    if(!sameContents(buffer, reference)) {
+        std::cout << "Mismatch: contents differ at the end" << std::endl;
+        return 1;
+    }
+    
+    std::cout << "OK: " << operations << " operations, output identical to the deque backend" << std::endl;
+    return 0;
+}
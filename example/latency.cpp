@@ -0,0 +1,139 @@
+#include "../src/client/Client.hpp"
+#include "../src/server/Server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+
+// Measures the round trip time of a ClientMessageDoAction over loopback, with
+// each socket profile. For every action, the server answers with a
+// ClientMessageActionAck and then, in a separate write, a small
+// ClientMessagePlayerData, like a turn update. The ack time is how long the
+// client waited for the ack; the turn time is how long it waited for both.
+// The local row does the same through a LocalChannel instead of loopback TCP,
+// like the host of a "New game" session. Prints CSV
+
+typedef std::chrono::high_resolution_clock Clock;
+
+/// Get the p-th percentile of sorted times, in microseconds
+double percentile(const std::vector<double>& sorted, double p) {
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p / 100.0 * sorted.size()));
+    return sorted[index];
+}
+
+/// Echo server loop. Answers every action with an ack and a turn update
+void serveActions(Server& server, std::atomic<bool>& running) {
+    std::vector<PlayerSnapshot> snapshots;
+    snapshots.emplace_back("player0", 10, 20, 1, std::vector<std::string>{"Sword"});
+    
+    while(running) {
+        auto messages = server.receive(10);
+        for(auto it = messages.begin(); it != messages.end(); it++) {
+            if((*it)->type != GameMessageType::DoAction)
+                continue;
+            
+            server.addMessage(ClientMessageActionAck(true), (*it)->sender);
+            server.sendMessages(-1);
+            server.addMessage(ClientMessagePlayerData(std::vector<PlayerSnapshot>(snapshots)), (*it)->sender);
+            server.sendMessages(-1);
+        }
+    }
+}
+
+/// Run round trips with a profile and print a CSV row. Local clients connect
+/// through a LocalChannel and ignore the profile
+void measure(const std::string& name, const SocketProfile& profile, uint16_t port, int roundTrips, bool local = false) {
+    ServerConfig config(port);
+    config.profile = profile;
+    Server server(config);
+    std::atomic<bool> running(true);
+    std::thread serverThread(serveActions, std::ref(server), std::ref(running));
+    
+    std::vector<double> ackTimes, turnTimes;
+    {
+        std::unique_ptr<Client> clientPtr;
+        if(local) {
+            std::shared_ptr<LocalChannel> channel(new LocalChannel());
+            server.connectLocal(channel);
+            clientPtr = std::unique_ptr<Client>(new Client(channel));
+        }
+        else {
+            clientPtr = std::unique_ptr<Client>(new Client("127.0.0.1", port, 5000));
+            clientPtr->applyProfile(profile);
+        }
+        Client& client = *clientPtr;
+        
+        for(int r = 0; r < roundTrips; r++) {
+            auto start = Clock::now();
+            client.addMessage(ClientMessageDoAction(MoveAction(eDirection::UP)));
+            client.sendMessages(-1);
+            
+            // Wait for the ack and the turn update
+            bool gotAck = false, gotTurn = false;
+            while(!gotTurn && client.isSocketOpen()) {
+                client.receiveMessages(1000);
+                auto messages = client.getMessages();
+                auto now = Clock::now();
+                for(auto it = messages.begin(); it != messages.end(); it++) {
+                    double elapsedUs = std::chrono::duration<double, std::micro>(now - start).count();
+                    if((*it)->type == GameMessageType::ActionAck && !gotAck) {
+                        ackTimes.push_back(elapsedUs);
+                        gotAck = true;
+                    }
+                    else if((*it)->type == GameMessageType::PlayerData) {
+                        turnTimes.push_back(elapsedUs);
+                        gotTurn = true;
+                    }
+                }
+            }
+        }
+    }
+    
+    running = false;
+    serverThread.join();
+    
+    std::sort(ackTimes.begin(), ackTimes.end());
+    std::sort(turnTimes.begin(), turnTimes.end());
+    if(turnTimes.empty()) {
+        std::cout << name << ",0,,,," << std::endl;
+        return;
+    }
+    
+    std::cout << name << ','
+              << turnTimes.size() << ','
+              << std::fixed << std::setprecision(1)
+              << percentile(ackTimes, 50) << ','
+              << percentile(ackTimes, 99) << ','
+              << percentile(turnTimes, 50) << ','
+              << percentile(turnTimes, 99) << std::endl;
+}
+
+int main(int argc, char** argv) {
+    uint16_t port = 7777;
+    int roundTrips = 200;
+    for(int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if(arg == "--port" && a + 1 < argc)
+            port = std::stoi(argv[++a]);
+        else if(arg == "--round-trips" && a + 1 < argc)
+            roundTrips = std::stoi(argv[++a]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--port n] [--round-trips n]" << std::endl;
+            return 1;
+        }
+    }
+    
+    Socket::initSocketApi();
+    
+    std::cout << "profile,round_trips,ack_p50_us,ack_p99_us,turn_p50_us,turn_p99_us" << std::endl;
+    
+    // Each profile gets its own port, so closed connections don't get in the way
+    measure("default", SocketProfile(), port, roundTrips);
+    measure("low_latency", SocketProfile::lowLatency(), port + 1, roundTrips);
+    measure("bulk", SocketProfile::bulk(), port + 2, roundTrips);
+    measure("local", SocketProfile(), port + 3, roundTrips, true);
+    
+    Socket::cleanupSocketApi();
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "../src/networking/ClientMessage.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+// Measures the bytes sent per turn for the objects of a level with 50
+// enemies, sending every object every turn (MapObjectData) versus sending
+// deltas against the last baseline the client confirmed (ObjectDelta). Every
+// turn, some of the enemies take a step, and every 10 turns one dies and
+// another spawns. The client confirms baselines ack_lag turns late, as if
+// acks took that long to arrive. The check column tells whether the client's
+// copy of the level, built from the deltas, matched the server's every turn.
+// Prints CSV
+
+/// Take turns and print a CSV row
+bool measure(WireFormat format, int movingPercent, int ackLag, int turns) {
+    std::mt19937 random(1234);
+    
+    // 50 enemies with the default 6x6 texture, and a player
+    uint64_t nextId = 1;
+    std::vector<std::shared_ptr<Object>> objects;
+    auto spawn = [&](ObjectType type, char character) {
+        std::shared_ptr<Object> object(new Object(
+            character,
+            Direction::NORTH,
+            true,
+            std::pair<int, int>(1 + random() % 98, 1 + random() % 98),
+            {Color::RED, Color::BLACK},
+            Texture(),
+            type
+        ));
+        object->set_id(nextId++);
+        objects.push_back(object);
+    };
+    spawn(ObjectType::PLAYER, '@');
+    for(auto e = 0; e < 50; e++)
+        spawn(ObjectType::ENEMY, 'e');
+    
+    ObjectHistory history;
+    ObjectMirror mirror;
+    std::vector<uint64_t> applied;
+    uint64_t fullBytes = 0, deltaBytes = 0;
+    bool ok = true;
+    for(auto turn = 1; turn <= turns; turn++) {
+        // Enemies take a step
+        for(auto& object : objects) {
+            if(object->get_type() == ObjectType::ENEMY && static_cast<int>(random() % 100) < movingPercent) {
+                auto position = object->get_position();
+                object->set_position({position.first + static_cast<int>(random() % 3) - 1, position.second + static_cast<int>(random() % 3) - 1});
+            }
+        }
+        
+        // An enemy dies and another one spawns
+        if(turn % 10 == 0) {
+            objects.erase(objects.begin() + 1 + random() % (objects.size() - 1));
+            spawn(ObjectType::ENEMY, 'e');
+        }
+        
+        // The server sends a delta against the baseline the client confirmed
+        // ackLag turns ago
+        history.record(objects, turn);
+        uint64_t baseline = applied.size() >= static_cast<size_t>(ackLag) ? applied[applied.size() - ackLag] : 0;
+        ClientMessageObjectDelta delta(history.deltaFrom(baseline));
+        fullBytes += ClientMessageMapObjectData(objects).toBytes(format).size();
+        auto bytes = delta.toBytes(format);
+        deltaBytes += bytes.size();
+        
+        // The client parses and applies it
+        Buffer buffer;
+        buffer.insert(bytes);
+        auto parsed = ClientMessage::fromBuffer(buffer, format);
+        if(!parsed || mirror.apply(static_cast<ClientMessageObjectDelta*>(parsed.get())->delta) != ObjectDeltaResult::Applied) {
+            ok = false;
+            break;
+        }
+        applied.push_back(turn);
+        
+        ObjectDelta difference = diffBaselines(makeBaseline(mirror.getObjects()), 0, makeBaseline(objects), 0);
+        ok &= difference.despawned.empty() && difference.updates.empty();
+    }
+    
+    double full = static_cast<double>(fullBytes) / turns;
+    double deltas = static_cast<double>(deltaBytes) / turns;
+    std::cout << (format == WireFormat::Fixed ? "fixed" : "compact") << ','
+              << movingPercent << ','
+              << ackLag << ','
+              << std::fixed << std::setprecision(1)
+              << full << ','
+              << deltas << ','
+              << 100.0 * (full - deltas) / full << ','
+              << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    const int turns = 200;
+    
+    std::cout << "format,moving_percent,ack_lag,full_bytes_per_turn,delta_bytes_per_turn,saved_percent,check" << std::endl;
+    bool ok = true;
+    for(auto format : {WireFormat::Fixed, WireFormat::Compact}) {
+        for(auto movingPercent : {0, 25, 100}) {
+            for(auto ackLag : {1, 4})
+                ok &= measure(format, movingPercent, ackLag, turns);
+        }
+    }
+    
+    return ok ? 0 : 1;
+}
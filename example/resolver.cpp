@@ -0,0 +1,121 @@
+#include "../src/networking/Resolver.hpp"
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+// Shows how long callers of a Resolver are kept waiting, with a fake backend
+// instead of DNS, so it runs the same without a network. Lookups take 200 ms;
+// hosts starting with "bad" fail, and hosts starting with "stuck" don't return
+// until the end (like getaddrinfo with the network down). For each case, the
+// wait column is how long the caller was blocked, and calls is how many
+// lookups reached the backend. The check column tells whether both were as
+// expected. Prints CSV
+
+typedef std::chrono::steady_clock Clock;
+
+/// Lookups that reached the fake backend
+std::atomic<int> backendCalls(0);
+
+/// Set at the end, so stuck lookups return and their threads finish
+std::atomic<bool> released(false);
+
+/// Fake backend. Every host resolves to 127.0.0.1
+std::vector<IN_ADDR> fakeLookup(const std::string& host) {
+    backendCalls++;
+    if(host.compare(0, 5, "stuck") == 0) {
+        while(!released)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    else
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    
+    if(host.compare(0, 3, "bad") == 0)
+        throw SocketException("fakeLookup: Unknown host " + host);
+    
+    IN_ADDR address;
+    address.s_addr = htonl(INADDR_LOOPBACK);
+    return {address};
+}
+
+/// Get the milliseconds since a time point
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/// Print a CSV row, checking the wait and the backend calls since callsBefore
+bool report(const std::string& name, double waitMs, double maxWaitMs, int callsBefore, int expectedCalls) {
+    int calls = backendCalls - callsBefore;
+    bool ok = waitMs <= maxWaitMs && calls == expectedCalls;
+    std::cout << name << ','
+              << std::fixed << std::setprecision(2) << waitMs << ','
+              << calls << ','
+              << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    Resolver resolver(fakeLookup, std::chrono::milliseconds(500), std::chrono::milliseconds(1000));
+    
+    std::cout << "case,wait_ms,calls,check" << std::endl;
+    bool ok = true;
+    
+    // Starting a lookup returns straight away; the caller polls the result,
+    // like a connecting screen would
+    int calls = backendCalls;
+    auto start = Clock::now();
+    Resolver::Result result = resolver.resolveAsync("game.example");
+    double startMs = millisecondsSince(start);
+    while(result.wait_for(std::chrono::milliseconds(16)) != std::future_status::ready);
+    ok &= result.get().size() == 1;
+    ok &= report("start", startMs, 5, calls, 1);
+    
+    // The result is cached for the TTL
+    calls = backendCalls;
+    start = Clock::now();
+    resolver.resolve("game.example");
+    ok &= report("cached", millisecondsSince(start), 5, calls, 0);
+    
+    // Callers asking for the same host at once share one lookup
+    calls = backendCalls;
+    start = Clock::now();
+    std::vector<std::thread> callers;
+    for(int c = 0; c < 8; c++)
+        callers.emplace_back([&resolver] { resolver.resolve("other.example"); });
+    for(auto it = callers.begin(); it != callers.end(); it++)
+        it->join();
+    ok &= report("shared", millisecondsSince(start), 300, calls, 1);
+    
+    // Failures aren't cached, so asking again tries again
+    calls = backendCalls;
+    start = Clock::now();
+    for(int attempt = 0; attempt < 2; attempt++) {
+        try {
+            resolver.resolve("bad.example");
+            ok = false;
+        }
+        catch(const SocketException&) {}
+    }
+    ok &= report("failed", millisecondsSince(start), 500, calls, 2);
+    
+    // A lookup that never returns only keeps the caller for its timeout
+    calls = backendCalls;
+    start = Clock::now();
+    try {
+        resolver.resolve("stuck.example", 100);
+        ok = false;
+    }
+    catch(const SocketException&) {}
+    ok &= report("stuck", millisecondsSince(start), 150, calls, 1);
+    
+    // Once the TTL is over, the host is looked up again
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    calls = backendCalls;
+    start = Clock::now();
+    resolver.resolve("game.example");
+    ok &= report("expired", millisecondsSince(start), 300, calls, 1);
+    
+    released = true;
+    return ok ? 0 : 1;
+}
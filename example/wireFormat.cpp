@@ -0,0 +1,112 @@
+#include "../src/networking/ClientMessage.hpp"
+#include "../src/networking/ServerMessage.hpp"
+#include <iostream>
+#include <iomanip>
+
+// Compares the size of every message type in the Fixed and Compact wire
+// formats, using messages shaped like the ones sent during a game, and checks
+// that Compact messages parse back to the same message. Prints CSV
+
+/// Parse bytes as a message to a client and re-encode it. Returns false if
+/// parsing fails or the result differs
+bool clientRoundTrip(const std::vector<uint8_t>& bytes, WireFormat format) {
+    Buffer buffer;
+    buffer.insert(bytes);
+    auto message = ClientMessage::fromBuffer(buffer, format);
+    return message && buffer.size() == 0 && message->toBytes(format) == bytes;
+}
+
+/// Parse bytes as a message to the server. Returns false if parsing fails
+bool serverRoundTrip(const std::vector<uint8_t>& bytes, WireFormat format) {
+    Buffer buffer;
+    buffer.insert(bytes);
+    auto message = ServerMessage::fromBuffer(buffer, nullptr, format);
+    return message && buffer.size() == 0;
+}
+
+/// Print a CSV row for a message. Returns false if the round trip failed
+bool report(std::string name, const ClientMessage& message, bool toServer) {
+    auto fixed = message.toBytes(WireFormat::Fixed);
+    auto compact = message.toBytes(WireFormat::Compact);
+    bool ok = toServer ? serverRoundTrip(compact, WireFormat::Compact) : clientRoundTrip(compact, WireFormat::Compact);
+    
+    double savedPercent = 100.0 * (fixed.size() - compact.size()) / fixed.size();
+    std::cout << name << ','
+              << fixed.size() << ','
+              << compact.size() << ','
+              << fixed.size() - compact.size() << ','
+              << std::fixed << std::setprecision(1) << savedPercent << ','
+              << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+int main() {
+    // 100x100 map with a wall border
+    const uint64_t mapSize = 100;
+    MapPlane plane(mapSize, std::vector<MapPoint>(mapSize, {' ', true, {Color::BLACK, Color::GREEN}}));
+    for(auto y = 0; y < mapSize; y++) {
+        for(auto x = 0; x < mapSize; x++) {
+            if(x == 0 || y == 0 || x == mapSize - 1 || y == mapSize - 1)
+                plane[y][x] = {'#', false, {Color::WHITE, Color::MAGENTA}};
+        }
+    }
+    
+    // 50 enemies with the default 6x6 texture, spread over the map
+    std::vector<std::shared_ptr<Object>> objects;
+    for(auto e = 0; e < 50; e++) {
+        objects.emplace_back(new Object(
+            'e',
+            Direction::NORTH,
+            true,
+            std::pair<int, int>(1 + (e * 37) % 98, 1 + (e * 53) % 98),
+            {Color::RED, Color::BLACK},
+            Texture(),
+            ObjectType::ENEMY
+        ));
+    }
+    
+    // A turn later: the first enemy died, the next 10 moved, and another one
+    // spawned
+    for(auto e = 0; e < 50; e++)
+        objects[e]->set_id(1 + e);
+    std::vector<std::shared_ptr<Object>> nextTurn;
+    for(auto e = 1; e < 50; e++) {
+        nextTurn.emplace_back(new Object(*objects[e]));
+        auto position = objects[e]->get_position();
+        if(e <= 10)
+            nextTurn.back()->set_position({position.first + 1, position.second});
+    }
+    nextTurn.emplace_back(new Object(*objects[0]));
+    nextTurn.back()->set_id(51);
+    ObjectDelta delta = diffBaselines(makeBaseline(objects), 1, makeBaseline(nextTurn), 2);
+    
+    // 4 players with a few items each
+    std::vector<PlayerSnapshot> snapshots;
+    for(auto p = 0; p < 4; p++)
+        snapshots.emplace_back("player" + std::to_string(p), 10 + p, 20 + p, 1 + p, std::vector<std::string>{"Sword", "Leather armour", "Health potion"});
+    
+    std::cout << "message,fixed_bytes,compact_bytes,saved_bytes,saved_percent,round_trip" << std::endl;
+    bool ok = true;
+    ok &= report("Join", ClientMessageJoin("player0"), false);
+    ok &= report("Quit", ClientMessageQuit("player0"), false);
+    ok &= report("Chat", ClientMessageChat("player0", "hello there"), false);
+    ok &= report("MapTileData", ClientMessageMapTileData(MapPlane(plane), mapSize, mapSize), false);
+    ok &= report("MapObjectData", ClientMessageMapObjectData(objects), false);
+    ok &= report("ObjectDelta", ClientMessageObjectDelta(delta), false);
+    ok &= report("PlayerData", ClientMessagePlayerData(std::vector<PlayerSnapshot>(snapshots)), false);
+    ok &= report("ActionAck", ClientMessageActionAck(true), false);
+    ok &= report("SnapshotChannel", ClientMessageSnapshotChannel(0x9e3779b9), false);
+    ok &= report("Ping", ClientMessagePing(1234567890123), false);
+    ok &= report("Pong", ClientMessagePong(1234567890123), false);
+    ok &= report("Fragment", ClientMessageFragment(true, ClientMessageChat("player0", "hello there").toBytes()), false);
+    ok &= report("DoJoin", ClientMessageDoJoin("player0"), true);
+    ok &= report("DoQuit", ClientMessageDoQuit(), true);
+    ok &= report("DoChat", ClientMessageDoChat("hello there"), true);
+    ok &= report("DoAction", ClientMessageDoAction(MoveAction(eDirection::UP)), true);
+    ok &= report("DoSnapshotChannel", ClientMessageDoSnapshotChannel(), true);
+    ok &= report("DoPing", ClientMessageDoPing(1234567890123), true);
+    ok &= report("DoPong", ClientMessageDoPong(1234567890123), true);
+    ok &= report("DoObjectAck", ClientMessageDoObjectAck(1234), true);
+    
+    return ok ? 0 : 1;
+}
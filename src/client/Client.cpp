@@ -1,13 +1,27 @@
 #include "../networking/SocketSelector.hpp"
 #include "Client.hpp"
 #include <chrono>
+#include <stdexcept>
 
-Client::Client(std::string host, uint16_t port, int timeoutMs) :
+// Definitions for hello limits, which are bound by reference
+const int Client::maxHellos;
+const int Client::helloIntervalMs;
+
+Client::Client(std::string host, uint16_t port, int timeoutMs, WireFormat wireFormat, Resolver& resolver) :
     // Open connection socket
-    clientSocket(new Socket(AF_INET, SOCK_STREAM, IPPROTO_TCP))
+    clientSocket(new Socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)),
+    pingIntervalMs(0),
+    idleTimeoutMs(0),
+    wireFormat(wireFormat)
 {
-    // Resolve host
-    auto addresses = Socket::resolve(host);
+    // Resolve host, giving up when the timeout is reached. Whatever is left of
+    // the timeout is used to connect
+    auto start = std::chrono::steady_clock::now();
+    auto addresses = resolver.resolve(host, timeoutMs);
+    if(timeoutMs > 0) {
+        int elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        timeoutMs = elapsed < timeoutMs ? timeoutMs - elapsed : 0;
+    }
     
     // Connect to first available socket
     SocketSelector selector;
@@ -19,8 +33,9 @@ Client::Client(std::string host, uint16_t port, int timeoutMs) :
             // Connect
             candidateSocket->connect(AF_INET, *it, port);
             
-            // Add to selector. Wait for writing to become available
-            selector.addWait(SelectedEventType::Write, candidateSocket);
+            // Add to selector. Wait for writing to become available. The
+            // address is kept as user data
+            selector.addWait(SelectedEventType::Write, candidateSocket, std::shared_ptr<IN_ADDR>(new IN_ADDR(*it)));
         }
         catch(SocketException){}; // Ignore exceptions, just don't connect
     }
@@ -35,6 +50,7 @@ Client::Client(std::string host, uint16_t port, int timeoutMs) :
         // Pick first available connection
         if(it->isOfType(SelectedEventType::Write) && it->socket->isValid()) {
             chosenCandidate = std::move(it->socket);
+            serverAddress = *it->getUserData<IN_ADDR>();
             break;
         }
     }
@@ -44,17 +60,30 @@ Client::Client(std::string host, uint16_t port, int timeoutMs) :
     
     // Close connection socket automatically and replace with new connection
     clientSocket = std::move(chosenCandidate);
+    serverPort = port;
     
     // Make socket non-blocking as we will be reading and writing from now on
     clientSocket->setBlocking(false);
 }
 
+Client::Client(std::shared_ptr<LocalChannel> channel) :
+    clientSocket(new Socket()),
+    localChannel(channel),
+    pingIntervalMs(0),
+    idleTimeoutMs(0),
+    wireFormat(WireFormat::Fixed)
+{}
+
 Client::~Client() {
+    // Tell a local server we're gone
+    if(localChannel != nullptr)
+        localChannel->close();
+    
     if(clientSocket->isValid()) {
         try {
             // Shutdown socket read
             clientSocket->shutdown(SocketShutdownMode::ShutRead);
-        
+            
             // Send all buffered data. Abort after, at most, 10 seconds
             auto quarters = 0;
             while(wBuffer.size() > 0) {
@@ -73,32 +102,45 @@ Client::~Client() {
 void Client::receiveMessages(int timeoutMs) {
     // Lock socket
     const std::lock_guard<std::mutex> sLockGuard(sLock);
+    
+    // Local clients wait on the channel and take messages as they are
+    if(localChannel != nullptr) {
+        SocketSelector selector;
+        selector.addWait(SelectedEventType::Read, localChannel->toClient.waker.reader);
+        selector.wait(timeoutMs);
         
-    std::deque<std::shared_ptr<ClientMessage>> messages;
+        const std::lock_guard<std::mutex> rLockGuard(rLock);
+        localChannel->toClient.pop(localMessages);
+        return;
+    }
     
-    // Wait for a read event in the client socket
+    // Wait for a read event in the client socket, or the snapshot socket
     SocketSelector selector;
     selector.addWait(SelectedEventType::Read, clientSocket);
+    if(snapshotSocket != nullptr) {
+        sendHello();
+        if(snapshotSocket != nullptr)
+            selector.addWait(SelectedEventType::Read, snapshotSocket);
+    }
     auto events = selector.wait(timeoutMs);
     
     // Parse events
-    if(events.empty())
-        return;
-    
-    // There will only be one event. Read data
-    std::vector<uint8_t> readBuf;
-    if(!clientSocket->read(readBuf)) {
-        // Close socket if read says it should close
-        clientSocket->close();
-        return;
-    }
-    else if(!readBuf.empty()) {
-        // Lock read buffer
-        const std::lock_guard<std::mutex> rLockGuard(rLock);
+    bool connected = true;
+    for(auto it = events.begin(); it != events.end(); it++) {
+        if(it->socket == snapshotSocket) {
+            receiveSnapshots();
+            continue;
+        }
         
-        // Insert data to read buffer
-        rBuffer.insert(readBuf);
+        connected = readMessages();
     }
+    
+    // Close socket if read says it should close. Messages received before
+    // that can still be taken with getMessages
+    if(!connected)
+        clientSocket->close();
+    else
+        keepAlive();
 }
 
 void Client::sendMessages(int timeoutMs) {
@@ -106,14 +148,8 @@ void Client::sendMessages(int timeoutMs) {
     if(wBuffer.size() == 0)
         return;
     
-    // Lock socket and write buffer
+    // Lock socket
     const std::lock_guard<std::mutex> sLockGuard(sLock);
-    const std::lock_guard<std::mutex> wLockGuard(wLock);
-    
-    // Merge buffer
-    std::vector<uint8_t> bytes;
-    wBuffer.get(bytes, wBuffer.size());
-    size_t sent = 0;
     
     // Setup timer
     std::chrono::time_point<std::chrono::high_resolution_clock> start;
@@ -121,59 +157,354 @@ void Client::sendMessages(int timeoutMs) {
         start = std::chrono::high_resolution_clock::now();
     
     // Start sending
-    while(sent != bytes.size()) {
-        // Send data
-        //size_t result = client_socket->write(bytes.begin() + sent, bytes.size() - sent);
-        size_t result = clientSocket->write(bytes.begin() + sent, bytes.size() - sent);
-        
-        // Clear sent part of buffer
-        wBuffer.erase(result);
-        sent += result;
+    SocketSelector selector;
+    selector.addWait(SelectedEventType::Write, clientSocket);
+    while(true) {
+        {
+            // Lock write buffer only while writing, so addMessage isn't held
+            // up while waiting
+            const std::lock_guard<std::mutex> wLockGuard(wLock);
+            link.bytesOut += clientSocket->writeFrom(wBuffer);
+            if(wBuffer.size() == 0)
+                break;
+        }
         
-        // Stop sending if timeout exceeded
+        // Stop sending if timeout exceeded. Otherwise, wait for the socket to
+        // take more
+        int waitMs = -1;
         if(timeoutMs == 0)
             break;
         else if(timeoutMs != -1) {
             auto end = std::chrono::high_resolution_clock::now();
             auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-            if(elapsed > timeoutMs)
+            if(elapsed >= timeoutMs)
                 break;
+            waitMs = timeoutMs - elapsed;
+        }
+        selector.wait(waitMs);
+    }
+}
+
+void Client::poll(int timeoutMs) {
+    // Local clients send straight away in addMessage, so there is only
+    // receiving to do
+    if(localChannel != nullptr) {
+        receiveMessages(timeoutMs);
+        return;
+    }
+    
+    // Lock socket
+    const std::lock_guard<std::mutex> sLockGuard(sLock);
+    
+    // Wait for data from the server or the snapshot socket, for a message to
+    // be added, or for the socket to be writable if data is left from last
+    // time
+    SocketSelector selector;
+    selector.addWait(SelectedEventType::Read, clientSocket);
+    selector.addWait(SelectedEventType::Read, sendWaker.reader);
+    {
+        const std::lock_guard<std::mutex> wLockGuard(wLock);
+        if(wBuffer.size() > 0)
+            selector.addWait(SelectedEventType::Write, clientSocket);
+    }
+    if(snapshotSocket != nullptr) {
+        sendHello();
+        if(snapshotSocket != nullptr)
+            selector.addWait(SelectedEventType::Read, snapshotSocket);
+    }
+    auto events = selector.wait(timeoutMs);
+    
+    // Parse events
+    bool connected = true;
+    for(auto it = events.begin(); it != events.end(); it++) {
+        if(it->socket == snapshotSocket) {
+            receiveSnapshots();
+            continue;
         }
+        
+        // New messages are written below. Clear before writing, so messages
+        // added from now on wake the next poll
+        if(it->socket == sendWaker.reader) {
+            sendWaker.clear();
+            continue;
+        }
+        
+        if(it->isOfType(SelectedEventType::Read))
+            connected = readMessages();
     }
     
-    return;
+    // Close socket if read says it should close. Messages received before
+    // that can still be taken with getMessages
+    if(!connected) {
+        clientSocket->close();
+        return;
+    }
+    
+    // Answer pings before writing, so pongs go out straight away. Write what
+    // the socket takes. The rest is written once the socket is writable again
+    keepAlive();
+    if(clientSocket->isValid()) {
+        const std::lock_guard<std::mutex> wLockGuard(wLock);
+        link.bytesOut += clientSocket->writeFrom(wBuffer);
+    }
+}
+
+bool Client::readMessages() {
+    // Read all available data straight into the read buffer
+    const std::lock_guard<std::mutex> rLockGuard(rLock);
+    size_t buffered = rBuffer.size();
+    bool connected = clientSocket->readInto(rBuffer);
+    link.received(rBuffer.size() - buffered);
+    
+    // Messages sent just before the server disconnected are still parsed
+    return parseMessages() && connected;
+}
+
+bool Client::parseMessages() {
+    // Build as many messages as possible
+    try {
+        while(true) {
+            size_t available = rBuffer.size();
+            auto message = ClientMessage::fromBuffer(rBuffer, wireFormat);
+            
+            // Stop once there is no full message left. Unknown or invalid
+            // messages are skipped
+            if(rBuffer.size() == available)
+                break;
+            link.messagesIn++;
+            if(!message)
+                continue;
+            
+            // Join fragments, and parse the message once the last one is in
+            if(message->type == GameMessageType::Fragment) {
+                auto fragment = static_cast<ClientMessageFragment*>(message.get());
+                fragments.insert(fragment->data);
+                if(!fragment->last)
+                    continue;
+                
+                message = ClientMessage::fromBuffer(fragments, wireFormat);
+                fragments.clear();
+                if(!message)
+                    continue;
+            }
+            
+            // Snapshot channel tokens, pings and pongs are handled here, not
+            // by the game
+            switch(message->type) {
+                case GameMessageType::SnapshotChannel:
+                    snapshotToken = static_cast<ClientMessageSnapshotChannel*>(message.get())->token;
+                    snapshotRefused = snapshotToken == 0;
+                    break;
+                case GameMessageType::Ping:
+                    pings.push_back(static_cast<ClientMessagePing*>(message.get())->timestamp);
+                    break;
+                case GameMessageType::Pong:
+                    link.addPong(static_cast<ClientMessagePong*>(message.get())->timestamp);
+                    break;
+                default:
+                    // std::move used to transfer ownership to deque
+                    received.push_back(std::move(message));
+                    break;
+            }
+        }
+    }
+    catch(const std::invalid_argument&) {
+        // Malformed header, the stream can't be framed anymore
+        rBuffer.clear();
+        return false;
+    }
+    
+    return true;
+}
+
+void Client::keepAlive() {
+    if(!clientSocket->isValid())
+        return;
+    
+    // Answer pings from the server
+    std::vector<uint64_t> timestamps;
+    {
+        const std::lock_guard<std::mutex> rLockGuard(rLock);
+        timestamps.swap(pings);
+    }
+    for(auto it = timestamps.begin(); it != timestamps.end(); it++)
+        addMessage(ClientMessageDoPong(*it));
+    
+    // Ping the server if it's time to
+    uint64_t now = monotonicMicroseconds();
+    if(pingIntervalMs > 0 && link.pingDue(now, pingIntervalMs))
+        addMessage(ClientMessageDoPing(now));
+    
+    // A server that sends nothing for too long is gone, even if the
+    // connection wasn't closed
+    if(idleTimeoutMs > 0 && link.idleTime(now) > static_cast<uint64_t>(idleTimeoutMs) * 1000)
+        clientSocket->close();
 }
 
 void Client::addMessage(const ClientMessage& message) {
     // Lock write buffer
     const std::lock_guard<std::mutex> wLockGuard(wLock);
     
-    // Insert to buffer
-    wBuffer.insert(message.toBytes());
+    // Local messages skip the write buffer. The lock keeps pushes from
+    // different threads apart
+    if(localChannel != nullptr) {
+        localChannel->toServer.push(message.clone());
+        return;
+    }
+    
+    // Insert to buffer, and wake poll to send it
+    link.messagesOut++;
+    wBuffer.insert(message.toBytes(wireFormat));
+    sendWaker.wake();
 }
 
 std::deque<std::unique_ptr<ClientMessage>> Client::getMessages() {
+    // Lock read buffer. Messages were parsed as they arrived
+    const std::lock_guard<std::mutex> rLockGuard(rLock);
     std::deque<std::unique_ptr<ClientMessage>> messages;
+    messages.swap(received);
     
-    // Lock read buffer
-    const std::lock_guard<std::mutex> rLockGuard(rLock);
+    // Add snapshots
+    for(auto it = snapshots.begin(); it != snapshots.end(); it++)
+        messages.push_back(std::move(*it));
+    snapshots.clear();
     
-    // Check if a message can be built from the current read buffer.
-    // Try to build as many messages as possible
-    while(true) {
-        auto message = ClientMessage::fromBuffer(rBuffer);
+    // Add local messages
+    for(auto it = localMessages.begin(); it != localMessages.end(); it++)
+        messages.push_back(std::move(*it));
+    localMessages.clear();
+    
+    return messages;
+}
+
+void Client::requestSnapshotChannel() {
+    // Local clients have nothing to gain from a snapshot channel
+    if(localChannel != nullptr)
+        return;
+    
+    {
+        // Lock socket
+        const std::lock_guard<std::mutex> sLockGuard(sLock);
+        if(snapshotSocket != nullptr)
+            return;
         
-        if(!message)
-            break;
+        snapshotSocket = std::shared_ptr<Socket>(new Socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+        snapshotSocket->setBlocking(false);
+    }
+    
+    addMessage(ClientMessageDoSnapshotChannel());
+}
 
-        // std::move used to transfer ownership to vector
-        messages.push_back(std::move(message));
+bool Client::hasSnapshotChannel() {
+    // Lock read buffer
+    const std::lock_guard<std::mutex> rLockGuard(rLock);
+    return snapshotConnected;
+}
+
+void Client::sendHello() {
+    uint32_t token;
+    {
+        // Lock read buffer
+        const std::lock_guard<std::mutex> rLockGuard(rLock);
+        
+        // Drop the socket if the server has no snapshot channel
+        if(snapshotRefused) {
+            snapshotSocket = nullptr;
+            return;
+        }
+        
+        // Wait for the token, and stop once connected or out of hellos
+        if(snapshotToken == 0 || snapshotConnected || hellosSent >= maxHellos)
+            return;
+        
+        auto now = std::chrono::steady_clock::now();
+        if(hellosSent > 0 && now - lastHello < std::chrono::milliseconds(helloIntervalMs))
+            return;
+        
+        token = snapshotToken;
+        hellosSent++;
+        lastHello = now;
     }
     
-    return messages;
+    // Hellos can be lost too; there will be another one
+    try {
+        snapshotSocket->sendTo(helloDatagram(token), serverAddress, serverPort);
+    }
+    catch(const SocketException&) {}
+}
+
+void Client::receiveSnapshots() {
+    std::vector<uint8_t> datagram;
+    IN_ADDR address;
+    uint16_t port;
+    try {
+        while(snapshotSocket->receiveFrom(datagram, address, port)) {
+            // Only accept datagrams from the server
+            if(address.s_addr != serverAddress.s_addr || port != serverPort)
+                continue;
+            
+            Buffer buffer;
+            buffer.insert(datagram);
+            DatagramHeader header;
+            if(!popDatagramHeader(buffer, header))
+                continue;
+            
+            // Lock read buffer. Any datagram from the server means the channel
+            // works
+            const std::lock_guard<std::mutex> rLockGuard(rLock);
+            snapshotConnected = true;
+            if(header.kind != DatagramKind::Snapshot)
+                continue;
+            
+            // Keep the snapshot unless a newer one of its type arrived first
+            std::unique_ptr<ClientMessage> message;
+            try {
+                message = ClientMessage::fromBuffer(buffer, wireFormat);
+            }
+            catch(const std::invalid_argument&) {
+                continue;
+            }
+            
+            if(!message || !snapshotFilter.accept(message->type, header.value))
+                continue;
+            
+            // Latest wins: replace an older snapshot of the same type that
+            // getMessages hasn't returned yet
+            for(auto it = snapshots.begin(); it != snapshots.end(); it++) {
+                if((*it)->type == message->type) {
+                    snapshots.erase(it);
+                    break;
+                }
+            }
+            snapshots.push_back(std::move(message));
+        }
+    }
+    catch(const SocketException&) {
+        // Errors on a UDP socket (e.g. ICMP errors from an earlier datagram)
+        // don't affect other datagrams. Try again next time
+    }
+}
+
+void Client::applyProfile(const SocketProfile& profile) {
+    // Lock socket
+    const std::lock_guard<std::mutex> sLockGuard(sLock);
+    if(clientSocket->isValid())
+        clientSocket->applyProfile(profile);
+}
+
+void Client::setKeepalive(int pingIntervalMs, int idleTimeoutMs) {
+    this->pingIntervalMs = pingIntervalMs;
+    this->idleTimeoutMs = idleTimeoutMs;
+}
+
+const LinkStats& Client::getLinkStats() const {
+    return link;
 }
 
 bool Client::isSocketOpen() {
+    if(localChannel != nullptr)
+        return !localChannel->isClosed();
+    
     return clientSocket->isValid();
 }
 
@@ -1,19 +1,118 @@
 #ifndef ROGUELIKE_CLIENT_HPP_INCLUDED
 #define ROGUELIKE_CLIENT_HPP_INCLUDED
 #include "../networking/ClientMessage.hpp"
+#include "../networking/LinkStats.hpp"
+#include "../networking/LocalChannel.hpp"
 #include "../networking/Socket.hpp"
+#include "../networking/Resolver.hpp"
+#include "../networking/SnapshotChannel.hpp"
+#include "../networking/Waker.hpp"
+#include <atomic>
+#include <chrono>
 #include <mutex>
+#include <deque>
 
 class Client {
     // Buffers and locks
     std::mutex rLock, wLock, sLock;
     Buffer rBuffer, wBuffer;
     
-    /// Client socket connected to server
+    /// Client socket connected to server. Invalid for local clients
     std::shared_ptr<Socket> clientSocket;
+    
+    /// Woken by addMessage, so poll sends new messages straight away
+    Waker sendWaker;
+    
+    /// Channel to a server in the same process. nullptr unless local
+    std::shared_ptr<LocalChannel> localChannel;
+    
+    /// Messages received through the local channel and not yet returned by
+    /// getMessages. Guarded by rLock
+    std::deque<std::unique_ptr<ClientMessage>> localMessages;
+    
+    /// Messages parsed from the read buffer and not yet returned by
+    /// getMessages. Guarded by rLock
+    std::deque<std::unique_ptr<ClientMessage>> received;
+    
+    /// Pieces of the message being received as fragments (see
+    /// ClientMessageFragment). Guarded by rLock
+    Buffer fragments;
+    
+    /// Timestamps of pings from the server that weren't answered yet. Guarded
+    /// by rLock
+    std::vector<uint64_t> pings;
+    
+    /// Traffic and round trip times of the connection
+    LinkStats link;
+    
+    /// Time between pings to the server, and time without input after which
+    /// the connection is closed. 0 if disabled
+    std::atomic<int> pingIntervalMs, idleTimeoutMs;
+    
+    /// Address and port of the server, for the snapshot channel
+    IN_ADDR serverAddress;
+    uint16_t serverPort;
+    
+    /// UDP socket for the snapshot channel. nullptr if there is no snapshot
+    /// channel. Guarded by sLock
+    std::shared_ptr<Socket> snapshotSocket;
+    
+    /// Snapshot channel state, guarded by rLock: the token given by the server
+    /// (0 until it arrives), whether the server refused, whether a datagram
+    /// from the server arrived, and the hellos sent so far
+    uint32_t snapshotToken = 0;
+    bool snapshotRefused = false;
+    bool snapshotConnected = false;
+    int hellosSent = 0;
+    std::chrono::steady_clock::time_point lastHello;
+    
+    /// Drops snapshots older than the newest of their type. Guarded by rLock
+    SnapshotFilter snapshotFilter;
+    
+    /// Snapshots not yet returned by getMessages. Guarded by rLock
+    std::deque<std::unique_ptr<ClientMessage>> snapshots;
+    
+    /// Send a hello datagram if the channel isn't connected yet and it's time
+    /// to. Requires sLock
+    void sendHello();
+    
+    /// Read all pending snapshot datagrams. Requires sLock
+    void receiveSnapshots();
+    
+    /// Read everything the server sent and parse it. Returns false if the
+    /// connection closed or the stream is malformed. Requires sLock
+    bool readMessages();
+    
+    /// Parse every full message in the read buffer, joining fragments and
+    /// handling snapshot channel tokens, pings and pongs here, and keeping
+    /// the rest for getMessages.
+    /// Returns false if the stream is malformed. Requires rLock
+    bool parseMessages();
+    
+    /// Answer pings from the server, send a ping if due, and close the
+    /// connection if the server went quiet for too long. Requires sLock
+    void keepAlive();
 public:
-    /// Connect client to server via host and port, with a timeout
-    Client(std::string host, uint16_t port, int timeoutMs);
+    /// Maximum amount of hello datagrams sent, and time between them. If none
+    /// get an answer, snapshots keep arriving over TCP
+    static const int maxHellos = 10;
+    static const int helloIntervalMs = 250;
+    
+    /// Wire format used to talk to the server. Must match the server's
+    const WireFormat wireFormat;
+    
+    /// Connect client to server via host and port, with a timeout and wire
+    /// format. The host is resolved with the given resolver, which caches it
+    /// for later connections. The timeout covers both resolving and
+    /// connecting. Resolving blocks the caller, so a caller that must keep
+    /// responding should start the lookup with resolver.resolveAsync first,
+    /// and create the client once it is done
+    Client(std::string host, uint16_t port, int timeoutMs, WireFormat wireFormat = WireFormat::Fixed, Resolver& resolver = Resolver::global());
+    
+    /// Connect client to a server in the same process through a channel (see
+    /// Server::connectLocal). Messages are passed as objects; there is no
+    /// socket, wire format or snapshot channel
+    Client(std::shared_ptr<LocalChannel> channel);
     
     /// Destructor
     virtual ~Client();
@@ -23,15 +122,47 @@ public:
     
     /// Attempt to send buffered messages. Stops sending even if not all data
     /// was sent if after timeoutMs milliseconds, unless timeout is negative
-    /// where it tries forever
+    /// where it tries forever. Waits for the socket to be writable when it is
+    /// full, instead of retrying
     void sendMessages(int timeoutMs);
     
+    /// Receive and send messages, for a network loop. Waits up to timeoutMs
+    /// for data from the server, for addMessage to queue a message, or for
+    /// the socket to become writable if it didn't take everything last time.
+    /// Then reads what arrived and writes what the socket takes, without
+    /// waiting. Messages added from other threads go out as soon as they are
+    /// added
+    void poll(int timeoutMs);
+    
     /// Add a message to be sent to the server
     void addMessage(const ClientMessage& message);
     
-    /// Get messages sent to the client
+    /// Get messages sent to the client, including snapshots received over the
+    /// snapshot channel
     std::deque<std::unique_ptr<ClientMessage>> getMessages();
     
+    /// Ask the server for a snapshot channel (see SnapshotChannel.hpp).
+    /// Snapshots then arrive over UDP, possibly out of order with other
+    /// messages; old ones are dropped. If the server has no snapshot channel,
+    /// or UDP doesn't get through, everything keeps arriving over TCP
+    void requestSnapshotChannel();
+    
+    /// Check if the snapshot channel is up
+    bool hasSnapshotChannel();
+    
+    /// Apply socket options to the connection to the server
+    void applyProfile(const SocketProfile& profile);
+    
+    /// Ping the server every pingIntervalMs, measuring round trip times (see
+    /// getLinkStats), and close the connection if nothing arrives for
+    /// idleTimeoutMs. 0 disables either; both are disabled by default. Pings
+    /// are sent, and pings from the server answered, by receiveMessages and
+    /// poll
+    void setKeepalive(int pingIntervalMs, int idleTimeoutMs);
+    
+    /// Gets traffic and round trip times of the connection to the server
+    const LinkStats& getLinkStats() const;
+    
     /// Check if client socket is still open
     bool isSocketOpen();
 };
@@ -17,11 +17,9 @@ enum ClientMenuItem {
 void GameClient::netLoop() {
     try {
         while(playing) {
-            // Receive messages with 250 ms timeout
-            receiveMessages(250);
-            
-            // Send messages with 250 ms timeout
-            sendMessages(250);
+            // Receive and send messages. Actions are sent as soon as they are
+            // added; the timeout only bounds how long stopping takes
+            poll(250);
             
             // Kill network loop if socket was closed
             if(!isSocketOpen())
@@ -44,6 +42,7 @@ void GameClient::logic(Renderer* renderer) {
     // Setup renderer with name menu
     std::string playerName;
     std::shared_ptr<Map> map = nullptr;
+    ObjectMirror objectMirror;
     std::shared_ptr<Camera> cam = nullptr;
     std::shared_ptr<Menu> focus = nullptr;
     
@@ -52,7 +51,7 @@ void GameClient::logic(Renderer* renderer) {
     actionMenu->addItem(quitAction);
     actionMenu->toggleExpand(false);
     actionMenu->setSplit(10);
-                            
+    
     std::shared_ptr<InputMenuItem> nameInput(new InputMenuItem(ClientMenuItem::TextItem, "My name is", "Riley"));
     {
         std::shared_ptr<MenuItem> nameText(new MenuItem(ClientMenuItem::TextItem, "What is your name?", false));
@@ -126,6 +125,27 @@ void GameClient::logic(Renderer* renderer) {
                         map->objects = mapObjectDataMessage->objects;
                     }
                     break;
+                case GameMessageType::ObjectDelta:
+                    {
+                        // Confirm every baseline, so the next deltas are
+                        // based on it. Ask for the whole level if the delta's
+                        // baseline is gone
+                        auto objectDeltaMessage = dynamic_cast<ClientMessageObjectDelta*>(it->get());
+                        switch(objectMirror.apply(objectDeltaMessage->delta)) {
+                            case ObjectDeltaResult::Applied:
+                                if(!map)
+                                    map = std::shared_ptr<Map>(new Map());
+                                map->objects = objectMirror.getObjects();
+                                addMessage(ClientMessageDoObjectAck(objectDeltaMessage->delta.sequence));
+                                break;
+                            case ObjectDeltaResult::MissingBaseline:
+                                addMessage(ClientMessageDoObjectAck(0));
+                                break;
+                            case ObjectDeltaResult::Stale:
+                                break;
+                        }
+                    }
+                    break;
                 case GameMessageType::PlayerData:
                     {
                         auto playerDataMessage = dynamic_cast<ClientMessagePlayerData*>(it->get());
@@ -221,6 +241,7 @@ void GameClient::logic(Renderer* renderer) {
                                         
                                         playerName = inputName;
                                         addMessage(ClientMessageDoJoin(playerName));
+                                        requestSnapshotChannel();
                                         std::shared_ptr<MenuItem> joiningText(new MenuItem(ClientMenuItem::TextItem, "Joining as " + playerName + "...", false));
                                         std::shared_ptr<MenuItem> joiningCancel(new MenuItem(ClientMenuItem::JoinCancel, "Cancel"));
                                         std::shared_ptr<Menu> joiningMenu(new Menu(4, 3, midX, midY));
@@ -251,11 +272,7 @@ void GameClient::logic(Renderer* renderer) {
     renderer->clear_drawables_lock();
 }
 
-GameClient::GameClient(Renderer* renderer, std::string host, uint16_t port) :
-    Client(host, port, 5000), // 5s timeout
-    renderer(renderer),
-    playing(true)
-{
+void GameClient::run() {
     // Start network thread
     netThread = std::thread(&GameClient::netLoop, this);
     
@@ -268,3 +285,26 @@ GameClient::GameClient(Renderer* renderer, std::string host, uint16_t port) :
     // Clear drawables
     renderer->clear_drawables_lock();
 }
+
+GameClient::GameClient(Renderer* renderer, std::string host, uint16_t port, WireFormat wireFormat) :
+    Client(host, port, 5000, wireFormat), // 5s timeout
+    renderer(renderer),
+    playing(true)
+{
+    // Actions and turn updates are small and need to arrive quickly
+    applyProfile(SocketProfile::lowLatency());
+    
+    // Measure round trip times, and notice a server that went away without
+    // closing the connection
+    setKeepalive(1000, 10000);
+    
+    run();
+}
+
+GameClient::GameClient(Renderer* renderer, std::shared_ptr<LocalChannel> channel) :
+    Client(channel),
+    renderer(renderer),
+    playing(true)
+{
+    run();
+}
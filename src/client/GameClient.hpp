@@ -14,7 +14,8 @@ class GameClient : private Client {
     /// Network thread
     std::thread netThread;
     
-    /// Network loop. Receive and send messages without spinlooping or blocking
+    /// Network loop. Receive and send messages without spinlooping, sleeping
+    /// until there is something to do
     void netLoop();
     
     /// Render exception message to screen
@@ -23,9 +24,17 @@ class GameClient : private Client {
     /// Client logic
     void logic(Renderer* renderer);
     
+    /// Run the network thread and client logic until the user stops playing
+    void run();
+    
 public:
-    /// Connect to a server with hostname/address host and port number port
-    GameClient(Renderer* renderer, std::string host, uint16_t port);
+    /// Connect to a server with hostname/address host and port number port.
+    /// The wire format must match the server's
+    GameClient(Renderer* renderer, std::string host, uint16_t port, WireFormat wireFormat = WireFormat::Fixed);
+    
+    /// Connect to a server in the same process through a local channel (see
+    /// GameServer::connectLocal)
+    GameClient(Renderer* renderer, std::shared_ptr<LocalChannel> channel);
 };
 
 #endif
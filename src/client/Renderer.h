@@ -14,6 +14,7 @@
 #include <conio.h>
 #endif
 #include <mutex>
+#include <memory>
 
 class Renderer; // Forward-declare Renderer
 
@@ -21,7 +21,7 @@ public:
     }
     Texture(std::vector<std::vector<TexturePoint>> &texture) : m_plane(texture){};
     Texture(std::vector<std::vector<TexturePoint>> &&texture) : m_plane(texture){};
-    std::vector<std::vector<TexturePoint>> get_plane() const {
+    const std::vector<std::vector<TexturePoint>>& get_plane() const {
         return m_plane;
     }
 private:
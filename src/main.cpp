@@ -85,9 +85,51 @@ void invalidInputScreen(Renderer& renderer, std::string message) {
     popup(renderer, errorItemFormatting, "Invalid input! Press space or enter to continue...", message);
 }
 
+/// Resolve a host in the background, showing a connecting screen until the
+/// lookup is done. Returns false if it was cancelled with space or enter.
+/// Throws SocketException if the lookup failed or took over 5 seconds
+bool resolveHost(Renderer& renderer, const std::string& host) {
+    // Create connecting screen
+    std::shared_ptr<Menu> connectingMenu(new Menu(10, 4, renderer.getWidth() / 2, renderer.getHeight() / 2));
+    connectingMenu->toggleCenter(true);
+    
+    std::shared_ptr<MenuItem> connectingItem(new MenuItem(0, "Connecting to " + host + "...", false));
+    std::shared_ptr<MenuItem> cancelItem(new MenuItem(0, "Press space or enter to cancel", false));
+    connectingMenu->addItem(connectingItem);
+    connectingMenu->addItem(cancelItem);
+    
+    {
+        std::lock_guard<std::mutex> r_lock_guard(renderer.r_lock);
+        renderer.clear_drawables();
+        renderer.add_drawable(connectingMenu);
+    }
+    
+    // Poll the lookup once per frame, so the screen keeps responding. The
+    // result is cached, so the client gets it without waiting again
+    auto start = std::chrono::steady_clock::now();
+    Resolver::Result lookup = Resolver::global().resolveAsync(host);
+    while(lookup.wait_for(std::chrono::microseconds(16667)) != std::future_status::ready) {
+        if(renderer.kbhit()) {
+            char input = renderer.getch();
+            if(input == ' ' || input == '\n' || input == '\r')
+                return false;
+        }
+        
+        if(std::chrono::steady_clock::now() - start >= std::chrono::seconds(5))
+            throw SocketException("Timed out resolving " + host);
+    }
+    
+    lookup.get();
+    return true;
+}
+
 /// Connect client to server, handling network exceptions
 void connectClientToServer(Renderer& renderer, std::string host, uint16_t port) {
     try {
+        // Look the host up without blocking the screen
+        if(!resolveHost(renderer, host))
+            return;
+        
         // Connect to server
         GameClient(&renderer, host, port);
     }
@@ -97,6 +139,13 @@ void connectClientToServer(Renderer& renderer, std::string host, uint16_t port)
     }
 }
 
+/// Play on a server in the same process, through a local channel
+void connectClientLocally(Renderer& renderer, GameServer& server) {
+    std::shared_ptr<LocalChannel> channel(new LocalChannel());
+    server.connectLocal(channel);
+    GameClient(&renderer, channel);
+}
+
 /// Create a new server, handling network exceptions
 std::unique_ptr<GameServer> createServer(Renderer& renderer, uint16_t port) {
     std::unique_ptr<GameServer> server = nullptr;
@@ -245,9 +294,11 @@ int main() {
                                 // Start server
                                 server = createServer(renderer, port);
                                 
-                                // Connect client to server if server started
+                                // Connect client to server if server started.
+                                // The host plays without going through a
+                                // socket; others can still connect to port
                                 if(server)
-                                    connectClientToServer(renderer, "localhost", port);
+                                    connectClientLocally(renderer, *server);
                                 
                                 // Client stopped, reset to main menu
                                 changeMenu(renderer, currentMenu, mainMenu, clearDrawable);
@@ -280,7 +331,7 @@ int main() {
             }
         }
     }
-
+    
     // Wait for render thread to stop
     renderThread.join();
     
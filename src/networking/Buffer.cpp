@@ -1,226 +1,415 @@
 #include "Buffer.hpp"
+#include "BufferPool.hpp"
 #include <stdexcept>
-#include <iterator>
+#include <algorithm>
+#include <cstring>
 
-size_t Buffer::size() {
-    return curSize;
+size_t BufferView::size() const {
+    return firstSize + secondSize;
 }
 
-void Buffer::clear() {
-    chunks.clear();
-    curSize = 0;
+void BufferView::copy(uint8_t* cBuffer, size_t byteCount, size_t offset) const {
+    // Copy the part in the first half...
+    if(offset < firstSize) {
+        size_t firstPart = std::min(byteCount, firstSize - offset);
+        std::memcpy(cBuffer, first + offset, firstPart);
+        cBuffer += firstPart;
+        byteCount -= firstPart;
+        offset = 0;
+    }
+    else
+        offset -= firstSize;
+    
+    // ... and the rest in the second half
+    if(byteCount > 0)
+        std::memcpy(cBuffer, second + offset, byteCount);
 }
 
-void Buffer::erase(size_t byteCount) {
-    if(byteCount > curSize)
-        throw std::out_of_range("Buffer::erase(" + std::to_string(byteCount) + ") called but curSize is " + std::to_string(curSize));
-    
-    curSize -= byteCount;
-    
-    for(auto it = chunks.begin(); it != chunks.end();) {
-        if(it->size() > byteCount) {
-            it->erase(it->begin(), std::next(it->begin(), byteCount));
-            break;
-        }
-        
-        byteCount -= it->size();
-        it = chunks.erase(it);
-        
-        if(byteCount == 0)
-            break;
-    }
+size_t BufferSpace::size() const {
+    return firstSize + secondSize;
 }
 
-std::vector<uint8_t> Buffer::getBytes(size_t byteCount, size_t offset) {
-    if((byteCount + offset) > curSize)
-        throw std::out_of_range("Buffer::getBytes(" + std::to_string(byteCount) + ", " + std::to_string(offset) + ") called but curSize is " + std::to_string(curSize));
-    
-    std::vector<uint8_t> merged;
-    merged.reserve(byteCount);
+BufferCursor::BufferCursor(const BufferView& view) :
+    view(view)
+{}
+
+const uint8_t* BufferCursor::contiguous(size_t byteCount, uint8_t* scratch) {
+    if(byteCount > remaining())
+        throw std::out_of_range("BufferCursor: read of " + std::to_string(byteCount) + " bytes but only " + std::to_string(remaining()) + " remain");
     
-    for(auto it = chunks.begin(); it != chunks.end(); it++) {
-        if(offset >= it->size()) {
-            offset -= it->size();
-            continue;
-        }
-        
-        size_t bytesToRead = it->size() - offset;
-        if(bytesToRead > byteCount)
-            bytesToRead = byteCount;
-        
-        auto offsetBegin = std::next(it->begin(), offset);
-        auto offsetEnd = std::next(offsetBegin, bytesToRead);
-        merged.insert(merged.end(), offsetBegin, offsetEnd);
-        
-        byteCount -= bytesToRead;
-        
-        if(byteCount == 0)
-            break;
-        
-        offset = 0;
+    const uint8_t* bytes;
+    if(position + byteCount <= view.firstSize)
+        bytes = view.first + position;
+    else if(position >= view.firstSize)
+        bytes = view.second + (position - view.firstSize);
+    else {
+        // Straddles both parts, merge into scratch
+        view.copy(scratch, byteCount, position);
+        bytes = scratch;
     }
     
-    return merged;
+    position += byteCount;
+    return bytes;
 }
 
-std::vector<uint8_t> Buffer::popBytes(size_t byteCount) {
-    if(byteCount > curSize)
-        throw std::out_of_range("Buffer::popBytes(" + std::to_string(byteCount) + ") called but curSize is " + std::to_string(curSize));
+template<typename T> T BufferCursor::readInteger() {
+    uint8_t scratch[sizeof(T)];
+    return loadLittleEndian<T>(contiguous(sizeof(T), scratch));
+}
+
+size_t BufferCursor::remaining() const {
+    return view.size() - position;
+}
+
+void BufferCursor::skip(size_t byteCount) {
+    if(byteCount > remaining())
+        throw std::out_of_range("BufferCursor::skip(" + std::to_string(byteCount) + ") called but only " + std::to_string(remaining()) + " bytes remain");
     
-    curSize -= byteCount;
+    position += byteCount;
+}
+
+void BufferCursor::read(std::vector<uint8_t>& bytes, size_t byteCount) {
+    if(byteCount > remaining())
+        throw std::out_of_range("BufferCursor::read(bytes, " + std::to_string(byteCount) + ") called but only " + std::to_string(remaining()) + " bytes remain");
     
-    std::vector<uint8_t> merged;
-    merged.reserve(byteCount);
+    bytes.resize(byteCount);
+    view.copy(bytes.data(), byteCount, position);
+    position += byteCount;
+}
+
+void BufferCursor::read(std::string& string, size_t byteCount) {
+    if(byteCount > remaining())
+        throw std::out_of_range("BufferCursor::read(string, " + std::to_string(byteCount) + ") called but only " + std::to_string(remaining()) + " bytes remain");
     
-    for(auto it = chunks.begin(); it != chunks.end();) {
-        if(it->size() > byteCount) {
-            auto chunkEnd = std::next(it->begin(), byteCount);
-            merged.insert(merged.end(), it->begin(), chunkEnd);
-            it->erase(it->begin(), chunkEnd);
-            break;
-        }
-        
-        byteCount -= it->size();
-        merged.insert(merged.end(), it->begin(), it->end());
-        it = chunks.erase(it);
-        
-        if(byteCount == 0)
-            break;
+    string.resize(byteCount);
+    view.copy(reinterpret_cast<uint8_t*>(&string[0]), byteCount, position);
+    position += byteCount;
+}
+
+void BufferCursor::read(uint8_t& byte) {
+    byte = readInteger<uint8_t>();
+}
+
+void BufferCursor::read(uint16_t& uint16) {
+    uint16 = readInteger<uint16_t>();
+}
+
+void BufferCursor::read(uint32_t& uint32) {
+    uint32 = readInteger<uint32_t>();
+}
+
+void BufferCursor::read(uint64_t& uint64) {
+    uint64 = readInteger<uint64_t>();
+}
+
+void BufferCursor::read(int8_t& int8) {
+    int8 = readInteger<int8_t>();
+}
+
+void BufferCursor::read(int16_t& int16) {
+    int16 = readInteger<int16_t>();
+}
+
+void BufferCursor::read(int32_t& int32) {
+    int32 = readInteger<int32_t>();
+}
+
+void BufferCursor::read(int64_t& int64) {
+    int64 = readInteger<int64_t>();
+}
+
+bool BufferCursor::hasVarint() const {
+    // Look for the last byte (high bit clear). Overlong varints count as
+    // complete so that readVarint reports them
+    size_t byteCount = std::min(remaining(), maxVarintSize);
+    for(size_t i = 0; i < byteCount; i++) {
+        size_t offset = position + i;
+        uint8_t byte = offset < view.firstSize ? view.first[offset] : view.second[offset - view.firstSize];
+        if(!(byte & 0x80))
+            return true;
     }
     
-    return merged;
+    return byteCount == maxVarintSize;
 }
 
-void Buffer::orUIntToCBuffer(uintmax_t integer, size_t n, uint8_t* cBuffer) {
-    for(auto i = 0; i < n; i++) {
-        // OR byte into array
-        cBuffer[i] |= static_cast<uint8_t>(integer & 0xFF);
+void BufferCursor::readVarint(uint64_t& uint64) {
+    uint64 = 0;
+    for(size_t i = 0; i < maxVarintSize; i++) {
+        uint8_t byte = readInteger<uint8_t>();
+        if(i == maxVarintSize - 1 && byte > 1)
+            break; // Doesn't fit in 64 bits
         
-        // Shift integer right one byte
-        integer >>= 8;
+        uint64 |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if(!(byte & 0x80))
+            return;
     }
+    
+    throw std::invalid_argument("BufferCursor::readVarint: varint doesn't fit in " + std::to_string(maxVarintSize) + " bytes");
 }
 
-void Buffer::orIntToCBuffer(intmax_t integer, size_t n, uint8_t* cBuffer) {
-    // Special case for most negative number. Only set MSB
-    if(integer == INTMAX_MIN) {
-        cBuffer[n - 1] |= 0b10000000;
-        return;
+void BufferCursor::readVarint(int64_t& int64) {
+    uint64_t zigzag;
+    readVarint(zigzag);
+    int64 = zigzagDecode(zigzag);
+}
+
+Buffer::Buffer(const Buffer& other) {
+    *this = other;
+}
+
+Buffer::Buffer(Buffer&& other) {
+    *this = std::move(other);
+}
+
+Buffer& Buffer::operator=(const Buffer& other) {
+    if(this != &other) {
+        clear();
+        reserve(other.curSize);
+        other.copyOut(storage, other.curSize, 0);
+        curSize = other.curSize;
     }
     
-    // Encode as 2's complement integer. Extra padding will be safely truncated
-    if(integer < 0)
-        orUIntToCBuffer(~static_cast<uintmax_t>(-integer) + 1, n, cBuffer);
-    else
-        orUIntToCBuffer(static_cast<uintmax_t>(integer), n, cBuffer);
+    return *this;
 }
 
-void Buffer::insertUInt(uintmax_t integer, size_t n) {
-    std::vector<uint8_t> bytes(n, 0);
-    orUIntToCBuffer(integer, n, bytes.data());
-    chunks.push_back(bytes);
-    curSize += n;
+Buffer& Buffer::operator=(Buffer&& other) {
+    if(this != &other) {
+        BufferPool::release(storage, capacity);
+        
+        // Take ownership of other's storage
+        storage = other.storage;
+        capacity = other.capacity;
+        head = other.head;
+        curSize = other.curSize;
+        
+        // Leave other empty
+        other.storage = nullptr;
+        other.capacity = 0;
+        other.head = 0;
+        other.curSize = 0;
+    }
+    
+    return *this;
 }
 
-void Buffer::insertInt(intmax_t integer, size_t n) {
-    std::vector<uint8_t> bytes(n, 0);
-    orIntToCBuffer(integer, n, bytes.data());
-    chunks.push_back(bytes);
-    curSize += n;
+Buffer::~Buffer() {
+    BufferPool::release(storage, capacity);
 }
 
-uintmax_t Buffer::cBufferToUInt(size_t n, uint8_t* cBuffer) {
-    uintmax_t integer = 0;
-    for(auto i = 0; i < n; i++)
-        integer += static_cast<uintmax_t>(cBuffer[i]) << (i * 8);
-    return integer;
+void Buffer::releaseStorage() {
+    BufferPool::release(storage, capacity);
+    storage = nullptr;
+    capacity = 0;
+    head = 0;
 }
 
-intmax_t Buffer::cBufferToInt(size_t n, uint8_t* cBuffer) {
-    intmax_t integer = 0;
+void Buffer::reserve(size_t byteCount) {
+    size_t needed = curSize + byteCount;
+    if(needed <= capacity)
+        return;
     
-    // Decode most significant byte
-    uint8_t msByte = cBuffer[n - 1];
+    // Grow to the next power of two, with a minimum block size
+    size_t newCapacity = capacity == 0 ? BufferPool::minBlockSize : capacity;
+    while(newCapacity < needed)
+        newCapacity <<= 1;
     
-    // Negative bit
-    if(msByte & 0b10000000)
-        integer = -(static_cast<uintmax_t>(1) << (n * 8 - 1));
+    // Move data to the start of the new storage
+    uint8_t* newStorage = BufferPool::allocate(newCapacity);
+    copyOut(newStorage, curSize, 0);
+    BufferPool::release(storage, capacity);
     
-    // Positive bits
-    integer += static_cast<uintmax_t>(msByte & 0b01111111) << ((n - 1) * 8);
+    storage = newStorage;
+    capacity = newCapacity;
+    head = 0;
+}
+
+void Buffer::copyOut(uint8_t* cBuffer, size_t byteCount, size_t offset) const {
+    if(byteCount == 0)
+        return;
+    
+    // Copy up to the end of the storage, then wrap around to the start
+    size_t start = (head + offset) & (capacity - 1);
+    size_t firstPart = std::min(byteCount, capacity - start);
+    std::memcpy(cBuffer, storage + start, firstPart);
+    std::memcpy(cBuffer + firstPart, storage, byteCount - firstPart);
+}
+
+void Buffer::copyIn(const uint8_t* cBuffer, size_t byteCount) {
+    if(byteCount == 0)
+        return;
     
-    // Decode positive bits of integer
-    for(auto i = 0; i < n - 1; i++)
-        integer += static_cast<uintmax_t>(cBuffer[i]) << (i * 8);
+    reserve(byteCount);
     
-    return integer;
+    // Copy up to the end of the storage, then wrap around to the start
+    size_t tail = (head + curSize) & (capacity - 1);
+    size_t firstPart = std::min(byteCount, capacity - tail);
+    std::memcpy(storage + tail, cBuffer, firstPart);
+    std::memcpy(storage, cBuffer + firstPart, byteCount - firstPart);
+    curSize += byteCount;
+}
+
+size_t Buffer::size() {
+    return curSize;
+}
+
+void Buffer::clear() {
+    curSize = 0;
+    releaseStorage();
+}
+
+void Buffer::erase(size_t byteCount) {
+    if(byteCount > curSize)
+        throw std::out_of_range("Buffer::erase(" + std::to_string(byteCount) + ") called but curSize is " + std::to_string(curSize));
+    
+    curSize -= byteCount;
+    
+    // Give the storage back to the pool when empty, so that idle buffers
+    // don't hold on to memory and busy ones get recycled blocks
+    if(curSize == 0)
+        releaseStorage();
+    else
+        head = (head + byteCount) & (capacity - 1);
+}
+
+std::vector<uint8_t> Buffer::getBytes(size_t byteCount, size_t offset) {
+    if((byteCount + offset) > curSize)
+        throw std::out_of_range("Buffer::getBytes(" + std::to_string(byteCount) + ", " + std::to_string(offset) + ") called but curSize is " + std::to_string(curSize));
+    
+    std::vector<uint8_t> merged(byteCount);
+    copyOut(merged.data(), byteCount, offset);
+    return merged;
 }
 
-template<typename T> T Buffer::getUInt(size_t offset) {
-    auto bytes = getBytes(sizeof(T), offset);
-    return static_cast<T>(cBufferToUInt(sizeof(T), bytes.data()));
+std::vector<uint8_t> Buffer::popBytes(size_t byteCount) {
+    if(byteCount > curSize)
+        throw std::out_of_range("Buffer::popBytes(" + std::to_string(byteCount) + ") called but curSize is " + std::to_string(curSize));
+    
+    std::vector<uint8_t> merged(byteCount);
+    copyOut(merged.data(), byteCount, 0);
+    erase(byteCount);
+    return merged;
 }
 
-template<typename T> T Buffer::getInt(size_t offset) {
-    auto bytes = getBytes(sizeof(T), offset);
-    return static_cast<T>(cBufferToInt(sizeof(T), bytes.data()));
+template<typename T> void Buffer::insertInteger(T integer) {
+    uint8_t bytes[sizeof(T)];
+    storeLittleEndian(integer, bytes);
+    copyIn(bytes, sizeof(T));
 }
 
-template<typename T> T Buffer::popUInt() {
-    auto bytes = popBytes(sizeof(T));
-    return static_cast<T>(cBufferToUInt(sizeof(T), bytes.data()));
+template<typename T> T Buffer::getInteger(size_t offset) {
+    if((sizeof(T) + offset) > curSize)
+        throw std::out_of_range("Buffer::getInteger(" + std::to_string(offset) + ") called but curSize is " + std::to_string(curSize));
+    
+    uint8_t bytes[sizeof(T)];
+    copyOut(bytes, sizeof(T), offset);
+    return loadLittleEndian<T>(bytes);
 }
 
-template<typename T> T Buffer::popInt() {
-    auto bytes = popBytes(sizeof(T));
-    return static_cast<T>(cBufferToInt(sizeof(T), bytes.data()));
+template<typename T> T Buffer::popInteger() {
+    T integer = getInteger<T>(0);
+    erase(sizeof(T));
+    return integer;
 }
 
 void Buffer::insert(const std::vector<uint8_t>& bytes) {
-    if(bytes.size() != 0) {
-        chunks.push_back(bytes);
-        curSize += bytes.size();
-    }
+    copyIn(bytes.data(), bytes.size());
 }
 
 void Buffer::insert(const std::string& string) {
-    if(string.size() != 0) {
-        chunks.emplace_back(string.begin(), string.end());
-        curSize += string.size();
-    }
+    copyIn(reinterpret_cast<const uint8_t*>(string.data()), string.size());
 }
 
 void Buffer::insert(uint8_t byte) {
-    chunks.emplace_back(1, byte);
-    curSize++;
+    copyIn(&byte, 1);
 }
 
 void Buffer::insert(uint16_t uint16) {
-    insertUInt(uint16, 2);
+    insertInteger(uint16);
 }
 
 void Buffer::insert(uint32_t uint32) {
-    insertUInt(uint32, 4);
+    insertInteger(uint32);
 }
 
 void Buffer::insert(uint64_t uint64) {
-    insertUInt(uint64, 8);
+    insertInteger(uint64);
 }
 
 void Buffer::insert(int8_t int8) {
-    insertInt(int8, 1);
+    insertInteger(int8);
 }
 
 void Buffer::insert(int16_t int16) {
-    insertInt(int16, 2);
+    insertInteger(int16);
 }
 
 void Buffer::insert(int32_t int32) {
-    insertInt(int32, 4);
+    insertInteger(int32);
 }
 
 void Buffer::insert(int64_t int64) {
-    insertInt(int64, 8);
+    insertInteger(int64);
+}
+
+void Buffer::insertVarint(uint64_t uint64) {
+    uint8_t bytes[maxVarintSize];
+    copyIn(bytes, storeVarint(uint64, bytes));
+}
+
+void Buffer::insertVarint(int64_t int64) {
+    insertVarint(zigzagEncode(int64));
+}
+
+BufferSpace Buffer::prepare(size_t byteCount) {
+    reserve(byteCount);
+    
+    // Free space starts after the data and may wrap around to the start of
+    // the storage
+    BufferSpace space;
+    size_t freeSize = capacity - curSize;
+    if(freeSize == 0)
+        return space;
+    
+    size_t tail = (head + curSize) & (capacity - 1);
+    space.first = storage + tail;
+    space.firstSize = std::min(freeSize, capacity - tail);
+    if(space.firstSize < freeSize) {
+        space.second = storage;
+        space.secondSize = freeSize - space.firstSize;
+    }
+    
+    return space;
+}
+
+void Buffer::commit(size_t byteCount) {
+    if(byteCount > capacity - curSize)
+        throw std::out_of_range("Buffer::commit(" + std::to_string(byteCount) + ") called but only " + std::to_string(capacity - curSize) + " bytes were prepared");
+    
+    curSize += byteCount;
+    
+    // Nothing was written to an empty buffer, don't hold on to the storage
+    if(curSize == 0 && storage != nullptr)
+        releaseStorage();
+}
+
+BufferView Buffer::peek(size_t byteCount, size_t offset) const {
+    if((byteCount + offset) > curSize)
+        throw std::out_of_range("Buffer::peek(" + std::to_string(byteCount) + ", " + std::to_string(offset) + ") called but curSize is " + std::to_string(curSize));
+    
+    BufferView view;
+    if(byteCount == 0)
+        return view;
+    
+    // Split at the end of the storage if the bytes wrap around
+    size_t start = (head + offset) & (capacity - 1);
+    view.first = storage + start;
+    view.firstSize = std::min(byteCount, capacity - start);
+    if(view.firstSize < byteCount) {
+        view.second = storage;
+        view.secondSize = byteCount - view.firstSize;
+    }
+    
+    return view;
 }
 
 void Buffer::get(std::vector<uint8_t>& bytes, size_t byteCount, size_t offset) {
@@ -228,40 +417,43 @@ void Buffer::get(std::vector<uint8_t>& bytes, size_t byteCount, size_t offset) {
 }
 
 void Buffer::get(std::string& string, size_t byteCount, size_t offset) {
-    std::vector<uint8_t> bytes = getBytes(byteCount, offset);
-    string = std::string(bytes.begin(), bytes.end());
+    if((byteCount + offset) > curSize)
+        throw std::out_of_range("Buffer::get(string, " + std::to_string(byteCount) + ", " + std::to_string(offset) + ") called but curSize is " + std::to_string(curSize));
+    
+    string.resize(byteCount);
+    copyOut(reinterpret_cast<uint8_t*>(&string[0]), byteCount, offset);
 }
 
 void Buffer::get(uint8_t& byte, size_t offset) {
-    byte = getBytes(1, offset)[0];
+    byte = getInteger<uint8_t>(offset);
 }
 
 void Buffer::get(uint16_t& uint16, size_t offset) {
-    uint16 = getUInt<uint16_t>(offset);
+    uint16 = getInteger<uint16_t>(offset);
 }
 
 void Buffer::get(uint32_t& uint32, size_t offset) {
-    uint32 = getUInt<uint32_t>(offset);
+    uint32 = getInteger<uint32_t>(offset);
 }
 
 void Buffer::get(uint64_t& uint64, size_t offset) {
-    uint64 = getUInt<uint64_t>(offset);
+    uint64 = getInteger<uint64_t>(offset);
 }
 
 void Buffer::get(int8_t& int8, size_t offset) {
-    int8 = getInt<int8_t>(offset);
+    int8 = getInteger<int8_t>(offset);
 }
 
 void Buffer::get(int16_t& uint16, size_t offset) {
-    uint16 = getInt<int16_t>(offset);
+    uint16 = getInteger<int16_t>(offset);
 }
 
 void Buffer::get(int32_t& uint32, size_t offset) {
-    uint32 = getInt<int32_t>(offset);
+    uint32 = getInteger<int32_t>(offset);
 }
 
 void Buffer::get(int64_t& uint64, size_t offset) {
-    uint64 = getInt<int64_t>(offset);
+    uint64 = getInteger<int64_t>(offset);
 }
 
 void Buffer::pop(std::vector<uint8_t>& bytes, size_t byteCount) {
@@ -269,38 +461,52 @@ void Buffer::pop(std::vector<uint8_t>& bytes, size_t byteCount) {
 }
 
 void Buffer::pop(std::string& string, size_t byteCount) {
-    std::vector<uint8_t> bytes = popBytes(byteCount);
-    string = std::string(bytes.begin(), bytes.end());
+    get(string, byteCount);
+    erase(byteCount);
 }
 
 void Buffer::pop(uint8_t& byte) {
-    byte = popBytes(1)[0];
+    byte = popInteger<uint8_t>();
 }
 
 void Buffer::pop(uint16_t& uint16) {
-    uint16 = popUInt<uint16_t>();
+    uint16 = popInteger<uint16_t>();
 }
 
 void Buffer::pop(uint32_t& uint32) {
-    uint32 = popUInt<uint32_t>();
+    uint32 = popInteger<uint32_t>();
 }
 
 void Buffer::pop(uint64_t& uint64) {
-    uint64 = popUInt<uint64_t>();
+    uint64 = popInteger<uint64_t>();
 }
 
 void Buffer::pop(int8_t& int8) {
-    int8 = popInt<int8_t>();
+    int8 = popInteger<int8_t>();
 }
 
 void Buffer::pop(int16_t& int16) {
-    int16 = popInt<int16_t>();
+    int16 = popInteger<int16_t>();
 }
 
 void Buffer::pop(int32_t& int32) {
-    int32 = popInt<int32_t>();
+    int32 = popInteger<int32_t>();
 }
 
 void Buffer::pop(int64_t& int64) {
-    int64 = popInt<int64_t>();
+    int64 = popInteger<int64_t>();
+}
+
+void Buffer::popVarint(uint64_t& uint64) {
+    // Decode in place, then erase what was read
+    BufferView view = peek(std::min(curSize, maxVarintSize));
+    BufferCursor cursor(view);
+    cursor.readVarint(uint64);
+    erase(view.size() - cursor.remaining());
+}
+
+void Buffer::popVarint(int64_t& int64) {
+    uint64_t zigzag;
+    popVarint(zigzag);
+    int64 = zigzagDecode(zigzag);
 }
@@ -1,59 +1,289 @@
 #ifndef ROGUELIKE_BUFFER_HPP_INCLUDED
 #define ROGUELIKE_BUFFER_HPP_INCLUDED
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
-#include <array>
-#include <deque>
+#include <type_traits>
+#include <stdexcept>
 
+// Detect big-endian hosts. Everything else (including MSVC) is assumed to be
+// little-endian
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define ROGUELIKE_BIG_ENDIAN
+#endif
+
+/// Reverses the byte order of an unsigned integer. Only used on big-endian
+/// hosts
+template<typename T> inline T byteswap(T integer) {
+    static_assert(std::is_unsigned<T>::value, "byteswap: T must be unsigned");
+    #if defined(__GNUC__) || defined(__clang__)
+    switch(sizeof(T)) {
+        case 2:
+            return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(integer)));
+        case 4:
+            return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(integer)));
+        case 8:
+            return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(integer)));
+    }
+    #endif
+    
+    T swapped = 0;
+    for(size_t i = 0; i < sizeof(T); i++) {
+        swapped = static_cast<T>((swapped << 8) | (integer & 0xFF));
+        integer >>= 8;
+    }
+    return swapped;
+}
+
+/// Stores an integer to a C byte buffer as a little-endian, sizeof(T)-byte,
+/// 2's complement integer
+template<typename T> inline void storeLittleEndian(T integer, uint8_t* cBuffer) {
+    static_assert(std::is_integral<T>::value, "storeLittleEndian: T must be an integer");
+    typedef typename std::make_unsigned<T>::type U;
+    U bits = static_cast<U>(integer);
+    #ifdef ROGUELIKE_BIG_ENDIAN
+    bits = byteswap(bits);
+    #endif
+    std::memcpy(cBuffer, &bits, sizeof(T));
+}
+
+/// Loads a little-endian, sizeof(T)-byte, 2's complement integer from a C
+/// byte buffer
+template<typename T> inline T loadLittleEndian(const uint8_t* cBuffer) {
+    static_assert(std::is_integral<T>::value, "loadLittleEndian: T must be an integer");
+    typedef typename std::make_unsigned<T>::type U;
+    U bits;
+    std::memcpy(&bits, cBuffer, sizeof(T));
+    #ifdef ROGUELIKE_BIG_ENDIAN
+    bits = byteswap(bits);
+    #endif
+    return static_cast<T>(bits);
+}
+
+/// Maximum size of a LEB128 varint holding a 64-bit integer, in bytes
+const size_t maxVarintSize = 10;
+
+/// Maps a signed integer to an unsigned one so that values close to zero have
+/// short varint encodings (0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...)
+inline uint64_t zigzagEncode(int64_t integer) {
+    uint64_t bits = static_cast<uint64_t>(integer);
+    return (bits << 1) ^ (0 - (bits >> 63));
+}
+
+/// Reverses zigzagEncode
+inline int64_t zigzagDecode(uint64_t integer) {
+    return static_cast<int64_t>((integer >> 1) ^ (0 - (integer & 1)));
+}
+
+/// Size of an unsigned LEB128 varint, in bytes
+inline size_t varintSize(uint64_t integer) {
+    size_t size = 1;
+    while(integer >= 0x80) {
+        integer >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/// Stores an unsigned LEB128 varint (7 bits per byte, least significant
+/// group first, high bit set on all but the last byte) to a C byte buffer.
+/// Returns the number of bytes written, at most maxVarintSize
+inline size_t storeVarint(uint64_t integer, uint8_t* cBuffer) {
+    size_t size = 0;
+    while(integer >= 0x80) {
+        cBuffer[size++] = static_cast<uint8_t>(integer | 0x80);
+        integer >>= 7;
+    }
+    cBuffer[size++] = static_cast<uint8_t>(integer);
+    return size;
+}
+
+/// A read-only view over bytes stored in a Buffer. Since Buffer is a ring
+/// buffer, the bytes may straddle the end of its storage, so a view is made
+/// of at most two contiguous parts. A view is invalidated by any change to
+/// the Buffer it was taken from
+struct BufferView {
+    /// First contiguous part
+    const uint8_t* first = nullptr;
+    size_t firstSize = 0;
+    
+    /// Second contiguous part. Empty if the bytes don't wrap around
+    const uint8_t* second = nullptr;
+    size_t secondSize = 0;
+    
+    /// Total size of the view
+    size_t size() const;
+    
+    /// Copies byteCount bytes, starting at offset, to a C byte buffer. Does
+    /// not check bounds
+    void copy(uint8_t* cBuffer, size_t byteCount, size_t offset) const;
+};
+
+/// Writable space at the end of a Buffer, after its data. Like BufferView, it
+/// is made of at most two contiguous parts. It is invalidated by any change to
+/// the Buffer it was taken from
+struct BufferSpace {
+    /// First contiguous part
+    uint8_t* first = nullptr;
+    size_t firstSize = 0;
+    
+    /// Second contiguous part. Empty if the space doesn't wrap around
+    uint8_t* second = nullptr;
+    size_t secondSize = 0;
+    
+    /// Total size of the space
+    size_t size() const;
+};
+
+/// A read cursor over a BufferView. Decodes values in place, so reading
+/// fixed-width integers never allocates. Throws std::out_of_range when
+/// reading past the end of the view, like Buffer does
+class BufferCursor {
+    /// Bytes being read
+    BufferView view;
+    
+    /// Read position, relative to the start of the view
+    size_t position = 0;
+    
+    /// Gets a pointer to byteCount contiguous bytes at the read position. If
+    /// the bytes straddle both parts of the view, they are copied to scratch
+    const uint8_t* contiguous(size_t byteCount, uint8_t* scratch);
+    
+    /// Reads a little-endian integer
+    template<typename T> inline T readInteger();
+
+public:
+    /// Create a cursor at the start of a view
+    BufferCursor(const BufferView& view);
+    
+    /// Number of bytes that haven't been read yet
+    size_t remaining() const;
+    
+    /// Skip byteCount bytes
+    void skip(size_t byteCount);
+    
+    // Reads byteCount bytes
+    void read(std::vector<uint8_t>& bytes, size_t byteCount);
+    
+    // Reads a string with byteCount bytes
+    void read(std::string& string, size_t byteCount);
+    
+    // Reads a byte
+    void read(uint8_t& byte);
+    
+    // Reads a little-endian uint16_t
+    void read(uint16_t& uint16);
+    
+    // Reads a little-endian uint32_t
+    void read(uint32_t& uint32);
+    
+    // Reads a little-endian uint64_t
+    void read(uint64_t& uint64);
+    
+    // Reads a little-endian int8_t
+    void read(int8_t& int8);
+    
+    // Reads a little-endian int16_t
+    void read(int16_t& int16);
+    
+    // Reads a little-endian int32_t
+    void read(int32_t& int32);
+    
+    // Reads a little-endian int64_t
+    void read(int64_t& int64);
+    
+    // Checks if a complete varint starts at the read position
+    bool hasVarint() const;
+    
+    // Reads an unsigned LEB128 varint. Throws std::invalid_argument if it
+    // doesn't fit in 64 bits
+    void readVarint(uint64_t& uint64);
+    
+    // Reads a zigzag-encoded signed LEB128 varint
+    void readVarint(int64_t& int64);
+    
+    // Reads count little-endian integers to a C array
+    template<typename T> void readArray(T* integers, size_t count) {
+        static_assert(std::is_integral<T>::value, "BufferCursor::readArray: T must be an integer");
+        if(count > remaining() / sizeof(T))
+            throw std::out_of_range("BufferCursor::readArray: read of " + std::to_string(count) + " integers but only " + std::to_string(remaining()) + " bytes remain");
+        
+        #ifdef ROGUELIKE_BIG_ENDIAN
+        uint8_t scratch[sizeof(T)];
+        for(size_t i = 0; i < count; i++)
+            integers[i] = loadLittleEndian<T>(contiguous(sizeof(T), scratch));
+        #else
+        // Wire format matches memory layout, copy everything at once
+        view.copy(reinterpret_cast<uint8_t*>(integers), count * sizeof(T), position);
+        position += count * sizeof(T);
+        #endif
+    }
+};
+
+/// A FIFO byte buffer. Data is stored in a single growable ring buffer with a
+/// power-of-two capacity, so inserting small values does not allocate once
+/// the buffer has grown to its steady-state size. Storage is drawn from (and
+/// returned to) the BufferPool, and is released whenever the buffer is empty
 class Buffer {
-    /// Chunks of data. Merge with pop() or get()
-    std::deque<std::vector<uint8_t>> chunks;
+    /// Ring buffer storage. Capacity is always 0 or a power of two
+    uint8_t* storage = nullptr;
+    
+    /// Size of the storage, in bytes
+    size_t capacity = 0;
+    
+    /// Index of the first byte in the storage
+    size_t head = 0;
     
     /// Current buffer size
     size_t curSize = 0;
     
-    /// Gets data from the buffer, with an offset
-    std::vector<uint8_t> getBytes(size_t byteCount, size_t offset);
+    /// Returns the storage to the BufferPool. Only call when empty
+    void releaseStorage();
     
-    /// Gets data from the buffer, removing read data
-    std::vector<uint8_t> popBytes(size_t byteCount);
-    
-    /// ORs a little-endian n-byte unsigned integer to a given C byte buffer
-    void orUIntToCBuffer(uintmax_t integer, size_t n, uint8_t* cBuffer);
+    /// Grows the storage (if needed) so that byteCount more bytes fit.
+    /// Existing data is linearised to the start of the new storage
+    void reserve(size_t byteCount);
     
-    /// ORs a little-endian n-byte signed integer to a given C byte buffer
-    void orIntToCBuffer(intmax_t integer, size_t n, uint8_t* cBuffer);
+    /// Copies byteCount bytes, starting at offset, to a C byte buffer. Does
+    /// not check bounds
+    void copyOut(uint8_t* cBuffer, size_t byteCount, size_t offset) const;
     
-    /// Inserts a little-endian n-byte unsigned integer to the buffer
-    inline void insertUInt(uintmax_t integer, size_t n);
+    /// Appends byteCount bytes from a C byte buffer to the end of the buffer
+    void copyIn(const uint8_t* cBuffer, size_t byteCount);
     
-    /// Inserts a little-endian n-byte signed integer to the buffer
-    inline void insertInt(intmax_t integer, size_t n);
+    /// Gets data from the buffer, with an offset
+    std::vector<uint8_t> getBytes(size_t byteCount, size_t offset);
     
-    /// Gets a little-endian n-byte unsigned integer from a given C byte buffer
-    uintmax_t cBufferToUInt(size_t n, uint8_t* cBuffer);
+    /// Gets data from the buffer, removing read data
+    std::vector<uint8_t> popBytes(size_t byteCount);
     
-    /// Gets a little-endian n-byte signed integer from a given C byte buffer
-    intmax_t cBufferToInt(size_t n, uint8_t* cBuffer);
+    /// Inserts a little-endian integer to the buffer
+    template<typename T> inline void insertInteger(T integer);
     
-    /// Gets a little-endian n-byte unsigned integer from the buffer
-    template<typename T> inline T getUInt(size_t offset);
+    /// Gets a little-endian integer from the buffer
+    template<typename T> inline T getInteger(size_t offset);
     
-    /// Gets a little-endian n-byte signed integer from the buffer
-    template<typename T> inline T getInt(size_t offset);
+    /// Pops a little-endian integer from the buffer
+    template<typename T> inline T popInteger();
+
+public:
+    /// Create empty buffer. Nothing is allocated until data is inserted
+    Buffer() = default;
     
-    /// Pops a little-endian n-byte unsigned integer from the buffer
-    template<typename T> inline T popUInt();
+    /// Buffers can be copied and moved
+    Buffer(const Buffer& other);
+    Buffer(Buffer&& other);
+    Buffer& operator=(const Buffer& other);
+    Buffer& operator=(Buffer&& other);
     
-    /// Pops a little-endian n-byte signed integer from the buffer
-    template<typename T> inline T popInt();
+    /// Frees the storage
+    ~Buffer();
     
-public:
     /// Current size of buffer
     size_t size();
     
-    /// Clear buffer
+    /// Clear buffer. The storage is returned to the BufferPool
     void clear();
     
     /// Erase byteCount bytes
@@ -65,7 +295,7 @@ public:
     // Inserts a string to the buffer
     void insert(const std::string& string);
     
-    // Inserts a byte to the buffer. Very inefficient, 1 chunk per byte
+    // Inserts a byte to the buffer
     void insert(uint8_t byte);
     
     // Inserts a little-endian uint16_t to the buffer
@@ -77,8 +307,7 @@ public:
     // Inserts a little-endian uint64_t to the buffer
     void insert(uint64_t uint64);
     
-    // Inserts a little-endian int8_t to the buffer. Very inefficient, 1 chunk
-    // per byte
+    // Inserts a little-endian int8_t to the buffer
     void insert(int8_t int8);
     
     // Inserts a little-endian int16_t to the buffer
@@ -90,6 +319,46 @@ public:
     // Inserts a little-endian int64_t to the buffer
     void insert(int64_t int64);
     
+    // Inserts an unsigned LEB128 varint to the buffer
+    void insertVarint(uint64_t uint64);
+    
+    // Inserts a zigzag-encoded signed LEB128 varint to the buffer
+    void insertVarint(int64_t int64);
+    
+    // Inserts count little-endian integers from a C array to the buffer, in a
+    // single copy on little-endian hosts
+    template<typename T> void insertArray(const T* integers, size_t count) {
+        static_assert(std::is_integral<T>::value, "Buffer::insertArray: T must be an integer");
+        #ifdef ROGUELIKE_BIG_ENDIAN
+        uint8_t bytes[sizeof(T)];
+        for(size_t i = 0; i < count; i++) {
+            storeLittleEndian(integers[i], bytes);
+            copyIn(bytes, sizeof(T));
+        }
+        #else
+        copyIn(reinterpret_cast<const uint8_t*>(integers), count * sizeof(T));
+        #endif
+    }
+    
+    // Inserts a vector of little-endian integers to the buffer
+    template<typename T> void insertArray(const std::vector<T>& integers) {
+        insertArray(integers.data(), integers.size());
+    }
+    
+    // Makes room for at least byteCount more bytes and gets all the writable
+    // space after the data, so that it can be filled in place (for example,
+    // by a socket read). Nothing is added to the buffer until commit is called
+    BufferSpace prepare(size_t byteCount);
+    
+    // Adds byteCount bytes, written to the space returned by the last call to
+    // prepare, to the end of the buffer. Throws std::out_of_range if that is
+    // more than the space available
+    void commit(size_t byteCount);
+    
+    // Gets a read-only view over byteCount bytes, with an offset. Nothing is
+    // copied. The view is invalidated by any change to the buffer
+    BufferView peek(size_t byteCount, size_t offset = 0) const;
+    
     // Gets byteCount bytes from the buffer, with an offset
     void get(std::vector<uint8_t>& bytes, size_t byteCount, size_t offset = 0);
     
@@ -150,6 +419,29 @@ public:
     
     // Gets a little-endian int64_t from the buffer, removing the read data
     void pop(int64_t& int64);
+    
+    // Gets an unsigned LEB128 varint from the buffer, removing the read data.
+    // Throws std::invalid_argument if it doesn't fit in 64 bits
+    void popVarint(uint64_t& uint64);
+    
+    // Gets a zigzag-encoded signed LEB128 varint from the buffer, removing
+    // the read data
+    void popVarint(int64_t& int64);
+    
+    // Gets count little-endian integers from the buffer to a C array, removing
+    // the read data
+    template<typename T> void popArray(T* integers, size_t count) {
+        BufferCursor cursor(peek(count * sizeof(T)));
+        cursor.readArray(integers, count);
+        erase(count * sizeof(T));
+    }
+    
+    // Gets count little-endian integers from the buffer to a vector, removing
+    // the read data
+    template<typename T> void popArray(std::vector<T>& integers, size_t count) {
+        integers.resize(count);
+        popArray(integers.data(), count);
+    }
 };
 
 #endif
@@ -0,0 +1,171 @@
+#include "BufferPool.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/// Number of size classes, from minBlockSize to maxBlockSize
+static const size_t classCount = 15;
+
+/// Blocks kept per size class in each thread's cache
+static const size_t threadCacheDepth = 8;
+
+static_assert((BufferPool::minBlockSize << (classCount - 1)) == BufferPool::maxBlockSize, "BufferPool: classCount doesn't match block size range");
+
+/// Free lists shared by all threads
+struct SharedPool {
+    std::mutex lock;
+    std::vector<uint8_t*> freeLists[classCount];
+    
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<size_t> bytesRetained{0};
+    std::atomic<size_t> retainLimit{32 * 1024 * 1024};
+};
+
+/// Get the shared pool. Never destroyed, so that buffers destroyed during
+/// static destruction can still release their storage
+static SharedPool& sharedPool() {
+    static SharedPool* pool = new SharedPool();
+    return *pool;
+}
+
+/// Set when this thread's cache is destroyed (on thread exit). Trivially
+/// destructible so it can still be read after that
+static thread_local bool threadCacheDestroyed = false;
+
+/// Per-thread cache, so that the hot path doesn't need to lock
+struct ThreadCache {
+    uint8_t* blocks[classCount][threadCacheDepth];
+    size_t counts[classCount] = {};
+    
+    /// Move cached blocks to the shared free lists on thread exit
+    ~ThreadCache() {
+        SharedPool& pool = sharedPool();
+        {
+            std::lock_guard<std::mutex> lockGuard(pool.lock);
+            for(size_t c = 0; c < classCount; c++) {
+                for(size_t b = 0; b < counts[c]; b++)
+                    pool.freeLists[c].push_back(blocks[c][b]);
+                counts[c] = 0;
+            }
+        }
+        
+        threadCacheDestroyed = true;
+    }
+};
+
+static thread_local ThreadCache threadCache;
+
+/// Get the size class of a block size, or classCount if it isn't pooled
+static size_t sizeClass(size_t size) {
+    if(size < BufferPool::minBlockSize || size > BufferPool::maxBlockSize)
+        return classCount;
+    
+    size_t c = 0;
+    while((BufferPool::minBlockSize << c) < size)
+        c++;
+    return c;
+}
+
+uint8_t* BufferPool::allocate(size_t size) {
+    SharedPool& pool = sharedPool();
+    size_t c = sizeClass(size);
+    
+    if(c < classCount) {
+        // Try this thread's cache...
+        if(!threadCacheDestroyed && threadCache.counts[c] > 0) {
+            pool.hits++;
+            pool.bytesRetained -= size;
+            return threadCache.blocks[c][--threadCache.counts[c]];
+        }
+        
+        // ... then the shared free lists
+        std::lock_guard<std::mutex> lockGuard(pool.lock);
+        auto& freeList = pool.freeLists[c];
+        if(!freeList.empty()) {
+            uint8_t* block = freeList.back();
+            freeList.pop_back();
+            pool.hits++;
+            pool.bytesRetained -= size;
+            return block;
+        }
+    }
+    
+    pool.misses++;
+    return new uint8_t[size];
+}
+
+void BufferPool::release(uint8_t* block, size_t size) {
+    if(block == nullptr)
+        return;
+    
+    SharedPool& pool = sharedPool();
+    size_t c = sizeClass(size);
+    
+    // Free if not pooled
+    if(c == classCount) {
+        delete[] block;
+        return;
+    }
+    
+    // Reserve room under the retain limit before keeping the block, so
+    // threads releasing at once can't go over it together. Free if there is
+    // no room
+    size_t retained = pool.bytesRetained;
+    do {
+        if(retained + size > pool.retainLimit) {
+            delete[] block;
+            return;
+        }
+    } while(!pool.bytesRetained.compare_exchange_weak(retained, retained + size));
+    
+    // Try this thread's cache...
+    if(!threadCacheDestroyed && threadCache.counts[c] < threadCacheDepth) {
+        threadCache.blocks[c][threadCache.counts[c]++] = block;
+        return;
+    }
+    
+    // ... then the shared free lists
+    std::lock_guard<std::mutex> lockGuard(pool.lock);
+    pool.freeLists[c].push_back(block);
+}
+
+void BufferPool::setRetainLimit(size_t bytes) {
+    sharedPool().retainLimit = bytes;
+}
+
+void BufferPool::trim() {
+    SharedPool& pool = sharedPool();
+    
+    // Free this thread's cache...
+    if(!threadCacheDestroyed) {
+        for(size_t c = 0; c < classCount; c++) {
+            for(size_t b = 0; b < threadCache.counts[c]; b++) {
+                delete[] threadCache.blocks[c][b];
+                pool.bytesRetained -= minBlockSize << c;
+            }
+            threadCache.counts[c] = 0;
+        }
+    }
+    
+    // ... and the shared free lists
+    std::lock_guard<std::mutex> lockGuard(pool.lock);
+    for(size_t c = 0; c < classCount; c++) {
+        for(auto block : pool.freeLists[c]) {
+            delete[] block;
+            pool.bytesRetained -= minBlockSize << c;
+        }
+        pool.freeLists[c].clear();
+    }
+}
+
+BufferPoolStats BufferPool::stats() {
+    SharedPool& pool = sharedPool();
+    return {pool.hits, pool.misses, pool.bytesRetained};
+}
+
+void BufferPool::resetStats() {
+    SharedPool& pool = sharedPool();
+    pool.hits = 0;
+    pool.misses = 0;
+}
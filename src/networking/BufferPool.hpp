@@ -0,0 +1,51 @@
+#ifndef ROGUELIKE_BUFFER_POOL_HPP_INCLUDED
+#define ROGUELIKE_BUFFER_POOL_HPP_INCLUDED
+#include <cstddef>
+#include <cstdint>
+
+/// Buffer pool counters
+struct BufferPoolStats {
+    /// Allocations served from a thread cache or the shared free lists
+    uint64_t hits;
+    
+    /// Allocations that had to use the heap
+    uint64_t misses;
+    
+    /// Bytes currently held in free lists (thread caches included)
+    size_t bytesRetained;
+};
+
+/// A free list allocator for Buffer storage. Blocks are power-of-two sized
+/// and are recycled instead of being freed, first in a small per-thread cache
+/// and then in free lists shared by all threads. Blocks bigger than
+/// maxBlockSize, or released while the pool is over its retain limit, go
+/// straight back to the heap
+class BufferPool {
+public:
+    /// Smallest block size
+    static const size_t minBlockSize = 64;
+    
+    /// Biggest block size that gets recycled
+    static const size_t maxBlockSize = 1 << 20;
+    
+    /// Allocate a block. size must be a power of two
+    static uint8_t* allocate(size_t size);
+    
+    /// Release a block obtained from allocate, with the same size
+    static void release(uint8_t* block, size_t size);
+    
+    /// Set the maximum amount of bytes kept in free lists. Defaults to 32 MiB.
+    /// Does not free blocks that are already retained; see trim
+    static void setRetainLimit(size_t bytes);
+    
+    /// Free all blocks in the shared free lists and this thread's cache
+    static void trim();
+    
+    /// Get the current counters
+    static BufferPoolStats stats();
+    
+    /// Reset the hit and miss counters
+    static void resetStats();
+};
+
+#endif
@@ -1,427 +1,534 @@
 #include "ClientMessage.hpp"
 
-const std::vector<uint8_t> ClientMessage::toBytesHelper(const std::vector<uint8_t>& data) const {
-    Buffer buffer;
+const std::vector<uint8_t> ClientMessage::toBytesHelper(const std::vector<uint8_t>& data, WireFormat format) const {
+    MessageWriter writer(type, data.size(), format);
+    writer.write(data);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessage::toBytes(WireFormat format) const {
+    static const std::vector<uint8_t> nothing;
+    return toBytesHelper(nothing, format);
+}
+
+/// Parse the body of a Chat message
+static std::unique_ptr<ClientMessage> chatFromBody(BufferCursor& body) {
+    // Body is a player name length, a player name and a chat message for Chat
+    // messages.
+    // Parse player name length
+    if(body.remaining() == 0)
+        return nullptr;
     
-    // Append type
-    buffer.insert(static_cast<uint16_t>(type));
+    uint8_t senderNameLength;
+    body.read(senderNameLength);
     
-    // Append data length
-    buffer.insert(static_cast<uint64_t>(data.size()));
+    // Prevent buffer size heartbleed-style bugs and 0-length player names
+    if(senderNameLength > body.remaining())
+        return nullptr;
     
-    // Append data
-    buffer.insert(data);
+    // Parse player name
+    std::string senderName;
+    body.read(senderName, senderNameLength);
     
-    // Get merged bytes
-    std::vector<uint8_t> bytes;
-    // Using get because there is no need to remove since buffer will go out of
-    // scope
-    buffer.get(bytes, 10 + data.size());
+    // Parse message
+    std::string message;
+    body.read(message, body.remaining());
     
-    return bytes;
+    return std::unique_ptr<ClientMessage>(new ClientMessageChat(senderName, message));
 }
 
-const std::vector<uint8_t> ClientMessage::toBytes() const {
-    static const std::vector<uint8_t> nothing;
-    return toBytesHelper(nothing);
+/// Parse the body of a MapTileData message
+static std::unique_ptr<ClientMessage> mapTileDataFromBody(BufferCursor& body, WireFormat format) {
+    // Parse map dimensions
+    if(body.remaining() < 2 * countSize(format, 0))
+        return nullptr;
+    
+    uint64_t width, height, tileCount;
+    readCount(body, format, width);
+    readCount(body, format, height);
+    
+    // Parse tile data
+    tileCount = width * height;
+    if(body.remaining() != tileCount * 3)
+        return nullptr;
+    
+    MapPlane tileData;
+    tileData.reserve(height);
+    for(auto y = 0; y < height; y++) {
+        std::vector<MapPoint> row;
+        row.reserve(width);
+        
+        for(auto x = 0; x < width; x++) {
+            uint8_t first, second, third;
+            body.read(first);
+            body.read(second);
+            body.read(third);
+            
+            MapPoint point;
+            point.character = first;
+            point.accesible = third & 0b01000000;
+            point.formating.text_color = static_cast<Color>(third & 0b00111111);
+            point.formating.background_color = static_cast<Color>(second);
+            row.push_back(point);
+        }
+        
+        tileData.push_back(row);
+    }
+    
+    return std::unique_ptr<ClientMessage>(new ClientMessageMapTileData(std::move(tileData), width, height));
 }
 
-std::unique_ptr<ClientMessage> ClientMessage::fromBuffer(Buffer& buffer) {
-    // Abort if header not received yet (type and data size)
-    if(buffer.size() < 10)
-        return nullptr;
+/// Pack the type, direction and visibility of an object into a single byte
+static uint8_t objectFlags(const Object& object) {
+    // [1 bit - visible?][3 bits - direction][4 bits - type]
+    // Note that both direction and type only use 2 bits each, but since
+    // there is leftover bits for a full byte, more were used for expanding in
+    // the future
+    // NOTE Stored in a variable so that the final result is cast to uint8_t,
+    // since bitwise operators implicitly cast to int, which caused the whole
+    // encoding process to fail before. Basically, DON'T TOUCH THIS
+    uint8_t omniByte = (static_cast<uint8_t>(object.get_type())             & 0b00001111) |
+                      ((static_cast<uint8_t>(object.get_direction())  << 4) & 0b01110000) |
+                      ((static_cast<uint8_t>(object.get_visibility()) << 7) & 0b10000000);
+    return omniByte;
+}
+
+/// Size of a texture field: its height, then each row's width and 3 bytes per
+/// point
+static size_t textureSize(WireFormat format, const Texture& texture) {
+    const auto& texturePlane = texture.get_plane();
+    size_t size = countSize(format, texturePlane.size());
+    for(const auto& row : texturePlane)
+        size += countSize(format, row.size()) + 3 * row.size();
+    return size;
+}
+
+/// Write a texture field
+static void writeTexture(MessageWriter& writer, const Texture& texture) {
+    const auto& texturePlane = texture.get_plane();
+    // ... height
+    writer.writeCount(texturePlane.size());
+    for(const auto& row : texturePlane) {
+        // ... row width
+        writer.writeCount(row.size());
+        for(const auto& point : row) {
+            // Texture point character
+            writer.write(static_cast<uint8_t>(point.character));
+            // Texture point formatting
+            writer.write(static_cast<uint8_t>(point.formating.text_color));
+            writer.write(static_cast<uint8_t>(point.formating.background_color));
+        }
+    }
+}
+
+/// Read a texture field. Returns false if the body is too short for it
+static bool readTexture(BufferCursor& body, WireFormat format, std::vector<std::vector<TexturePoint> >& texPlane) {
+    // Texture height
+    if(body.remaining() < countSize(format, 0))
+        return false;
     
-    // Parse data size field
-    uint64_t dataSize;
-    buffer.get(dataSize, 2);
+    uint64_t texHeight;
+    readCount(body, format, texHeight);
     
-    // Abort if body (data) not received
-    if(buffer.size() < dataSize + 10)
+    // Texture plane
+    for(auto h = 0; h < texHeight; h++) {
+        // Abort if not enough buffer size for width value
+        if(body.remaining() < countSize(format, 0))
+            return false;
+        
+        // Texture plane row width
+        uint64_t rowWidth;
+        readCount(body, format, rowWidth);
+        
+        // Abort if not enough buffer size for row content
+        if(body.remaining() / 3 < rowWidth)
+            return false;
+        
+        // Row
+        texPlane.emplace_back();
+        auto& lastRow = texPlane[texPlane.size() - 1];
+        lastRow.reserve(rowWidth);
+        for(auto c = 0; c < rowWidth; c++) {
+            uint8_t pCharacter, pTextColor, pBgColor;
+            
+            // Texture point
+            body.read(pCharacter);
+            body.read(pTextColor);
+            body.read(pBgColor);
+            TexturePoint tPoint = {
+                static_cast<char>(pCharacter),
+                {
+                    static_cast<Color>(pTextColor),
+                    static_cast<Color>(pBgColor)
+                }
+            };
+            
+            lastRow.emplace_back(std::move(tPoint));
+        }
+    }
+    
+    return true;
+}
+
+/// Parse the body of a MapObjectData message
+static std::unique_ptr<ClientMessage> mapObjectDataFromBody(BufferCursor& body, WireFormat format) {
+    // Parse object count
+    if(body.remaining() < countSize(format, 0))
         return nullptr;
     
-    // Parse type field
-    uint16_t type;
-    buffer.get(type);
+    std::vector<std::shared_ptr<Object>> objects;
+    uint64_t count;
+    readCount(body, format, count);
     
-    // Clear header from buffer, full message received
-    buffer.erase(10);
+    // Smallest possible object: 4 single bytes, a position and an empty
+    // texture
+    const size_t minObjectSize = 4 + 2 * coordinateSize(format, 0) + countSize(format, 0);
     
-    // Create ClientMessage
-    switch(type) {
-        case static_cast<int>(GameMessageType::Join):
-            {
-                // Body is a player name for Join messages
-                std::string senderName;
-                buffer.pop(senderName, dataSize);
-                return std::unique_ptr<ClientMessage>(new ClientMessageJoin(senderName));
-            }
-            break;
-        case static_cast<int>(GameMessageType::Quit):
+    // Parse objects
+    for(auto o = 0; o < count; o++) {
+        // Abort if there isn't enough size for another object
+        if(body.remaining() < minObjectSize)
+            return nullptr;
+        
+        uint8_t character, omniByte, textColor, bgColor;
+        int64_t positionFields[2];
+        
+        // Character
+        body.read(character);
+        
+        // Omni-byte (visible flag | direction | type)
+        // Will be split later
+        body.read(omniByte);
+        
+        // Position
+        readCoordinates(body, format, positionFields, 2);
+        
+        // Formatting colors
+        body.read(textColor);
+        body.read(bgColor);
+        
+        // Texture
+        std::vector<std::vector<TexturePoint> > texPlane;
+        if(!readTexture(body, format, texPlane))
+            return nullptr;
+        
+        // Done, parse omni-byte
+        ObjectType type = static_cast<ObjectType>(omniByte       & 0b00001111);
+        Direction dir   = static_cast<Direction>((omniByte >> 4) & 0b00000111);
+        bool visible    = static_cast<bool>(     (omniByte >> 7) & 0b00000001);
+        
+        // Generate final object
+        objects.emplace_back(new Object(
+            static_cast<char>(character),
+            dir,
+            visible,
+            std::pair<int, int>(positionFields[0], positionFields[1]),
             {
-                // Body is a player name for Quit messages
-                std::string senderName;
-                buffer.pop(senderName, dataSize);
-                return std::unique_ptr<ClientMessage>(new ClientMessageQuit(senderName));
-            }
-            break;
-        case static_cast<int>(GameMessageType::Chat):
+                static_cast<Color>(textColor),
+                static_cast<Color>(bgColor)
+            },
+            Texture(std::move(texPlane)),
+            type
+        ));
+    }
+    
+    // Abort if there is remainder data
+    if(body.remaining() > 0)
+        return nullptr;
+    
+    return std::unique_ptr<ClientMessage>(new ClientMessageMapObjectData(objects));
+}
+
+/// Parse the body of an ObjectDelta message
+static std::unique_ptr<ClientMessage> objectDeltaFromBody(BufferCursor& body, WireFormat format) {
+    // Parse sequences and despawned object count
+    if(body.remaining() < 3 * countSize(format, 0))
+        return nullptr;
+    
+    ObjectDelta delta;
+    uint64_t despawnedCount;
+    readCount(body, format, delta.baseSequence);
+    readCount(body, format, delta.sequence);
+    readCount(body, format, despawnedCount);
+    
+    // Parse despawned object ids
+    if(body.remaining() / countSize(format, 0) < despawnedCount)
+        return nullptr;
+    
+    delta.despawned.resize(despawnedCount);
+    for(auto& id : delta.despawned)
+        readCount(body, format, id);
+    
+    // Parse updates
+    if(body.remaining() < countSize(format, 0))
+        return nullptr;
+    
+    uint64_t updateCount;
+    readCount(body, format, updateCount);
+    for(auto u = 0; u < updateCount; u++) {
+        // Abort if there isn't enough size for an id and the field bits
+        if(body.remaining() < countSize(format, 0) + 1)
+            return nullptr;
+        
+        uint64_t id;
+        uint8_t fields;
+        readCount(body, format, id);
+        body.read(fields);
+        if(fields & ~objectFieldAll)
+            return nullptr;
+        
+        // Fields that weren't sent keep their defaults
+        uint8_t character = 0, omniByte = 0, textColor = 0, bgColor = 0;
+        int64_t positionFields[2] = {0, 0};
+        std::vector<std::vector<TexturePoint> > texPlane;
+        if(fields & objectFieldCharacter)
+            body.read(character);
+        if(fields & objectFieldFlags)
+            body.read(omniByte);
+        if(fields & objectFieldPosition)
+            readCoordinates(body, format, positionFields, 2);
+        if(fields & objectFieldFormatting) {
+            body.read(textColor);
+            body.read(bgColor);
+        }
+        if((fields & objectFieldTexture) && !readTexture(body, format, texPlane))
+            return nullptr;
+        
+        Object object(
+            static_cast<char>(character),
+            static_cast<Direction>((omniByte >> 4) & 0b00000111),
+            static_cast<bool>(     (omniByte >> 7) & 0b00000001),
+            std::pair<int, int>(positionFields[0], positionFields[1]),
             {
-                // Body is a player name length, a player name and a chat
-                // message for Chat messages.
-                // Parse player name length
-                if(dataSize == 0)
-                    return nullptr;
-                
-                uint8_t senderNameLength;
-                buffer.pop(senderNameLength);
-                
-                // Prevent buffer size heartbleed-style bugs and 0-length player names
-                if(senderNameLength > dataSize - 1) {
-                    buffer.erase(dataSize - 1);
-                    return nullptr;
+                static_cast<Color>(textColor),
+                static_cast<Color>(bgColor)
+            },
+            Texture(std::move(texPlane)),
+            static_cast<ObjectType>(omniByte & 0b00001111)
+        );
+        object.set_id(id);
+        delta.updates.push_back(ObjectUpdate{id, fields, std::move(object)});
+    }
+    
+    // Abort if there is remainder data
+    if(body.remaining() > 0)
+        return nullptr;
+    
+    return std::unique_ptr<ClientMessage>(new ClientMessageObjectDelta(std::move(delta)));
+}
+
+/// Parse the body of a PlayerData message
+static std::unique_ptr<ClientMessage> playerDataFromBody(BufferCursor& body, WireFormat format) {
+    // Parse player count
+    if(body.remaining() < countSize(format, 0))
+        return nullptr;
+    
+    std::vector<std::string> names;
+    uint64_t count;
+    readCount(body, format, count);
+    
+    // Parse names
+    for(auto n = 0; n < count; n++) {
+        // Get name size
+        if(body.remaining() < 1)
+            return nullptr;
+        
+        uint8_t nameSize;
+        body.read(nameSize);
+        
+        // Get name
+        if(body.remaining() < nameSize)
+            return nullptr;
+        
+        std::string name;
+        body.read(name, nameSize);
+        
+        // Add to name list
+        names.push_back(std::move(name));
+    }
+    
+    // Rest of needed size is (at least) 3 coordinate fields per player,
+    // abort if too little
+    if(body.remaining() / (3 * coordinateSize(format, 0)) < count)
+        return nullptr;
+    
+    // Parse positions (x and y pairs)
+    std::vector<int64_t> positions(2 * count);
+    readCoordinates(body, format, positions.data(), positions.size());
+    
+    // Parse levels
+    std::vector<int64_t> levels(count);
+    readCoordinates(body, format, levels.data(), levels.size());
+    
+    // Parse item names
+    std::vector<std::vector<std::string>> itemNames;
+    for(auto i = 0; i < count; i++) {
+        // Item count
+        uint64_t itemCount;
+        if(body.remaining() < countSize(format, 0))
+            return nullptr;
+        readCount(body, format, itemCount);
+        
+        // Item names
+        std::vector<std::string> theseItemNames;
+        for(auto n = 0; n < itemCount; n++) {
+            // Name size
+            uint64_t itemNameSize;
+            if(body.remaining() < countSize(format, 0))
+                return nullptr;
+            readCount(body, format, itemNameSize);
+            
+            // Name content
+            if(body.remaining() < itemNameSize)
+                return nullptr;
+            std::string itemName;
+            body.read(itemName, itemNameSize);
+            theseItemNames.emplace_back(std::move(itemName));
+        }
+        itemNames.emplace_back(std::move(theseItemNames));
+    }
+    
+    // Abort if there is data left
+    if(body.remaining() != 0)
+        return nullptr;
+    
+    // Create list of player snapshots
+    std::vector<PlayerSnapshot> playerSnapshots;
+    for(auto p = 0; p < count; p++)
+        playerSnapshots.emplace_back(names[p], positions[2 * p], positions[2 * p + 1], levels[p], std::move(itemNames[p]));
+    
+    return std::unique_ptr<ClientMessage>(new ClientMessagePlayerData(std::move(playerSnapshots)));
+}
+
+std::unique_ptr<ClientMessage> ClientMessage::fromBuffer(Buffer& buffer, WireFormat format) {
+    // Abort if header not received yet (type and data size). Header fields
+    // are parsed in place
+    MessageHeader header;
+    if(!peekHeader(buffer, format, header))
+        return nullptr;
+    
+    uint16_t type = header.type;
+    uint64_t dataSize = header.bodySize;
+    
+    // Abort if body (data) not received
+    if(buffer.size() - header.size < dataSize)
+        return nullptr;
+    
+    // Create ClientMessage from body. Invalid bodies result in nullptr
+    std::unique_ptr<ClientMessage> message = nullptr;
+    BufferCursor body(buffer.peek(dataSize, header.size));
+    try {
+        switch(type) {
+            case static_cast<int>(GameMessageType::Join):
+                {
+                    // Body is a player name for Join messages
+                    std::string senderName;
+                    body.read(senderName, dataSize);
+                    message = std::unique_ptr<ClientMessage>(new ClientMessageJoin(senderName));
                 }
-                
-                // Parse player name
-                std::string senderName;
-                if(senderNameLength > 0)
-                    buffer.pop(senderName, senderNameLength);
-                
-                // Parse message
-                std::string message;
-                size_t messageLength = dataSize - senderNameLength - 1;
-                if(messageLength > 0)
-                    buffer.pop(message, messageLength);
-                
-                return std::unique_ptr<ClientMessage>(new ClientMessageChat(senderName, message));
-            }
-            break;
-        case static_cast<int>(GameMessageType::MapTileData):
-            {
-                // Parse map dimensions
-                if(dataSize == 0)
-                    return nullptr;
-                
-                if(dataSize < 16)
-                    break;
-                
-                uint64_t width, height, tileCount;
-                buffer.pop(width);
-                buffer.pop(height);
-                
-                // Parse tile data
-                tileCount = width * height;
-                if(dataSize != 16 + tileCount * 3) {
-                    buffer.erase(dataSize - 16);
-                    return nullptr;
+                break;
+            case static_cast<int>(GameMessageType::Quit):
+                {
+                    // Body is a player name for Quit messages
+                    std::string senderName;
+                    body.read(senderName, dataSize);
+                    message = std::unique_ptr<ClientMessage>(new ClientMessageQuit(senderName));
                 }
-                
-                MapPlane tileData;
-                tileData.reserve(height);
-                for(auto y = 0; y < height; y++) {
-                    std::vector<MapPoint> row;
-                    row.reserve(width);
-                    
-                    for(auto x = 0; x < width; x++) {
-                        uint8_t first, second, third;
-                        buffer.pop(first);
-                        buffer.pop(second);
-                        buffer.pop(third);
-                        
-                        MapPoint point;
-                        point.character = first;
-                        point.accesible = third & 0b01000000;
-                        point.formating.text_color = static_cast<Color>(third & 0b00111111);
-                        point.formating.background_color = static_cast<Color>(second);
-                        row.push_back(point);
-                    }
+                break;
+            case static_cast<int>(GameMessageType::Chat):
+                message = chatFromBody(body);
+                break;
+            case static_cast<int>(GameMessageType::MapTileData):
+                message = mapTileDataFromBody(body, format);
+                break;
+            case static_cast<int>(GameMessageType::MapObjectData):
+                message = mapObjectDataFromBody(body, format);
+                break;
+            case static_cast<int>(GameMessageType::PlayerData):
+                message = playerDataFromBody(body, format);
+                break;
+            case static_cast<int>(GameMessageType::ObjectDelta):
+                message = objectDeltaFromBody(body, format);
+                break;
+            case static_cast<int>(GameMessageType::ActionAck):
+                {
+                    // Parse accepted flag
+                    if(dataSize != 1)
+                        break;
                     
-                    tileData.push_back(row);
+                    uint8_t accepted;
+                    body.read(accepted);
+                    message = std::unique_ptr<ClientMessage>(new ClientMessageActionAck(accepted));
                 }
-                
-                return std::unique_ptr<ClientMessage>(new ClientMessageMapTileData(std::move(tileData), width, height));
-            }
-            break;
-        case static_cast<int>(GameMessageType::MapObjectData):
-            {
-                // Parse object count
-                if(dataSize == 0)
-                    return nullptr;
-                
-                if(dataSize < 8)
-                    break;
-                
-                std::vector<std::shared_ptr<Object>> objects;
-                uint64_t count;
-                buffer.pop(count);
-                
-                // Parse objects
-                size_t dataLeft = dataSize - 8;
-                for(auto o = 0; o < count; o++) {
-                    // Abort if there isn't enough size for another object
-                    if(dataLeft < 28) {
-                        buffer.erase(dataLeft);
-                        return nullptr;
-                    }
-                    
-                    uint8_t character, omniByte, textColor, bgColor;
-                    int64_t posX, posY;
-                    uint64_t texHeight;
-                    
-                    // Character
-                    buffer.pop(character);
-                    
-                    // Omni-byte (visible flag | direction | type)
-                    // Will be split later
-                    buffer.pop(omniByte);
-                    
-                    // Position
-                    buffer.pop(posX);
-                    buffer.pop(posY);
-                    
-                    // Formatting colors
-                    buffer.pop(textColor);
-                    buffer.pop(bgColor);
-                    
-                    // Texture height
-                    buffer.pop(texHeight);
+                break;
+            case static_cast<int>(GameMessageType::SnapshotChannel):
+                {
+                    // Parse token
+                    if(dataSize != 4)
+                        break;
                     
-                    // Texture plane
-                    dataLeft -= 28;
-                    std::vector<std::vector<TexturePoint> > texPlane;
-                    texPlane.reserve(texHeight);
-                    for(auto h = 0; h < texHeight; h++) {
-                        // Abort if not enough buffer size for width value
-                        if(dataLeft < 8) {
-                            buffer.erase(dataLeft);
-                            return nullptr;
-                        }
-                        
-                        // Texture plane row width
-                        uint64_t rowWidth;
-                        buffer.pop(rowWidth);
-                        dataLeft -= 8;
-                        
-                        // Abort if not enough buffer size for row content
-                        if(dataLeft < 3 * rowWidth) {
-                            buffer.erase(dataLeft);
-                            return nullptr;
-                        }
-                        
-                        // Row
-                        texPlane.emplace_back();
-                        auto& lastRow = texPlane[texPlane.size() - 1];
-                        lastRow.reserve(3 * rowWidth);
-                        for(auto c = 0; c < rowWidth; c++) {
-                            uint8_t pCharacter, pTextColor, pBgColor;
-                            
-                            // Texture point
-                            buffer.pop(pCharacter);
-                            buffer.pop(pTextColor);
-                            buffer.pop(pBgColor);
-                            TexturePoint tPoint = {
-                                static_cast<char>(pCharacter),
-                                {
-                                    static_cast<Color>(pTextColor),
-                                    static_cast<Color>(pBgColor)
-                                }
-                            };
-                            
-                            lastRow.emplace_back(std::move(tPoint));
-                        }
-                        
-                        dataLeft -= 3 * rowWidth;
-                    }
-                    
-                    // Done, parse omni-byte
-                    ObjectType type = static_cast<ObjectType>(omniByte       & 0b00001111);
-                    Direction dir   = static_cast<Direction>((omniByte >> 4) & 0b00000111);
-                    bool visible    = static_cast<bool>(     (omniByte >> 7) & 0b00000001);
-                    
-                    // Generate final object
-                    objects.emplace_back(new Object(
-                        static_cast<char>(character),
-                        dir,
-                        visible,
-                        std::pair<int, int>(posX, posY),
-                        {
-                            static_cast<Color>(textColor),
-                            static_cast<Color>(bgColor)
-                        },
-                        Texture(std::move(texPlane)),
-                        type
-                    ));
+                    uint32_t token;
+                    body.read(token);
+                    message = std::unique_ptr<ClientMessage>(new ClientMessageSnapshotChannel(token));
                 }
-                
-                // Abort if there is remainder data
-                if(dataLeft > 0) {
-                    buffer.erase(dataLeft);
-                    return nullptr;
-                }
-                
-                return std::unique_ptr<ClientMessage>(new ClientMessageMapObjectData(objects));
-            }
-            break;
-        case static_cast<int>(GameMessageType::PlayerData):
-            {
-                // Parse player count
-                if(dataSize == 0)
-                    return nullptr;
-                
-                if(dataSize < 8)
-                    break;
-                
-                std::vector<std::string> names;
-                uint64_t count;
-                buffer.pop(count);
-                
-                // Parse names
-                size_t dataLeft = dataSize - 8;
-                for(auto n = 0; n < count; n++) {
-                    // Get name size
-                    if(dataLeft < 1) {
-                        buffer.erase(dataLeft);
-                        return nullptr;
-                    }
-                    
-                    uint8_t nameSize;
-                    buffer.pop(nameSize);
-                    dataLeft--;
-                    
-                    // Get name
-                    if(dataLeft < nameSize) {
-                        buffer.erase(dataLeft);
-                        return nullptr;
-                    }
-                    
-                    std::string name;
-                    buffer.pop(name, nameSize);
-                    dataLeft -= nameSize;
+                break;
+            case static_cast<int>(GameMessageType::Fragment):
+                {
+                    // Parse last flag and piece
+                    if(dataSize < 1)
+                        break;
                     
-                    // Add to name list
-                    names.push_back(std::move(name));
+                    uint8_t last;
+                    std::vector<uint8_t> data;
+                    body.read(last);
+                    body.read(data, dataSize - 1);
+                    message = std::unique_ptr<ClientMessage>(new ClientMessageFragment(last, std::move(data)));
                 }
-                
-                // Rest of needed size is known, abort if too little
-                if(dataLeft < 24 * count) {
-                    buffer.erase(dataLeft);
-                    return nullptr;
-                }
-                dataLeft -= 24 * count;
-                
-                std::vector<int> xPositions;
-                std::vector<int> yPositions;
-                std::vector<int> levels;
-                
-                // Parse positions
-                for(auto p = 0; p < count; p++) {
-                    int64_t posX, posY;
-                    buffer.pop(posX);
-                    buffer.pop(posY);
-                    xPositions.emplace_back(posX);
-                    yPositions.emplace_back(posY);
-                }
-                
-                // Parse levels
-                for(auto l = 0; l < count; l++) {
-                    int64_t level;
-                    buffer.pop(level);
-                    levels.push_back(level);
-                }
-                
-                // Parse item names
-                std::vector<std::vector<std::string>> itemNames;
-                for(auto i = 0; i < count; i++) {
-                    // Item count
-                    uint64_t itemCount;
-                    if(dataLeft < 8) {
-                        buffer.erase(dataLeft);
-                        return nullptr;
-                    }
-                    buffer.pop(itemCount);
-                    dataLeft -= 8;
+                break;
+            case static_cast<int>(GameMessageType::Ping):
+            case static_cast<int>(GameMessageType::Pong):
+                {
+                    // Parse timestamp
+                    if(dataSize != 8)
+                        break;
                     
-                    // Item names
-                    std::vector<std::string> theseItemNames;
-                    for(auto n = 0; n < itemCount; n++) {
-                        // Name size
-                        uint64_t itemNameSize;
-                        if(dataLeft < 8) {
-                            buffer.erase(dataLeft);
-                            return nullptr;
-                        }
-                        buffer.pop(itemNameSize);
-                        dataLeft -= 8;
-                        
-                        // Name content
-                        if(dataLeft < itemNameSize) {
-                            buffer.erase(dataLeft);
-                            return nullptr;
-                        }
-                        std::string itemName;
-                        buffer.pop(itemName, itemNameSize);
-                        dataLeft -= itemNameSize;
-                        theseItemNames.emplace_back(std::move(itemName));
-                    }
-                    itemNames.emplace_back(std::move(theseItemNames));
-                }
-                
-                // Abort if there is data left
-                if(dataLeft != 0) {
-                    buffer.erase(dataLeft);
-                    return nullptr;
+                    uint64_t timestamp;
+                    body.read(timestamp);
+                    if(type == static_cast<int>(GameMessageType::Ping))
+                        message = std::unique_ptr<ClientMessage>(new ClientMessagePing(timestamp));
+                    else
+                        message = std::unique_ptr<ClientMessage>(new ClientMessagePong(timestamp));
                 }
-                
-                // Create list of player snapshots
-                std::vector<PlayerSnapshot> playerSnapshots;
-                for(auto p = 0; p < count; p++)
-                    playerSnapshots.emplace_back(names[p], xPositions[p], yPositions[p], levels[p], std::move(itemNames[p]));
-                
-                return std::unique_ptr<ClientMessage>(new ClientMessagePlayerData(std::move(playerSnapshots)));
-            }
-            break;
-        case static_cast<int>(GameMessageType::ActionAck):
-            {
-                // Parse accepted flag
-                if(dataSize == 0)
-                    return nullptr;
-                
-                if(dataSize != 1)
-                    break;
-                
-                uint8_t accepted;
-                buffer.pop(accepted);
-                return std::unique_ptr<ClientMessage>(new ClientMessageActionAck(accepted));
-            }
-            break;
+                break;
+        }
     }
+    catch(const std::out_of_range&) {} // Varint field runs past the body
+    catch(const std::invalid_argument&) {} // Varint field too big
     
-    // Unknown message type or action message, clear body
-    buffer.erase(dataSize);
-    return nullptr;
+    // Full message received and parsed (or unknown message type or action
+    // message), clear it from the buffer
+    buffer.erase(header.size + dataSize);
+    return message;
 }
 
-const std::vector<uint8_t> ClientMessageJoin::toBytes() const {
-    return toBytesHelper(
-        std::vector<uint8_t>(senderName.begin(), senderName.end())
-    );
+const std::vector<uint8_t> ClientMessageJoin::toBytes(WireFormat format) const {
+    MessageWriter writer(type, senderName.size(), format);
+    writer.write(senderName);
+    return writer.finish();
 }
 
-const std::vector<uint8_t> ClientMessageQuit::toBytes() const {
-    return toBytesHelper(
-        std::vector<uint8_t>(senderName.begin(), senderName.end())
-    );
+const std::vector<uint8_t> ClientMessageQuit::toBytes(WireFormat format) const {
+    MessageWriter writer(type, senderName.size(), format);
+    writer.write(senderName);
+    return writer.finish();
 }
 
-const std::vector<uint8_t> ClientMessageChat::toBytes() const {
-    Buffer bodyBuffer;
-    bodyBuffer.insert(static_cast<uint8_t>(senderName.size()));
-    bodyBuffer.insert(senderName);
-    bodyBuffer.insert(message);
-    
-    std::vector<uint8_t> data;
-    bodyBuffer.pop(data, 1 + senderName.size() + message.size());
-    
-    return toBytesHelper(data);
+const std::vector<uint8_t> ClientMessageChat::toBytes(WireFormat format) const {
+    MessageWriter writer(type, 1 + senderName.size() + message.size(), format);
+    writer.write(static_cast<uint8_t>(senderName.size()));
+    writer.write(senderName);
+    writer.write(message);
+    return writer.finish();
 }
 
 ClientMessageMapTileData::ClientMessageMapTileData(Map& map) :
@@ -443,98 +550,137 @@ ClientMessageMapTileData::ClientMessageMapTileData(MapPlane&& mapPlane, uint64_t
     height(height)
 {}
 
-const std::vector<uint8_t> ClientMessageMapTileData::toBytes() const {
-    // Insert map dimensions into buffer
-    // Buffers are expensive, so only use them to encode data that isn't a
-    // bunch of bytes
-    Buffer dimBuffer;
-    dimBuffer.insert(width);
-    dimBuffer.insert(height);
+const std::vector<uint8_t> ClientMessageMapTileData::toBytes(WireFormat format) const {
+    // Map dimensions and 3 bytes per tile
+    MessageWriter writer(type, countSize(format, width) + countSize(format, height) + 3 * width * height, format);
     
-    std::vector<uint8_t> data;
-    dimBuffer.pop(data, 16);
+    // Insert map dimensions
+    writer.writeCount(width);
+    writer.writeCount(height);
     
     // Insert tile data
-    data.reserve(16 + 3 * width * height); // 3 bytes per tile
-    for(const auto row : tileData) {
-        for(const auto tile : row) {
+    for(const auto& row : tileData) {
+        for(const auto& tile : row) {
             // Add single byte representing tile character
-            data.push_back((uint8_t)tile.character);
+            writer.write(static_cast<uint8_t>(tile.character));
             
             // Add single byte representing background color
-            data.push_back((uint8_t)tile.formating.background_color);
+            writer.write(static_cast<uint8_t>(tile.formating.background_color));
             
             // Encode accessible flag and text color into a byte
             // [1 byte - empty][1 byte - accessible][6 bytes - text_color]
             uint8_t mixedByte = (uint8_t)tile.formating.text_color | ((uint8_t)tile.accesible << 6);
-            data.push_back(mixedByte);
+            writer.write(mixedByte);
         }
     }
     
-    // Generate full message with header
-    return toBytesHelper(data);
+    return writer.finish();
 }
 
-const std::vector<uint8_t> ClientMessageMapObjectData::toBytes() const {
-    std::vector<uint8_t> data;
+const std::vector<uint8_t> ClientMessageMapObjectData::toBytes(WireFormat format) const {
+    // Calculate body size: object count, then 4 single bytes, a position and
+    // a texture per object
+    size_t bodySize = countSize(format, objects.size());
+    for(const auto& object : objects) {
+        auto position = object->get_position();
+        bodySize += 4 + coordinateSize(format, position.first) + coordinateSize(format, position.second) + textureSize(format, object->get_texture());
+    }
+    
+    MessageWriter writer(type, bodySize, format);
+    
+    // Insert object count
+    writer.writeCount(objects.size());
     
-    {
-        Buffer buffer;
+    // Insert each object
+    for(const auto& object : objects) {
+        // Character
+        writer.write(static_cast<uint8_t>(object->get_char()));
         
-        // Insert object count into buffer
-        buffer.insert(static_cast<uint64_t>(objects.size()));
+        // Direction, type and visibility as a single byte
+        writer.write(objectFlags(*object));
         
-        // Insert each object into buffer
-        for(const auto object : objects) {
-            // Character
-            buffer.insert(static_cast<uint8_t>(object->get_char()));
-            
-            // Direction, type and visibility as a single byte
-            // [1 bit - visible?][3 bits - direction][4 bits - type]
-            // Note that both direction and type only use 2 bits each, but
-            // since there is leftover bits for a full byte, more were used for
-            // expanding in the future
-            // NOTE Stored in a variable so that the final result is cast to
-            // uint8_t, since bitwise operators implicitly cast to int, which
-            // caused the whole encoding process to fail before. Basically,
-            // DON'T TOUCH THIS
-            uint8_t omniByte = (static_cast<uint8_t>(object->get_type())             & 0b00001111) |
-                              ((static_cast<uint8_t>(object->get_direction())  << 4) & 0b01110000) |
-                              ((static_cast<uint8_t>(object->get_visibility()) << 7) & 0b10000000);
-            buffer.insert(omniByte);
-            
-            // Position
-            auto position = object->get_position();
-            buffer.insert(static_cast<int64_t>(position.first));
-            buffer.insert(static_cast<int64_t>(position.second));
-            
-            // Formatting
-            auto formatting = object->get_formating();
-            buffer.insert(static_cast<uint8_t>(formatting.text_color));
-            buffer.insert(static_cast<uint8_t>(formatting.background_color));
-            
-            // Texture
-            auto texturePlane = object->get_texture().get_plane();
-            // ... height
-            buffer.insert(static_cast<uint64_t>(texturePlane.size()));
-            for(const auto& row : texturePlane) {
-                // ... row width
-                buffer.insert(static_cast<uint64_t>(row.size()));
-                for(const auto& point : row) {
-                    // Texture point character
-                    buffer.insert(static_cast<uint8_t>(point.character));
-                    // Texture point formatting
-                    buffer.insert(static_cast<uint8_t>(point.formating.text_color));
-                    buffer.insert(static_cast<uint8_t>(point.formating.background_color));
-                }
-            }
-        }
+        // Position
+        auto position = object->get_position();
+        const int64_t positionFields[2] = {
+            static_cast<int64_t>(position.first),
+            static_cast<int64_t>(position.second)
+        };
+        writer.writeCoordinates(positionFields, 2);
+        
+        // Formatting
+        auto formatting = object->get_formating();
+        writer.write(static_cast<uint8_t>(formatting.text_color));
+        writer.write(static_cast<uint8_t>(formatting.background_color));
         
-        buffer.get(data, buffer.size());
+        // Texture
+        writeTexture(writer, object->get_texture());
     }
     
-    // Generate full message with header
-    return toBytesHelper(data);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessageObjectDelta::toBytes(WireFormat format) const {
+    // Calculate body size: sequences, despawned ids, then an id, the field
+    // bits and the fields sent per update
+    size_t bodySize = countSize(format, delta.baseSequence) + countSize(format, delta.sequence) + countSize(format, delta.despawned.size());
+    for(auto id : delta.despawned)
+        bodySize += countSize(format, id);
+    
+    bodySize += countSize(format, delta.updates.size());
+    for(const auto& update : delta.updates) {
+        bodySize += countSize(format, update.id) + 1;
+        if(update.fields & objectFieldCharacter)
+            bodySize++;
+        if(update.fields & objectFieldFlags)
+            bodySize++;
+        if(update.fields & objectFieldPosition) {
+            auto position = update.object.get_position();
+            bodySize += coordinateSize(format, position.first) + coordinateSize(format, position.second);
+        }
+        if(update.fields & objectFieldFormatting)
+            bodySize += 2;
+        if(update.fields & objectFieldTexture)
+            bodySize += textureSize(format, update.object.get_texture());
+    }
+    
+    MessageWriter writer(type, bodySize, format);
+    writer.writeCount(delta.baseSequence);
+    writer.writeCount(delta.sequence);
+    
+    // Despawned objects
+    writer.writeCount(delta.despawned.size());
+    for(auto id : delta.despawned)
+        writer.writeCount(id);
+    
+    // Spawned and changed objects, with only the fields they carry, in the
+    // same order as MapObjectData
+    writer.writeCount(delta.updates.size());
+    for(const auto& update : delta.updates) {
+        const Object& object = update.object;
+        writer.writeCount(update.id);
+        writer.write(update.fields);
+        if(update.fields & objectFieldCharacter)
+            writer.write(static_cast<uint8_t>(object.get_char()));
+        if(update.fields & objectFieldFlags)
+            writer.write(objectFlags(object));
+        if(update.fields & objectFieldPosition) {
+            auto position = object.get_position();
+            const int64_t positionFields[2] = {
+                static_cast<int64_t>(position.first),
+                static_cast<int64_t>(position.second)
+            };
+            writer.writeCoordinates(positionFields, 2);
+        }
+        if(update.fields & objectFieldFormatting) {
+            auto formatting = object.get_formating();
+            writer.write(static_cast<uint8_t>(formatting.text_color));
+            writer.write(static_cast<uint8_t>(formatting.background_color));
+        }
+        if(update.fields & objectFieldTexture)
+            writeTexture(writer, object.get_texture());
+    }
+    
+    return writer.finish();
 }
 
 ClientMessagePlayerData::ClientMessagePlayerData(std::vector<std::shared_ptr<Player> >& players) :
@@ -556,70 +702,208 @@ ClientMessagePlayerData::ClientMessagePlayerData(std::vector<PlayerSnapshot>&& p
     playersSnapshots(playersSnapshots)
 {}
 
-const std::vector<uint8_t> ClientMessagePlayerData::toBytes() const {
-    std::vector<uint8_t> data;
+const std::vector<uint8_t> ClientMessagePlayerData::toBytes(WireFormat format) const {
+    // Calculate body size: player count, then each player's name, position,
+    // level and inventory
+    auto count = playersSnapshots.size();
+    size_t bodySize = countSize(format, count);
+    for(const auto& snapshot : playersSnapshots) {
+        bodySize += 1 + snapshot.name.size();
+        bodySize += coordinateSize(format, snapshot.x) + coordinateSize(format, snapshot.y) + coordinateSize(format, snapshot.level);
+        bodySize += countSize(format, snapshot.items.size());
+        for(const auto& item : snapshot.items)
+            bodySize += countSize(format, item.size()) + item.size();
+    }
     
-    {
-        Buffer buffer;
-        
-        // Insert player count into buffer
-        auto count = playersSnapshots.size();
-        buffer.insert(static_cast<uint64_t>(count));
-        
-        // Insert player names into buffer
-        for(auto n = 0; n < count; n++) {
-            auto name = playersSnapshots[n].name;
-            // Add name size; names are limited to 256 bytes
-            buffer.insert(static_cast<uint8_t>(name.size()));
-            // Add name bytes
-            buffer.insert(name);
-        }
-        
-        // Insert positions into buffer
-        for(auto p = 0; p < count; p++) {
-            buffer.insert(static_cast<int64_t>(playersSnapshots[p].x));
-            buffer.insert(static_cast<int64_t>(playersSnapshots[p].y));
-        }
-        
-        // Insert levels into buffer
-        for(auto l = 0; l < count; l++)
-            buffer.insert(static_cast<int64_t>(playersSnapshots[l].level));
+    MessageWriter writer(type, bodySize, format);
+    
+    // Insert player count
+    writer.writeCount(count);
+    
+    // Insert player names
+    for(auto n = 0; n < count; n++) {
+        const auto& name = playersSnapshots[n].name;
+        // Add name size; names are limited to 256 bytes
+        writer.write(static_cast<uint8_t>(name.size()));
+        // Add name bytes
+        writer.write(name);
+    }
+    
+    // Insert positions
+    for(auto p = 0; p < count; p++) {
+        const int64_t positionFields[2] = {
+            playersSnapshots[p].x,
+            playersSnapshots[p].y
+        };
+        writer.writeCoordinates(positionFields, 2);
+    }
+    
+    // Insert levels
+    for(auto l = 0; l < count; l++)
+        writer.writeCoordinate(playersSnapshots[l].level);
+    
+    // Insert inventories
+    for(auto i = 0; i < count; i++) {
+        // Count
+        writer.writeCount(playersSnapshots[i].items.size());
         
-        // Insert inventories into buffer
-        for(auto i = 0; i < count; i++) {
-            // Count
-            buffer.insert(static_cast<uint64_t>(playersSnapshots[i].items.size()));
-            
-            // Names
-            for(auto item : playersSnapshots[i].items) {
-                buffer.insert(static_cast<uint64_t>(item.size()));
-                buffer.insert(item);
-            }
+        // Names
+        for(const auto& item : playersSnapshots[i].items) {
+            writer.writeCount(item.size());
+            writer.write(item);
         }
-        
-        buffer.get(data, buffer.size());
     }
     
-    // Generate full message with header
-    return toBytesHelper(data);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessageActionAck::toBytes(WireFormat format) const {
+    MessageWriter writer(type, 1, format);
+    writer.write(static_cast<uint8_t>(accepted));
+    return writer.finish();
 }
 
-const std::vector<uint8_t> ClientMessageActionAck::toBytes() const {
-    return toBytesHelper({accepted});
+const std::vector<uint8_t> ClientMessageSnapshotChannel::toBytes(WireFormat format) const {
+    MessageWriter writer(type, 4, format);
+    writer.write(token);
+    return writer.finish();
 }
+
+/// Builds a message whose body is a single timestamp
+static std::vector<uint8_t> timestampToBytes(GameMessageType type, uint64_t timestamp, WireFormat format) {
+    MessageWriter writer(type, 8, format);
+    writer.write(timestamp);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessagePing::toBytes(WireFormat format) const {
+    return timestampToBytes(type, timestamp, format);
+}
+
+const std::vector<uint8_t> ClientMessagePong::toBytes(WireFormat format) const {
+    return timestampToBytes(type, timestamp, format);
+}
+
+const std::vector<uint8_t> ClientMessageFragment::toBytes(WireFormat format) const {
+    MessageWriter writer(type, 1 + data.size(), format);
+    writer.write(static_cast<uint8_t>(last));
+    writer.write(data);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessageDoJoin::toBytes(WireFormat format) const {
+    MessageWriter writer(type, senderName.size(), format);
+    writer.write(senderName);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessageDoChat::toBytes(WireFormat format) const {
+    MessageWriter writer(type, message.size(), format);
+    writer.write(message);
+    return writer.finish();
+}
+
+const std::vector<uint8_t> ClientMessageDoAction::toBytes(WireFormat format) const {
+    return toBytesHelper(action.toBytes(), format);
+}
+
+const std::vector<uint8_t> ClientMessageDoPing::toBytes(WireFormat format) const {
+    return timestampToBytes(type, timestamp, format);
+}
+
+const std::vector<uint8_t> ClientMessageDoPong::toBytes(WireFormat format) const {
+    return timestampToBytes(type, timestamp, format);
+}
+
+const std::vector<uint8_t> ClientMessageDoObjectAck::toBytes(WireFormat format) const {
+    MessageWriter writer(type, 8, format);
+    writer.write(sequence);
+    return writer.finish();
+}
+
+std::unique_ptr<ClientMessage> ClientMessageJoin::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageJoin(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageQuit::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageQuit(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageChat::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageChat(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageMapTileData::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageMapTileData(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageMapObjectData::clone() const {
+    // Copy the objects too, so the copy doesn't share objects that are still
+    // being updated by the game
+    std::vector<std::shared_ptr<Object>> objectsCopy;
+    objectsCopy.reserve(objects.size());
+    for(const auto& object : objects)
+        objectsCopy.emplace_back(new Object(*object));
     
-const std::vector<uint8_t> ClientMessageDoJoin::toBytes() const {
-    return toBytesHelper(
-        std::vector<uint8_t>(senderName.begin(), senderName.end())
-    );
+    return std::unique_ptr<ClientMessage>(new ClientMessageMapObjectData(objectsCopy));
+}
+
+std::unique_ptr<ClientMessage> ClientMessagePlayerData::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessagePlayerData(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageActionAck::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageActionAck(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageSnapshotChannel::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageSnapshotChannel(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessagePing::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessagePing(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessagePong::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessagePong(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageFragment::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageFragment(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageObjectDelta::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageObjectDelta(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoJoin::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoJoin(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoQuit::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoQuit(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoChat::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoChat(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoAction::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoAction(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoSnapshotChannel::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoSnapshotChannel(*this));
+}
+
+std::unique_ptr<ClientMessage> ClientMessageDoPing::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoPing(*this));
 }
 
-const std::vector<uint8_t> ClientMessageDoChat::toBytes() const {
-    return toBytesHelper(
-        std::vector<uint8_t>(message.begin(), message.end())
-    );
+std::unique_ptr<ClientMessage> ClientMessageDoPong::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoPong(*this));
 }
 
-const std::vector<uint8_t> ClientMessageDoAction::toBytes() const {
-    return toBytesHelper(action.toBytes());
+std::unique_ptr<ClientMessage> ClientMessageDoObjectAck::clone() const {
+    return std::unique_ptr<ClientMessage>(new ClientMessageDoObjectAck(*this));
 }
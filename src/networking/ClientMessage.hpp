@@ -3,24 +3,14 @@
 #include "../server/Player.hpp"
 #include "../server/Map.h"
 #include "Buffer.hpp"
+#include "GameMessageType.hpp"
+#include "MessageWriter.hpp"
+#include "WireFormat.hpp"
 #include "PlayerSnapshot.hpp"
+#include "ObjectDelta.hpp"
 #include "Action.hpp"
 #include <memory>
 
-enum class GameMessageType {
-    Join = 0,
-    Quit = 1,
-    Chat = 2,
-    MapTileData = 3,
-    MapObjectData = 4,
-    PlayerData = 5,
-    ActionAck = 6,
-    DoJoin = 100,
-    DoQuit = 101,
-    DoChat = 102,
-    DoAction = 103
-};
-
 /// A message sent to a client or by a client
 class ClientMessage {
 protected:
@@ -31,8 +21,8 @@ protected:
     {}
     
     /// Helper for toBytes that automatically creates message from body
-    const std::vector<uint8_t> toBytesHelper(const std::vector<uint8_t>& data) const;
-    
+    const std::vector<uint8_t> toBytesHelper(const std::vector<uint8_t>& data, WireFormat format) const;
+
 public:
     /// Virtual destructor. Must be implemented if base classes do memory
     /// management
@@ -45,15 +35,20 @@ public:
     /// hasn't joined yet or the message is an action to be sent to the server
     const std::string senderName;
     
-    /// Converts client message to bytes (for networking). Has no body by
-    /// default. Should be implemented, but not required
-    virtual const std::vector<uint8_t> toBytes() const;
+    /// Converts client message to bytes (for networking), in a given wire
+    /// format. Has no body by default. Should be implemented, but not required
+    virtual const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const;
+    
+    /// Create a copy of this message, e.g. to pass it to another thread (see
+    /// LocalChannel)
+    virtual std::unique_ptr<ClientMessage> clone() const = 0;
     
     /// Create a client message from a buffer. If there is enough data for a
     /// full message, buffer is (partially) popped and a new ClientMessage is
     /// returned, else, nullptr is returned and buffer is not popped. This is
-    /// a factory
-    static std::unique_ptr<ClientMessage> fromBuffer(Buffer& buffer);
+    /// a factory. Throws std::invalid_argument if the message header is
+    /// malformed, as the rest of the buffer can't be framed anymore
+    static std::unique_ptr<ClientMessage> fromBuffer(Buffer& buffer, WireFormat format = WireFormat::Fixed);
 };
 
 struct ClientMessageJoin : public ClientMessage {
@@ -64,7 +59,8 @@ struct ClientMessageJoin : public ClientMessage {
     {};
     
     ~ClientMessageJoin() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageQuit : public ClientMessage {
@@ -74,7 +70,8 @@ struct ClientMessageQuit : public ClientMessage {
     {};
     
     ~ClientMessageQuit() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageChat : public ClientMessage {
@@ -87,7 +84,8 @@ struct ClientMessageChat : public ClientMessage {
     {};
     
     ~ClientMessageChat() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageMapTileData : public ClientMessage {
@@ -105,7 +103,8 @@ struct ClientMessageMapTileData : public ClientMessage {
     ClientMessageMapTileData(MapPlane&& mapPlane, uint64_t width, uint64_t height);
     
     ~ClientMessageMapTileData() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageMapObjectData : public ClientMessage {
@@ -119,7 +118,8 @@ struct ClientMessageMapObjectData : public ClientMessage {
     {}
     
     ~ClientMessageMapObjectData() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessagePlayerData : public ClientMessage {
@@ -133,7 +133,8 @@ struct ClientMessagePlayerData : public ClientMessage {
     ClientMessagePlayerData(std::vector<PlayerSnapshot>&& playersSnapshots);
     
     ~ClientMessagePlayerData() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageActionAck : public ClientMessage {
@@ -148,7 +149,97 @@ struct ClientMessageActionAck : public ClientMessage {
     {};
     
     ~ClientMessageActionAck() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageSnapshotChannel : public ClientMessage {
+    /// Token to send in hello datagrams. 0 if the server has no snapshot
+    /// channel
+    uint32_t token;
+    
+    /// Sent by the server to a client that asked for a snapshot channel. See
+    /// SnapshotChannel.hpp
+    ClientMessageSnapshotChannel(uint32_t token) :
+        ClientMessage(GameMessageType::SnapshotChannel, ""),
+        token(token)
+    {};
+    
+    ~ClientMessageSnapshotChannel() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessagePing : public ClientMessage {
+    /// When the ping was sent, in the server's monotonic clock (see
+    /// monotonicMicroseconds)
+    uint64_t timestamp;
+    
+    /// Sent by the server every so often. The client answers with a DoPong
+    /// echoing the timestamp, so the server can measure the round trip time
+    ClientMessagePing(uint64_t timestamp) :
+        ClientMessage(GameMessageType::Ping, ""),
+        timestamp(timestamp)
+    {};
+    
+    ~ClientMessagePing() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessagePong : public ClientMessage {
+    /// Timestamp of the DoPing this answers, in the client's monotonic clock
+    uint64_t timestamp;
+    
+    /// Sent by the server to answer a DoPing
+    ClientMessagePong(uint64_t timestamp) :
+        ClientMessage(GameMessageType::Pong, ""),
+        timestamp(timestamp)
+    {};
+    
+    ~ClientMessagePong() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageFragment : public ClientMessage {
+    /// Whether this is the last piece of the message
+    bool last;
+    
+    /// A piece of the message, header included
+    std::vector<uint8_t> data;
+    
+    /// Sent by the server instead of a big message, in pieces, so other
+    /// messages can be sent in between (see WriteQueue). The pieces of a
+    /// message arrive in order, and only one message is fragmented at a time.
+    /// The client joins the pieces and parses the result as a message
+    ClientMessageFragment(bool last, std::vector<uint8_t> data) :
+        ClientMessage(GameMessageType::Fragment, ""),
+        last(last),
+        data(data)
+    {};
+    
+    ~ClientMessageFragment() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageObjectDelta : public ClientMessage {
+    /// Changes to the objects of the player's level
+    ObjectDelta delta;
+    
+    /// Sent by the server every turn instead of MapObjectData. Carries only
+    /// what changed since the last baseline the client confirmed with
+    /// DoObjectAck, or the whole level if the server doesn't have that
+    /// baseline anymore (see ObjectHistory and ObjectMirror)
+    ClientMessageObjectDelta(ObjectDelta delta) :
+        ClientMessage(GameMessageType::ObjectDelta, ""),
+        delta(std::move(delta))
+    {};
+    
+    ~ClientMessageObjectDelta() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageDoJoin : public ClientMessage {
@@ -159,7 +250,8 @@ struct ClientMessageDoJoin : public ClientMessage {
     {};
     
     ~ClientMessageDoJoin() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageDoQuit : public ClientMessage {
@@ -169,6 +261,7 @@ struct ClientMessageDoQuit : public ClientMessage {
     {};
     
     ~ClientMessageDoQuit() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
 };
 
 struct ClientMessageDoChat : public ClientMessage {
@@ -181,7 +274,8 @@ struct ClientMessageDoChat : public ClientMessage {
     {};
     
     ~ClientMessageDoChat() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 struct ClientMessageDoAction : public ClientMessage {
@@ -194,7 +288,67 @@ struct ClientMessageDoAction : public ClientMessage {
     {}
     
     ~ClientMessageDoAction() = default;
-    const std::vector<uint8_t> toBytes() const override;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageDoSnapshotChannel : public ClientMessage {
+    /// Sent by the client if the client wants snapshots over UDP. See
+    /// SnapshotChannel.hpp
+    ClientMessageDoSnapshotChannel() :
+        ClientMessage(GameMessageType::DoSnapshotChannel, "")
+    {};
+    
+    ~ClientMessageDoSnapshotChannel() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+};
+
+struct ClientMessageDoPing : public ClientMessage {
+    /// When the ping was sent, in the client's monotonic clock
+    uint64_t timestamp;
+    
+    /// Sent by the client every so often. The server answers with a Pong
+    /// echoing the timestamp
+    ClientMessageDoPing(uint64_t timestamp) :
+        ClientMessage(GameMessageType::DoPing, ""),
+        timestamp(timestamp)
+    {};
+    
+    ~ClientMessageDoPing() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageDoPong : public ClientMessage {
+    /// Timestamp of the Ping this answers, in the server's monotonic clock
+    uint64_t timestamp;
+    
+    /// Sent by the client to answer a Ping
+    ClientMessageDoPong(uint64_t timestamp) :
+        ClientMessage(GameMessageType::DoPong, ""),
+        timestamp(timestamp)
+    {};
+    
+    ~ClientMessageDoPong() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
+};
+
+struct ClientMessageDoObjectAck : public ClientMessage {
+    /// Sequence of the object baseline the client has, or 0 if it is missing
+    /// the baseline of the last ObjectDelta
+    uint64_t sequence;
+    
+    /// Sent by the client after applying an ObjectDelta, so the next ones are
+    /// based on it. Sent with sequence 0 to get the whole level instead
+    ClientMessageDoObjectAck(uint64_t sequence) :
+        ClientMessage(GameMessageType::DoObjectAck, ""),
+        sequence(sequence)
+    {};
+    
+    ~ClientMessageDoObjectAck() = default;
+    std::unique_ptr<ClientMessage> clone() const override;
+    const std::vector<uint8_t> toBytes(WireFormat format = WireFormat::Fixed) const override;
 };
 
 #endif
@@ -0,0 +1,27 @@
+#ifndef ROGUELIKE_GAME_MESSAGE_TYPE_HPP_INCLUDED
+#define ROGUELIKE_GAME_MESSAGE_TYPE_HPP_INCLUDED
+
+enum class GameMessageType {
+    Join = 0,
+    Quit = 1,
+    Chat = 2,
+    MapTileData = 3,
+    MapObjectData = 4,
+    PlayerData = 5,
+    ActionAck = 6,
+    SnapshotChannel = 7,
+    Ping = 8,
+    Pong = 9,
+    Fragment = 10,
+    ObjectDelta = 11,
+    DoJoin = 100,
+    DoQuit = 101,
+    DoChat = 102,
+    DoAction = 103,
+    DoSnapshotChannel = 104,
+    DoPing = 105,
+    DoPong = 106,
+    DoObjectAck = 107
+};
+
+#endif
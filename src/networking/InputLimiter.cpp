@@ -0,0 +1,99 @@
+#include "InputLimiter.hpp"
+#include <algorithm>
+#include <cmath>
+
+uint64_t InputLimits::maxBodySizeOf(uint16_t type) const {
+    auto it = maxBodySizes.find(type);
+    if(it == maxBodySizes.end())
+        return maxBodySize;
+    
+    return it->second;
+}
+
+void TokenBucket::reset(double rate, double burst) {
+    this->rate = rate;
+    this->burst = std::max(burst, 1.0);
+    tokens = this->burst;
+    last = std::chrono::steady_clock::now();
+}
+
+void TokenBucket::refill(std::chrono::steady_clock::time_point now) {
+    if(rate <= 0)
+        return;
+    
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    last = now;
+    tokens = std::min(burst, tokens + elapsed * rate);
+}
+
+int TokenBucket::waitMs() const {
+    if(rate <= 0 || tokens > 0)
+        return 0;
+    
+    // Just past the point where the debt is paid off
+    return static_cast<int>(std::ceil(-tokens / rate * 1000.0)) + 1;
+}
+
+void TokenBucket::take(double amount) {
+    if(rate > 0)
+        tokens -= amount;
+}
+
+void InputLimiter::setLimits(const InputLimits& limits) {
+    this->limits = limits;
+    bytes.reset(limits.bytesPerSecond, limits.byteBurst);
+    messages.reset(limits.messagesPerSecond, limits.messageBurst);
+}
+
+bool InputLimiter::checkHeader(Buffer& buffer, WireFormat format) {
+    // Don't bother parsing the header if there is nothing to check
+    if(limits.maxBodySize == 0 && limits.maxBodySizes.empty())
+        return true;
+    
+    MessageHeader header;
+    if(!peekHeader(buffer, format, header))
+        return true;
+    
+    uint64_t maxSize = limits.maxBodySizeOf(header.type);
+    if(maxSize != 0 && header.bodySize > maxSize) {
+        stats.oversizedMessages++;
+        return false;
+    }
+    
+    return true;
+}
+
+bool InputLimiter::admit(size_t size) {
+    if(limits.messagesPerSecond <= 0 && limits.bytesPerSecond <= 0)
+        return true;
+    
+    // Only take from the buckets if both have tokens, so a message that has
+    // to wait is counted once, when it is admitted
+    auto now = std::chrono::steady_clock::now();
+    messages.refill(now);
+    bytes.refill(now);
+    if(waitMs() > 0) {
+        // Count each message once, not every time it is checked again
+        if(!throttled)
+            stats.limitedMessages++;
+        throttled = true;
+        return false;
+    }
+    
+    messages.take(1);
+    bytes.take(static_cast<double>(size));
+    throttled = false;
+    return true;
+}
+
+int InputLimiter::waitMs() const {
+    return std::max(messages.waitMs(), bytes.waitMs());
+}
+
+bool InputLimiter::isThrottled() const {
+    return throttled;
+}
+
+InputLimitAction InputLimiter::getAction() const {
+    return limits.action;
+}
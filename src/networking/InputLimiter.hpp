@@ -0,0 +1,131 @@
+#ifndef ROGUELIKE_INPUT_LIMITER_HPP_INCLUDED
+#define ROGUELIKE_INPUT_LIMITER_HPP_INCLUDED
+#include "Buffer.hpp"
+#include "GameMessageType.hpp"
+#include "WireFormat.hpp"
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+
+/// What happens to a connection that sends messages faster than its rate
+/// limits allow
+enum class InputLimitAction {
+    /// Reading from the connection pauses until the limits let the next
+    /// message through. Nothing is lost; the unread bytes fill the kernel's
+    /// buffers, so TCP makes the sender slow down
+    Throttle,
+    /// The connection is disconnected
+    Disconnect
+};
+
+/// Limits on what a single connection may send to a server. Everything is
+/// unlimited by default
+struct InputLimits {
+    /// Maximum message body size per message type, in bytes. Checked as soon
+    /// as a message header arrives, so a connection announcing a huge message
+    /// is disconnected before its body is buffered
+    std::unordered_map<uint16_t, uint64_t> maxBodySizes;
+    
+    /// Maximum message body size for types not in maxBodySizes. 0 for no
+    /// limit
+    uint64_t maxBodySize = 0;
+    
+    /// Sustained bytes per second, and how many bytes can arrive at once on
+    /// top of that. A rate of 0 means no limit
+    double bytesPerSecond = 0;
+    double byteBurst = 0;
+    
+    /// Sustained messages per second, and how many messages can arrive at once
+    /// on top of that. A rate of 0 means no limit
+    double messagesPerSecond = 0;
+    double messageBurst = 0;
+    
+    /// What to do with messages over the rate limits. Oversized messages always
+    /// disconnect, since the stream can't be trusted anymore
+    InputLimitAction action = InputLimitAction::Throttle;
+    
+    /// Gets the maximum body size of a message type. 0 for no limit
+    uint64_t maxBodySizeOf(uint16_t type) const;
+};
+
+/// Counters of a single connection's input limits. Can be updated and read
+/// from any thread
+struct InputLimiterStats {
+    /// Messages whose header announced a body bigger than allowed
+    std::atomic<uint64_t> oversizedMessages;
+    
+    /// Messages that went over a rate limit, and had to wait for it or caused
+    /// a disconnection
+    std::atomic<uint64_t> limitedMessages;
+    
+    InputLimiterStats() :
+        oversizedMessages(0),
+        limitedMessages(0)
+    {}
+};
+
+/// A token bucket. Tokens are added at a fixed rate, up to a burst, and taken
+/// when something arrives
+class TokenBucket {
+    double rate = 0;
+    double burst = 0;
+    double tokens = 0;
+    std::chrono::steady_clock::time_point last;
+public:
+    /// Set the rate (tokens per second) and burst. The bucket starts full. A
+    /// rate of 0 means no limit; a burst below 1 is taken as 1
+    void reset(double rate, double burst);
+    
+    /// Add the tokens for the time since the last refill
+    void refill(std::chrono::steady_clock::time_point now);
+    
+    /// Gets the time until the bucket has tokens again, in milliseconds,
+    /// rounded up. 0 if it has some now, or there is no limit
+    int waitMs() const;
+    
+    /// Take amount tokens. Anything goes while there are tokens left, so
+    /// amounts bigger than the tokens left, or the burst, leave the bucket in
+    /// debt until enough tokens are added
+    void take(double amount);
+};
+
+/// Enforces InputLimits on a single connection, as its messages are parsed
+class InputLimiter {
+    InputLimits limits;
+    TokenBucket bytes, messages;
+    
+    /// Whether the last message checked by admit went over the rate limits
+    bool throttled = false;
+public:
+    /// Counters for this connection
+    InputLimiterStats stats;
+    
+    /// Set the limits. Rate limits start with full buckets
+    void setLimits(const InputLimits& limits);
+    
+    /// Check the header at the start of a read buffer, which may not have its
+    /// body yet. Returns false if the message is bigger than allowed for its
+    /// type. Throws std::invalid_argument if the header is malformed
+    bool checkHeader(Buffer& buffer, WireFormat format);
+    
+    /// Count a full message of size bytes (header included) against the rate
+    /// limits. Call before the message is taken from the read buffer. Returns
+    /// false if it went over them, in which case nothing is counted, and the
+    /// message should be handled as limits.action says: with
+    /// InputLimitAction::Throttle, it stays in the read buffer and is admitted
+    /// again once waitMs is over
+    bool admit(size_t size);
+    
+    /// Gets the time until the rate limits let a message through again, in
+    /// milliseconds. 0 if they do now
+    int waitMs() const;
+    
+    /// Check if the last message checked by admit went over the rate limits,
+    /// so it is still waiting in the read buffer
+    bool isThrottled() const;
+    
+    /// Gets the action for messages over the rate limits
+    InputLimitAction getAction() const;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "LinkStats.hpp"
+#include <chrono>
+
+uint64_t monotonicMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LinkStats::LinkStats() :
+    bytesIn(0),
+    bytesOut(0),
+    messagesIn(0),
+    messagesOut(0),
+    lastRtt(0),
+    rtt(0),
+    jitter(0),
+    pongs(0),
+    lastReceived(monotonicMicroseconds()),
+    lastPing(lastReceived)
+{}
+
+void LinkStats::received(size_t bytes) {
+    if(bytes == 0)
+        return;
+    
+    bytesIn += bytes;
+    lastReceived = monotonicMicroseconds();
+}
+
+void LinkStats::addPong(uint64_t pingTimestamp) {
+    // Ignore timestamps from the future, which can only come from a confused
+    // or lying peer
+    uint64_t now = monotonicMicroseconds();
+    if(pingTimestamp > now)
+        return;
+    
+    uint64_t sample = now - pingTimestamp;
+    lastRtt = sample;
+    
+    // The first sample sets the estimate. After that, the deviation moves a
+    // quarter and the estimate an eighth of the way to each sample
+    if(pongs++ == 0) {
+        rtt = sample;
+        jitter = sample / 2;
+        return;
+    }
+    
+    uint64_t smoothed = rtt;
+    uint64_t deviation = smoothed > sample ? smoothed - sample : sample - smoothed;
+    jitter = (3 * jitter + deviation) / 4;
+    rtt = (7 * smoothed + sample) / 8;
+}
+
+bool LinkStats::pingDue(uint64_t now, int intervalMs) {
+    if(now - lastPing < static_cast<uint64_t>(intervalMs) * 1000)
+        return false;
+    
+    lastPing = now;
+    return true;
+}
+
+uint64_t LinkStats::idleTime(uint64_t now) const {
+    uint64_t last = lastReceived;
+    return now > last ? now - last : 0;
+}
@@ -0,0 +1,55 @@
+#ifndef ROGUELIKE_LINK_STATS_HPP_INCLUDED
+#define ROGUELIKE_LINK_STATS_HPP_INCLUDED
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Microseconds on a monotonic clock, for ping timestamps. Only comparable
+/// with other timestamps of the same process, which is why pongs echo the
+/// timestamp of their ping instead of sending their own
+uint64_t monotonicMicroseconds();
+
+/// Traffic and round trip times of a connection. Everything can be read from
+/// any thread while the connection's network thread updates it
+struct LinkStats {
+    /// Bytes read from and written to the connection
+    std::atomic<uint64_t> bytesIn, bytesOut;
+    
+    /// Messages parsed from the connection, and queued for it
+    std::atomic<uint64_t> messagesIn, messagesOut;
+    
+    /// Round trip time of the last pong, smoothed round trip time, and jitter
+    /// (smoothed deviation from the smoothed round trip time), in
+    /// microseconds. All 0 until the first pong
+    std::atomic<uint64_t> lastRtt, rtt, jitter;
+    
+    /// Amount of pongs received
+    std::atomic<uint64_t> pongs;
+    
+    /// When something was last read from the connection. See
+    /// monotonicMicroseconds
+    std::atomic<uint64_t> lastReceived;
+    
+    /// When the last ping was sent. Only used by the thread sending pings
+    uint64_t lastPing;
+    
+    /// Create stats for a new connection, which counts as just heard from
+    LinkStats();
+    
+    /// Note that bytes were read from the connection. Reads of 0 bytes don't
+    /// count as activity
+    void received(size_t bytes);
+    
+    /// Add a round trip time sample from a pong echoing the timestamp of a
+    /// ping sent by this process. Smoothed like TCP does (RFC 6298)
+    void addPong(uint64_t pingTimestamp);
+    
+    /// Check if a ping should be sent, pinging every intervalMs. If so, it
+    /// counts as sent at now
+    bool pingDue(uint64_t now, int intervalMs);
+    
+    /// Microseconds since something was last read from the connection
+    uint64_t idleTime(uint64_t now) const;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "LocalChannel.hpp"
+
+void LocalQueue::push(std::unique_ptr<ClientMessage> message) {
+    queue.push(std::move(message));
+    wake();
+}
+
+void LocalQueue::wake() {
+    waker.wake();
+}
+
+void LocalQueue::pop(std::deque<std::unique_ptr<ClientMessage> >& messages) {
+    // Clear before popping, so a message pushed from now on wakes the
+    // receiver again
+    waker.clear();
+    
+    std::unique_ptr<ClientMessage> message;
+    while(queue.pop(message))
+        messages.push_back(std::move(message));
+}
+
+LocalChannel::LocalChannel() :
+    closed(false)
+{}
+
+void LocalChannel::close() {
+    if(!closed.exchange(true)) {
+        toServer.wake();
+        toClient.wake();
+    }
+}
+
+bool LocalChannel::isClosed() const {
+    return closed;
+}
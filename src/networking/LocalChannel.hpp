@@ -0,0 +1,50 @@
+#ifndef ROGUELIKE_LOCAL_CHANNEL_HPP_INCLUDED
+#define ROGUELIKE_LOCAL_CHANNEL_HPP_INCLUDED
+#include "ClientMessage.hpp"
+#include "SpscQueue.hpp"
+#include "Waker.hpp"
+#include <atomic>
+#include <deque>
+
+/// Messages going one way through a LocalChannel, with a socket that becomes
+/// readable when there are messages, so the receiver can wait for them with a
+/// SocketSelector along with its other sockets
+class LocalQueue {
+    SpscQueue<std::unique_ptr<ClientMessage> > queue;
+public:
+    /// Woken when there may be messages. Wait for read events on its reader
+    Waker waker;
+    
+    /// Queue a message and wake the receiver. Sender thread only
+    void push(std::unique_ptr<ClientMessage> message);
+    
+    /// Wake the receiver without a message
+    void wake();
+    
+    /// Move all queued messages to the end of messages. Receiver thread only
+    void pop(std::deque<std::unique_ptr<ClientMessage> >& messages);
+};
+
+/// An in-process connection between a Client and a Server, for when both live
+/// in the same process. Messages are passed as objects, so they are never
+/// serialised, copied through the kernel or parsed. Messages to the server are
+/// ClientMessages too (Do* messages); the server converts them with
+/// ServerMessage::fromClient
+class LocalChannel {
+    std::atomic<bool> closed;
+public:
+    /// Messages from the client to the server, and from the server to the
+    /// client
+    LocalQueue toServer, toClient;
+    
+    LocalChannel();
+    
+    /// Close the channel from either side. Both sides are woken up
+    void close();
+    
+    /// Check if either side closed the channel. Messages already queued can
+    /// still be popped
+    bool isClosed() const;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "MessageWriter.hpp"
+#include <stdexcept>
+
+MessageWriter::MessageWriter(GameMessageType type, size_t bodySize, WireFormat format) :
+    format(format),
+    bytes(::headerSize(format, static_cast<uint16_t>(type), bodySize) + bodySize)
+{
+    // Write header: type and data length
+    if(format == WireFormat::Compact) {
+        writeVarint(static_cast<uint64_t>(type));
+        writeVarint(static_cast<uint64_t>(bodySize));
+    }
+    else {
+        write(static_cast<uint16_t>(type));
+        write(static_cast<uint64_t>(bodySize));
+    }
+}
+
+uint8_t* MessageWriter::advance(size_t byteCount) {
+    if(byteCount > bytes.size() - position)
+        throw std::length_error("MessageWriter: write of " + std::to_string(byteCount) + " bytes exceeds message size of " + std::to_string(bytes.size()) + " bytes");
+    
+    uint8_t* out = bytes.data() + position;
+    position += byteCount;
+    return out;
+}
+
+template<typename T> void MessageWriter::writeInteger(T integer) {
+    storeLittleEndian(integer, advance(sizeof(T)));
+}
+
+void MessageWriter::write(const uint8_t* data, size_t dataSize) {
+    if(dataSize > 0)
+        std::memcpy(advance(dataSize), data, dataSize);
+}
+
+void MessageWriter::write(const std::vector<uint8_t>& data) {
+    write(data.data(), data.size());
+}
+
+void MessageWriter::write(const std::string& string) {
+    write(reinterpret_cast<const uint8_t*>(string.data()), string.size());
+}
+
+void MessageWriter::write(uint8_t byte) {
+    *advance(1) = byte;
+}
+
+void MessageWriter::write(uint16_t uint16) {
+    writeInteger(uint16);
+}
+
+void MessageWriter::write(uint32_t uint32) {
+    writeInteger(uint32);
+}
+
+void MessageWriter::write(uint64_t uint64) {
+    writeInteger(uint64);
+}
+
+void MessageWriter::write(int8_t int8) {
+    writeInteger(int8);
+}
+
+void MessageWriter::write(int16_t int16) {
+    writeInteger(int16);
+}
+
+void MessageWriter::write(int32_t int32) {
+    writeInteger(int32);
+}
+
+void MessageWriter::write(int64_t int64) {
+    writeInteger(int64);
+}
+
+void MessageWriter::writeVarint(uint64_t uint64) {
+    uint8_t varint[maxVarintSize];
+    write(varint, storeVarint(uint64, varint));
+}
+
+void MessageWriter::writeVarint(int64_t int64) {
+    writeVarint(zigzagEncode(int64));
+}
+
+void MessageWriter::writeCount(uint64_t count) {
+    if(format == WireFormat::Compact)
+        writeVarint(count);
+    else
+        write(count);
+}
+
+void MessageWriter::writeCoordinate(int64_t coordinate) {
+    if(format == WireFormat::Compact)
+        writeVarint(coordinate);
+    else
+        write(coordinate);
+}
+
+void MessageWriter::writeCoordinates(const int64_t* coordinates, size_t count) {
+    if(format == WireFormat::Compact) {
+        for(size_t i = 0; i < count; i++)
+            writeVarint(coordinates[i]);
+    }
+    else
+        writeArray(coordinates, count);
+}
+
+std::vector<uint8_t> MessageWriter::finish() {
+    if(position != bytes.size())
+        throw std::length_error("MessageWriter::finish: only " + std::to_string(position) + " of " + std::to_string(bytes.size()) + " message bytes were written");
+    
+    position = 0;
+    return std::move(bytes);
+}
+
+std::vector<uint8_t> MessageWriter::finishPrefix() {
+    bytes.resize(position);
+    position = 0;
+    return std::move(bytes);
+}
@@ -0,0 +1,113 @@
+#ifndef ROGUELIKE_MESSAGE_WRITER_HPP_INCLUDED
+#define ROGUELIKE_MESSAGE_WRITER_HPP_INCLUDED
+#include "GameMessageType.hpp"
+#include "Buffer.hpp"
+#include "WireFormat.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Builds a full message (header and body) in a single vector. The exact body
+/// size must be given up front so that the whole message is allocated once.
+/// Fields are appended in order, little-endian. Counts and coordinates are
+/// written according to the wire format
+class MessageWriter {
+    /// Wire format of the message
+    WireFormat format;
+    
+    /// Message bytes, allocated with the final size
+    std::vector<uint8_t> bytes;
+    
+    /// Write position
+    size_t position = 0;
+    
+    /// Gets a pointer to the next byteCount bytes and advances the write
+    /// position. Throws std::length_error if the body size is exceeded
+    uint8_t* advance(size_t byteCount);
+    
+    /// Appends a little-endian integer
+    template<typename T> inline void writeInteger(T integer);
+
+public:
+    /// Header size in the Fixed wire format, in bytes: 2-byte type and 8-byte
+    /// body size
+    static const size_t headerSize = 10;
+    
+    /// Start a message with a given type, body size and wire format. The
+    /// header is written immediately
+    MessageWriter(GameMessageType type, size_t bodySize, WireFormat format = WireFormat::Fixed);
+    
+    // Appends bytes
+    void write(const uint8_t* data, size_t dataSize);
+    
+    // Appends a byte vector
+    void write(const std::vector<uint8_t>& data);
+    
+    // Appends a string
+    void write(const std::string& string);
+    
+    // Appends a byte
+    void write(uint8_t byte);
+    
+    // Appends a little-endian uint16_t
+    void write(uint16_t uint16);
+    
+    // Appends a little-endian uint32_t
+    void write(uint32_t uint32);
+    
+    // Appends a little-endian uint64_t
+    void write(uint64_t uint64);
+    
+    // Appends a little-endian int8_t
+    void write(int8_t int8);
+    
+    // Appends a little-endian int16_t
+    void write(int16_t int16);
+    
+    // Appends a little-endian int32_t
+    void write(int32_t int32);
+    
+    // Appends a little-endian int64_t
+    void write(int64_t int64);
+    
+    // Appends an unsigned LEB128 varint
+    void writeVarint(uint64_t uint64);
+    
+    // Appends a zigzag-encoded signed LEB128 varint
+    void writeVarint(int64_t int64);
+    
+    // Appends a count or length field. Its size is given by countSize
+    void writeCount(uint64_t count);
+    
+    // Appends a coordinate (or other small signed value) field. Its size is
+    // given by coordinateSize
+    void writeCoordinate(int64_t coordinate);
+    
+    // Appends count coordinate fields from a C array. In the Fixed format,
+    // they are written in a single copy
+    void writeCoordinates(const int64_t* coordinates, size_t count);
+    
+    // Appends count little-endian integers from a C array
+    template<typename T> void writeArray(const T* integers, size_t count) {
+        uint8_t* out = advance(count * sizeof(T));
+        #ifdef ROGUELIKE_BIG_ENDIAN
+        for(size_t i = 0; i < count; i++)
+            storeLittleEndian(integers[i], out + i * sizeof(T));
+        #else
+        // Wire format matches memory layout, copy everything at once
+        std::memcpy(out, integers, count * sizeof(T));
+        #endif
+    }
+    
+    /// Get the finished message. Throws std::length_error if the body written
+    /// is smaller than the size given in the constructor. The writer is left
+    /// empty
+    std::vector<uint8_t> finish();
+    
+    /// Get the bytes written so far, header included, for messages whose
+    /// remaining body is sent from somewhere else (see WriteQueue). The writer
+    /// is left empty
+    std::vector<uint8_t> finishPrefix();
+};
+
+#endif
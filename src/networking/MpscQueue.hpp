@@ -0,0 +1,71 @@
+#ifndef ROGUELIKE_MPSC_QUEUE_HPP_INCLUDED
+#define ROGUELIKE_MPSC_QUEUE_HPP_INCLUDED
+#include <atomic>
+#include <utility>
+
+/// An unbounded lock-free queue for many producer threads and a single
+/// consumer thread. Pushing allocates a node; popping frees one. Like
+/// SpscQueue, but producers link their nodes with an atomic exchange. A value
+/// pushed while another producer is midway through its push may only become
+/// visible once that push finishes
+template<typename T> class MpscQueue {
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+        
+        Node() :
+            next(nullptr)
+        {}
+    };
+    
+    /// Node before the first value (consumer side). Always a node whose value
+    /// was already popped, or the initial empty node
+    Node* head;
+    
+    /// Last node (producer side)
+    std::atomic<Node*> tail;
+public:
+    MpscQueue() :
+        head(new Node),
+        tail(head)
+    {}
+    
+    /// Queues cannot be copied or copy-assigned
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+    
+    ~MpscQueue() {
+        while(head != nullptr) {
+            Node* next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+    
+    /// Add a value to the back. Any thread
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        
+        // Claim the tail, then link the previous one to the new node. Release
+        // so the consumer sees its value
+        Node* previous = tail.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+    
+    /// Take the value at the front. Returns false if the queue is empty.
+    /// Consumer only
+    bool pop(T& value) {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if(next == nullptr)
+            return false;
+        
+        // next becomes the new empty head node
+        value = std::move(next->value);
+        delete head;
+        head = next;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "ObjectDelta.hpp"
+#include <stdexcept>
+
+/// Check if two textures look the same
+static bool sameTexture(const Texture& a, const Texture& b) {
+    const auto& planeA = a.get_plane();
+    const auto& planeB = b.get_plane();
+    if(planeA.size() != planeB.size())
+        return false;
+    
+    for(size_t r = 0; r < planeA.size(); r++) {
+        if(planeA[r].size() != planeB[r].size())
+            return false;
+        
+        for(size_t c = 0; c < planeA[r].size(); c++) {
+            const TexturePoint& pointA = planeA[r][c];
+            const TexturePoint& pointB = planeB[r][c];
+            if(pointA.character != pointB.character ||
+               pointA.formating.text_color != pointB.formating.text_color ||
+               pointA.formating.background_color != pointB.formating.background_color)
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+/// Get the fields that differ between two copies of an object
+static uint8_t changedFields(const Object& a, const Object& b) {
+    uint8_t fields = 0;
+    if(a.get_char() != b.get_char())
+        fields |= objectFieldCharacter;
+    if(a.get_type() != b.get_type() || a.get_direction() != b.get_direction() || a.get_visibility() != b.get_visibility())
+        fields |= objectFieldFlags;
+    if(a.get_position() != b.get_position())
+        fields |= objectFieldPosition;
+    
+    Formating formattingA = a.get_formating();
+    Formating formattingB = b.get_formating();
+    if(formattingA.text_color != formattingB.text_color || formattingA.background_color != formattingB.background_color)
+        fields |= objectFieldFormatting;
+    
+    if(!sameTexture(a.get_texture(), b.get_texture()))
+        fields |= objectFieldTexture;
+    return fields;
+}
+
+/// Copy the given fields of an update on top of an object
+static Object applyFields(const Object& base, const ObjectUpdate& update) {
+    const Object& source = update.object;
+    const Object& flagsFrom = update.fields & objectFieldFlags ? source : base;
+    auto position = (update.fields & objectFieldPosition ? source : base).get_position();
+    
+    Object object(
+        (update.fields & objectFieldCharacter ? source : base).get_char(),
+        flagsFrom.get_direction(),
+        flagsFrom.get_visibility(),
+        std::pair<int, int>(position.first, position.second),
+        (update.fields & objectFieldFormatting ? source : base).get_formating(),
+        (update.fields & objectFieldTexture ? source : base).get_texture(),
+        flagsFrom.get_type()
+    );
+    object.set_id(update.id);
+    return object;
+}
+
+ObjectBaseline makeBaseline(const std::vector<std::shared_ptr<Object> >& objects) {
+    ObjectBaseline baseline;
+    for(const auto& object : objects) {
+        if(object->get_id() != 0)
+            baseline.emplace(object->get_id(), *object);
+    }
+    
+    return baseline;
+}
+
+ObjectDelta diffBaselines(const ObjectBaseline& base, uint64_t baseSequence, const ObjectBaseline& current, uint64_t sequence) {
+    ObjectDelta delta;
+    delta.baseSequence = baseSequence;
+    delta.sequence = sequence;
+    
+    // Both baselines are sorted by id, so walk them together
+    auto baseIt = base.begin();
+    auto currentIt = current.begin();
+    while(baseIt != base.end() || currentIt != current.end()) {
+        if(currentIt == current.end() || (baseIt != base.end() && baseIt->first < currentIt->first)) {
+            delta.despawned.push_back(baseIt->first);
+            baseIt++;
+        }
+        else if(baseIt == base.end() || currentIt->first < baseIt->first) {
+            delta.updates.push_back(ObjectUpdate{currentIt->first, objectFieldAll, currentIt->second});
+            currentIt++;
+        }
+        else {
+            uint8_t fields = changedFields(baseIt->second, currentIt->second);
+            if(fields != 0)
+                delta.updates.push_back(ObjectUpdate{currentIt->first, fields, currentIt->second});
+            baseIt++;
+            currentIt++;
+        }
+    }
+    
+    return delta;
+}
+
+ObjectHistory::ObjectHistory(size_t maxBaselines) :
+    maxBaselines(maxBaselines)
+{}
+
+void ObjectHistory::record(const std::vector<std::shared_ptr<Object> >& objects, uint64_t sequence) {
+    baselines.emplace_back(sequence, makeBaseline(objects));
+    while(baselines.size() > maxBaselines)
+        baselines.pop_front();
+}
+
+ObjectDelta ObjectHistory::deltaFrom(uint64_t baseSequence) const {
+    if(baselines.empty())
+        throw std::out_of_range("ObjectHistory::deltaFrom: Nothing was recorded");
+    
+    static const ObjectBaseline empty;
+    const auto& newest = baselines.back();
+    for(auto it = baselines.begin(); baseSequence != 0 && it != baselines.end(); it++) {
+        if(it->first == baseSequence)
+            return diffBaselines(it->second, baseSequence, newest.second, newest.first);
+    }
+    
+    return diffBaselines(empty, 0, newest.second, newest.first);
+}
+
+ObjectMirror::ObjectMirror(size_t maxBaselines) :
+    maxBaselines(maxBaselines)
+{}
+
+ObjectDeltaResult ObjectMirror::apply(const ObjectDelta& delta) {
+    if(!baselines.empty() && delta.sequence <= baselines.back().first)
+        return ObjectDeltaResult::Stale;
+    
+    // Find the baseline the delta is based on
+    static const ObjectBaseline empty;
+    const ObjectBaseline* base = delta.baseSequence == 0 ? &empty : nullptr;
+    for(auto it = baselines.begin(); base == nullptr && it != baselines.end(); it++) {
+        if(it->first == delta.baseSequence)
+            base = &it->second;
+    }
+    
+    if(base == nullptr)
+        return ObjectDeltaResult::MissingBaseline;
+    
+    // Copy the baseline, then apply the changes
+    ObjectBaseline baseline(*base);
+    for(auto it = delta.despawned.begin(); it != delta.despawned.end(); it++)
+        baseline.erase(*it);
+    
+    for(auto it = delta.updates.begin(); it != delta.updates.end(); it++) {
+        auto existing = baseline.find(it->id);
+        if(existing == baseline.end()) {
+            // Spawned objects must carry every field
+            if(it->fields != objectFieldAll)
+                return ObjectDeltaResult::MissingBaseline;
+            
+            baseline.emplace(it->id, applyFields(it->object, *it));
+        }
+        else
+            existing->second = applyFields(existing->second, *it);
+    }
+    
+    baselines.emplace_back(delta.sequence, std::move(baseline));
+    while(baselines.size() > maxBaselines)
+        baselines.pop_front();
+    
+    return ObjectDeltaResult::Applied;
+}
+
+std::vector<std::shared_ptr<Object> > ObjectMirror::getObjects() const {
+    std::vector<std::shared_ptr<Object> > objects;
+    if(baselines.empty())
+        return objects;
+    
+    const ObjectBaseline& newest = baselines.back().second;
+    objects.reserve(newest.size());
+    for(auto it = newest.begin(); it != newest.end(); it++)
+        objects.emplace_back(new Object(it->second));
+    
+    return objects;
+}
+
+void ObjectMirror::clear() {
+    baselines.clear();
+}
@@ -0,0 +1,116 @@
+#ifndef ROGUELIKE_OBJECT_DELTA_HPP_INCLUDED
+#define ROGUELIKE_OBJECT_DELTA_HPP_INCLUDED
+#include "../server/Object.h"
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+/// Fields of an object that a delta can carry, as bits of
+/// ObjectUpdate::fields
+const uint8_t objectFieldCharacter = 1 << 0;
+const uint8_t objectFieldFlags = 1 << 1; // Type, direction and visibility
+const uint8_t objectFieldPosition = 1 << 2;
+const uint8_t objectFieldFormatting = 1 << 3;
+const uint8_t objectFieldTexture = 1 << 4;
+const uint8_t objectFieldAll = 0b00011111;
+
+/// Objects of a level at some point, by id. Copies, so later changes to the
+/// level don't show up in them
+typedef std::map<uint64_t, Object> ObjectBaseline;
+
+/// Copy the objects of a level to a baseline. Objects must have an id (see
+/// Object::set_id); objects with id 0 are left out
+ObjectBaseline makeBaseline(const std::vector<std::shared_ptr<Object> >& objects);
+
+/// A spawned object, or the fields of an object that changed
+struct ObjectUpdate {
+    /// Id of the object
+    uint64_t id;
+    
+    /// Fields carried by this update. Spawned objects carry all of them
+    uint8_t fields;
+    
+    /// The object, of which only the fields above are meaningful
+    Object object;
+};
+
+/// Changes from one baseline of a level to a later one. A base sequence of 0
+/// means the empty baseline, so the delta holds the whole level
+struct ObjectDelta {
+    /// Sequence of the baseline this delta applies to, and of the baseline it
+    /// makes
+    uint64_t baseSequence = 0;
+    uint64_t sequence = 0;
+    
+    /// Ids of objects that are gone
+    std::vector<uint64_t> despawned;
+    
+    /// Spawned and changed objects
+    std::vector<ObjectUpdate> updates;
+};
+
+/// Get the delta from one baseline to another. Objects in both get only the
+/// fields that changed; unchanged ones are left out
+ObjectDelta diffBaselines(const ObjectBaseline& base, uint64_t baseSequence, const ObjectBaseline& current, uint64_t sequence);
+
+/// The last few baselines of a level, as sent by the server. Players confirm
+/// the sequence of the last baseline they got, and get deltas against it
+class ObjectHistory {
+    /// Baselines, oldest first, with their sequences
+    std::deque<std::pair<uint64_t, ObjectBaseline> > baselines;
+    
+    /// Baselines kept
+    size_t maxBaselines;
+public:
+    /// Create a history keeping the last maxBaselines baselines
+    ObjectHistory(size_t maxBaselines = 32);
+    
+    /// Record the current objects of the level as a new baseline. Sequences
+    /// must grow with every call. Drops the oldest baseline if there are too
+    /// many
+    void record(const std::vector<std::shared_ptr<Object> >& objects, uint64_t sequence);
+    
+    /// Get the delta from a baseline to the newest one. If the baseline is
+    /// unknown (too old, or from another level), the delta is from the empty
+    /// baseline, so it holds every object. Throws std::out_of_range if
+    /// nothing was recorded
+    ObjectDelta deltaFrom(uint64_t baseSequence) const;
+};
+
+/// What ObjectMirror::apply did with a delta
+enum class ObjectDeltaResult {
+    /// The delta was applied and should be confirmed to the server
+    Applied,
+    /// The delta is older than the newest baseline, and was ignored
+    Stale,
+    /// The delta's baseline isn't known. The server should be told, so it
+    /// sends the whole level instead
+    MissingBaseline
+};
+
+/// A client's copy of the objects of its level, built from deltas. Keeps the
+/// last few baselines, so deltas against any of them can be applied
+class ObjectMirror {
+    /// Baselines, oldest first, with their sequences
+    std::deque<std::pair<uint64_t, ObjectBaseline> > baselines;
+    
+    /// Baselines kept
+    size_t maxBaselines;
+public:
+    /// Create a mirror keeping the last maxBaselines baselines. Should be at
+    /// least as many as the server's ObjectHistory keeps
+    ObjectMirror(size_t maxBaselines = 32);
+    
+    /// Apply a delta, making a new baseline from the one it is based on
+    ObjectDeltaResult apply(const ObjectDelta& delta);
+    
+    /// Gets the objects of the newest baseline. Empty if nothing was applied
+    std::vector<std::shared_ptr<Object> > getObjects() const;
+    
+    /// Forget every baseline, e.g. after a reconnection
+    void clear();
+};
+
+#endif
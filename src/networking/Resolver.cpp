@@ -0,0 +1,90 @@
+#include "Resolver.hpp"
+#include <thread>
+
+Resolver::Resolver(Backend backend, std::chrono::milliseconds ttl, std::chrono::milliseconds timeout) :
+    state(new State),
+    backend(backend),
+    ttl(ttl),
+    timeout(timeout)
+{}
+
+Resolver::Result Resolver::resolveAsync(const std::string& host) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lockGuard(state->lock);
+    
+    // Use the cached result, or join the lookup in flight, unless it expired
+    // or got stuck
+    auto it = state->entries.find(host);
+    if(it != state->entries.end()) {
+        Entry& entry = it->second;
+        bool inFlight = entry.expires == std::chrono::steady_clock::time_point::max();
+        if(inFlight ? now - entry.started < timeout : now < entry.expires)
+            return entry.result;
+    }
+    
+    // Start a new lookup in a worker thread
+    std::shared_ptr<std::promise<std::vector<IN_ADDR> > > promise(new std::promise<std::vector<IN_ADDR> >);
+    Entry& entry = state->entries[host];
+    entry.result = promise->get_future().share();
+    entry.started = now;
+    entry.expires = std::chrono::steady_clock::time_point::max();
+    entry.id = state->nextId++;
+    
+    // The worker only holds the shared state, so it is detached; a lookup that
+    // never returns doesn't keep anyone waiting
+    std::shared_ptr<State> workerState = state;
+    Backend workerBackend = backend;
+    std::chrono::milliseconds workerTtl = ttl;
+    uint64_t id = entry.id;
+    std::thread([workerState, workerBackend, workerTtl, host, id, promise] {
+        std::vector<IN_ADDR> addresses;
+        std::exception_ptr error;
+        try {
+            addresses = workerBackend(host);
+        }
+        catch(...) {
+            error = std::current_exception();
+        }
+        
+        // Keep successful results until they expire, and forget failures so
+        // the next request tries again. Done before completing the future, so
+        // waiters retrying straight away don't get the same failure
+        {
+            std::lock_guard<std::mutex> lockGuard(workerState->lock);
+            auto it = workerState->entries.find(host);
+            if(it != workerState->entries.end() && it->second.id == id) {
+                if(error)
+                    workerState->entries.erase(it);
+                else
+                    it->second.expires = std::chrono::steady_clock::now() + workerTtl;
+            }
+        }
+        
+        if(error)
+            promise->set_exception(error);
+        else
+            promise->set_value(std::move(addresses));
+    }).detach();
+    
+    return entry.result;
+}
+
+std::vector<IN_ADDR> Resolver::resolve(const std::string& host, int timeoutMs) {
+    Result result = resolveAsync(host);
+    
+    std::chrono::milliseconds waitTime = timeoutMs < 0 ? timeout : std::chrono::milliseconds(timeoutMs);
+    if(result.wait_for(waitTime) != std::future_status::ready)
+        throw SocketException("Resolver::resolve: Timed out resolving " + host);
+    
+    return result.get();
+}
+
+void Resolver::clear() {
+    std::lock_guard<std::mutex> lockGuard(state->lock);
+    state->entries.clear();
+}
+
+Resolver& Resolver::global() {
+    static Resolver resolver;
+    return resolver;
+}
@@ -0,0 +1,75 @@
+#ifndef ROGUELIKE_RESOLVER_HPP_INCLUDED
+#define ROGUELIKE_RESOLVER_HPP_INCLUDED
+#include "Socket.hpp"
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// Resolves hosts to addresses without blocking the caller, caching results.
+/// Each lookup runs in its own worker thread and completes a shared future,
+/// so a lookup that never returns (e.g. getaddrinfo with internet access down)
+/// only costs a thread, never the caller. Concurrent lookups for the same host
+/// share one worker. Successful results are cached for a TTL; failures are not
+/// cached
+class Resolver {
+public:
+    /// Result of a lookup. Throws the lookup's exception (usually a
+    /// SocketException) on get if it failed
+    typedef std::shared_future<std::vector<IN_ADDR> > Result;
+    
+    /// Function doing the actual (blocking) lookup. Socket::resolve by
+    /// default. Replace it with a fake one to resolve without a network
+    typedef std::function<std::vector<IN_ADDR>(const std::string& host)> Backend;
+private:
+    /// A cached or in-flight lookup
+    struct Entry {
+        /// The lookup's result
+        Result result;
+        
+        /// When the lookup started and when its result expires. Expiry is the
+        /// maximum time point while the lookup is in flight
+        std::chrono::steady_clock::time_point started, expires;
+        
+        /// Identifies the lookup, so a late worker doesn't touch an entry that
+        /// was replaced by a newer lookup
+        uint64_t id;
+    };
+    
+    /// State shared with worker threads. Workers keep it alive, so they can
+    /// outlive the resolver
+    struct State {
+        std::mutex lock;
+        std::unordered_map<std::string, Entry> entries;
+        uint64_t nextId = 0;
+    };
+    
+    std::shared_ptr<State> state;
+    Backend backend;
+    std::chrono::milliseconds ttl, timeout;
+public:
+    /// Create resolver with a backend, a TTL for cached results and a timeout.
+    /// Lookups in flight for longer than the timeout are abandoned and
+    /// restarted by the next request for that host
+    Resolver(Backend backend = Socket::resolve, std::chrono::milliseconds ttl = std::chrono::seconds(60), std::chrono::milliseconds timeout = std::chrono::seconds(5));
+    
+    /// Start resolving a host, or get the cached or in-flight lookup for it.
+    /// Never blocks on the lookup itself
+    Result resolveAsync(const std::string& host);
+    
+    /// Resolve a host, waiting up to timeoutMs milliseconds, or the resolver's
+    /// timeout if negative. Throws SocketException if the lookup failed or
+    /// timed out; the lookup carries on in the background
+    std::vector<IN_ADDR> resolve(const std::string& host, int timeoutMs = -1);
+    
+    /// Forget all cached results. Lookups in flight still complete their
+    /// futures
+    void clear();
+    
+    /// Resolver used by Client by default
+    static Resolver& global();
+};
+
+#endif
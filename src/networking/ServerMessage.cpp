@@ -1,74 +1,116 @@
 #include "ServerMessage.hpp"
+#include <stdexcept>
 
 std::unique_ptr<ClientMessage> ServerMessage::toClient() {
     return nullptr;
 }
 
-std::unique_ptr<ServerMessage> ServerMessage::fromBuffer(Buffer& buffer, std::shared_ptr<Player> sender) {
-    // Abort if header not received yet (type and data size)
-    if(buffer.size() < 10)
+std::unique_ptr<ServerMessage> ServerMessage::fromBuffer(Buffer& buffer, std::shared_ptr<Player> sender, WireFormat format) {
+    // Abort if header not received yet (type and data size). Header fields
+    // are parsed in place
+    MessageHeader header;
+    if(!peekHeader(buffer, format, header))
         return nullptr;
     
-    // Parse data size field
-    uint64_t dataSize;
-    buffer.get(dataSize, 2);
+    uint16_t type = header.type;
+    uint64_t dataSize = header.bodySize;
     
     // Abort if body (data) not received
-    if(buffer.size() < dataSize + 10)
+    if(buffer.size() - header.size < dataSize)
         return nullptr;
     
-    // Parse type field
-    uint16_t type;
-    buffer.get(type);
-    
-    // Clear header from buffer, full message received
-    buffer.erase(10);
-    
-    // Create ServerMessage
+    // Create ServerMessage from body. Invalid bodies result in nullptr
+    std::unique_ptr<ServerMessage> message = nullptr;
+    BufferCursor body(buffer.peek(dataSize, header.size));
     switch(type) {
         case static_cast<int>(GameMessageType::DoJoin):
             {
                 // Body is a player name for Join messages
                 std::string name;
-                buffer.pop(name, dataSize);
-                return std::unique_ptr<ServerMessage>(new ServerMessageDoJoin(sender, name));
+                body.read(name, dataSize);
+                message = std::unique_ptr<ServerMessage>(new ServerMessageDoJoin(sender, name));
             }
             break;
         case static_cast<int>(GameMessageType::DoQuit):
+            // Body should be empty for DoQuit messages. It is ignored if not
+            message = std::unique_ptr<ServerMessage>(new ServerMessageDoQuit(sender));
+            break;
+        case static_cast<int>(GameMessageType::DoChat):
+            {
+                // Body is a message name for DoChat messages
+                std::string chatMessage;
+                body.read(chatMessage, dataSize);
+                message = std::unique_ptr<ServerMessage>(new ServerMessageDoChat(sender, chatMessage));
+            }
+            break;
+        case static_cast<int>(GameMessageType::DoSnapshotChannel):
+            // Body should be empty for DoSnapshotChannel messages. It is
+            // ignored if not
+            message = std::unique_ptr<ServerMessage>(new ServerMessageDoSnapshotChannel(sender));
+            break;
+        case static_cast<int>(GameMessageType::DoPing):
+        case static_cast<int>(GameMessageType::DoPong):
             {
-                // Body should be empty for DoQuit messages. Clear it if not
-                if(dataSize > 0)
-                    buffer.erase(dataSize);
+                // Body is a timestamp
+                if(dataSize != 8)
+                    break;
                 
-                return std::unique_ptr<ServerMessage>(new ServerMessageDoQuit(sender));
+                uint64_t timestamp;
+                body.read(timestamp);
+                if(type == static_cast<int>(GameMessageType::DoPing))
+                    message = std::unique_ptr<ServerMessage>(new ServerMessageDoPing(sender, timestamp));
+                else
+                    message = std::unique_ptr<ServerMessage>(new ServerMessageDoPong(sender, timestamp));
             }
             break;
-        case static_cast<int>(GameMessageType::DoChat):
+        case static_cast<int>(GameMessageType::DoObjectAck):
             {
-                // Body is a message name for DoChat messages
-                std::string message;
-                buffer.pop(message, dataSize);
-                return std::unique_ptr<ServerMessage>(new ServerMessageDoChat(sender, message));
+                // Body is a baseline sequence
+                if(dataSize != 8)
+                    break;
+                
+                uint64_t sequence;
+                body.read(sequence);
+                message = std::unique_ptr<ServerMessage>(new ServerMessageDoObjectAck(sender, sequence));
             }
             break;
         case static_cast<int>(GameMessageType::DoAction):
             {
                 // Body is an action
-                std::vector<uint8_t> body;
-                buffer.pop(body, dataSize);
+                std::vector<uint8_t> actionBytes;
+                body.read(actionBytes, dataSize);
                 try {
-                    return std::unique_ptr<ServerMessage>(new ServerMessageDoAction(sender, Action::fromBytes(body)));
-                }
-                catch(std::invalid_argument e) {
-                    return nullptr; // Will throw on invalid body
+                    message = std::unique_ptr<ServerMessage>(new ServerMessageDoAction(sender, Action::fromBytes(actionBytes)));
                 }
+                catch(std::invalid_argument e) {} // Will throw on invalid body
             }
             break;
     }
     
-    // Unknown message type or non-action message, clear body
-    buffer.erase(dataSize);
-    return nullptr;
+    // Full message received and parsed (or unknown message type or
+    // non-action message), clear it from the buffer
+    buffer.erase(header.size + dataSize);
+    return message;
+}
+
+std::unique_ptr<ServerMessage> ServerMessage::fromClient(const ClientMessage& message, std::shared_ptr<Player> sender) {
+    switch(message.type) {
+        case GameMessageType::DoJoin:
+            // The player name is the sender name of DoJoin messages
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoJoin(sender, message.senderName));
+        case GameMessageType::DoQuit:
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoQuit(sender));
+        case GameMessageType::DoChat:
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoChat(sender, static_cast<const ClientMessageDoChat&>(message).message));
+        case GameMessageType::DoAction:
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoAction(sender, static_cast<const ClientMessageDoAction&>(message).action));
+        case GameMessageType::DoSnapshotChannel:
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoSnapshotChannel(sender));
+        case GameMessageType::DoObjectAck:
+            return std::unique_ptr<ServerMessage>(new ServerMessageDoObjectAck(sender, static_cast<const ClientMessageDoObjectAck&>(message).sequence));
+        default:
+            return nullptr;
+    }
 }
 
 std::unique_ptr<ClientMessage> ServerMessageDoJoin::toClient() {
@@ -12,7 +12,7 @@ protected:
         type(type),
         sender(sender)
     {}
-    
+
 public:
     /// Virtual destructor. Must be implemented if base classes do memory
     /// management
@@ -31,8 +31,14 @@ public:
     /// Create a game message from a buffer. If there is enough data for a full
     /// message, buffer is (partially) popped and a new ServerMessage is
     /// returned, else, nullptr is returned and buffer is not popped. This is
-    /// a factory
-    static std::unique_ptr<ServerMessage> fromBuffer(Buffer& buffer, std::shared_ptr<Player> sender);
+    /// a factory. Throws std::invalid_argument if the message header is
+    /// malformed, as the rest of the buffer can't be framed anymore
+    static std::unique_ptr<ServerMessage> fromBuffer(Buffer& buffer, std::shared_ptr<Player> sender, WireFormat format = WireFormat::Fixed);
+    
+    /// Create a game message from a message built by a client, without
+    /// serialising it (see LocalChannel). Returns nullptr if the message isn't
+    /// one a client sends to a server. This is a factory
+    static std::unique_ptr<ServerMessage> fromClient(const ClientMessage& message, std::shared_ptr<Player> sender);
 };
 
 struct ServerMessageDoJoin : public ServerMessage {
@@ -84,4 +90,55 @@ struct ServerMessageDoAction : public ServerMessage {
     ~ServerMessageDoAction() = default;
 };
 
+struct ServerMessageDoSnapshotChannel : public ServerMessage {
+    /// Sent by the client if the client wants snapshots over UDP. Handled by
+    /// Server itself
+    ServerMessageDoSnapshotChannel(std::shared_ptr<Player> sender) :
+        ServerMessage(GameMessageType::DoSnapshotChannel, sender)
+    {};
+    
+    ~ServerMessageDoSnapshotChannel() = default;
+};
+
+struct ServerMessageDoPing : public ServerMessage {
+    /// When the ping was sent, in the client's monotonic clock
+    const uint64_t timestamp;
+    
+    /// Sent by the client every so often. Answered by Server itself with a
+    /// Pong
+    ServerMessageDoPing(std::shared_ptr<Player> sender, uint64_t timestamp) :
+        ServerMessage(GameMessageType::DoPing, sender),
+        timestamp(timestamp)
+    {};
+    
+    ~ServerMessageDoPing() = default;
+};
+
+struct ServerMessageDoPong : public ServerMessage {
+    /// Timestamp of the Ping this answers, in the server's monotonic clock
+    const uint64_t timestamp;
+    
+    /// Sent by the client to answer a Ping. Handled by Server itself
+    ServerMessageDoPong(std::shared_ptr<Player> sender, uint64_t timestamp) :
+        ServerMessage(GameMessageType::DoPong, sender),
+        timestamp(timestamp)
+    {};
+    
+    ~ServerMessageDoPong() = default;
+};
+
+struct ServerMessageDoObjectAck : public ServerMessage {
+    /// Sequence of the object baseline the client has, or 0 if it needs the
+    /// whole level
+    const uint64_t sequence;
+    
+    /// Sent by the client after applying an ObjectDelta
+    ServerMessageDoObjectAck(std::shared_ptr<Player> sender, uint64_t sequence) :
+        ServerMessage(GameMessageType::DoObjectAck, sender),
+        sequence(sequence)
+    {};
+    
+    ~ServerMessageDoObjectAck() = default;
+};
+
 #endif
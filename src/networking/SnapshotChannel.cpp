@@ -0,0 +1,55 @@
+#include "SnapshotChannel.hpp"
+
+/// Create a datagram with a header and room for a payload
+static std::vector<uint8_t> datagramWithHeader(DatagramKind kind, uint32_t value, size_t payloadSize) {
+    std::vector<uint8_t> datagram;
+    datagram.reserve(datagramHeaderSize + payloadSize);
+    datagram.push_back(static_cast<uint8_t>(kind));
+    for(auto i = 0; i < 4; i++)
+        datagram.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    return datagram;
+}
+
+std::vector<uint8_t> helloDatagram(uint32_t token) {
+    return datagramWithHeader(DatagramKind::Hello, token, 0);
+}
+
+std::vector<uint8_t> snapshotDatagram(uint32_t sequence, const std::vector<uint8_t>& message) {
+    std::vector<uint8_t> datagram = datagramWithHeader(DatagramKind::Snapshot, sequence, message.size());
+    datagram.insert(datagram.end(), message.begin(), message.end());
+    return datagram;
+}
+
+bool popDatagramHeader(Buffer& datagram, DatagramHeader& header) {
+    if(datagram.size() < datagramHeaderSize)
+        return false;
+    
+    uint8_t kind;
+    datagram.get(kind);
+    if(kind > static_cast<uint8_t>(DatagramKind::Snapshot))
+        return false;
+    
+    header.kind = static_cast<DatagramKind>(kind);
+    datagram.get(header.value, 1);
+    datagram.erase(datagramHeaderSize);
+    return true;
+}
+
+bool SnapshotFilter::accept(GameMessageType type, uint32_t sequence) {
+    auto it = newest.find(static_cast<uint16_t>(type));
+    if(it == newest.end()) {
+        newest[static_cast<uint16_t>(type)] = sequence;
+        return true;
+    }
+    
+    // Newer if ahead by less than half the sequence space
+    if(static_cast<int32_t>(sequence - it->second) <= 0)
+        return false;
+    
+    it->second = sequence;
+    return true;
+}
+
+void SnapshotFilter::clear() {
+    newest.clear();
+}
@@ -0,0 +1,93 @@
+#ifndef ROGUELIKE_SNAPSHOT_CHANNEL_HPP_INCLUDED
+#define ROGUELIKE_SNAPSHOT_CHANNEL_HPP_INCLUDED
+#include "Buffer.hpp"
+#include "GameMessageType.hpp"
+#include "SocketPlatform.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#ifdef ROGUELIKE_UNIX
+    #include <arpa/inet.h> // in_addr
+#else
+    #include <winsock2.h>
+#endif
+
+// The snapshot channel is an optional UDP side channel for state that is
+// obsolete one turn later (object and player data). It is negotiated over TCP:
+// the client sends a DoSnapshotChannel message and the server answers with a
+// SnapshotChannel message holding a token. The client then sends hello
+// datagrams with that token to the server's UDP port (the same as its TCP
+// port) until the server echoes one back. From then on, the server sends
+// snapshots as datagrams, each with a sequence number, and the client drops
+// any snapshot older than the newest of the same message type. Lost
+// snapshots are not resent; the next turn replaces them anyway.
+//
+// Every datagram starts with a 1-byte kind and a 4-byte little endian value:
+// the token for hellos, or the sequence number for snapshots, which are
+// followed by a full message in the connection's wire format
+
+/// Kind of a snapshot channel datagram
+enum class DatagramKind : uint8_t {
+    Hello = 0,
+    Snapshot = 1
+};
+
+/// A snapshot channel datagram header
+struct DatagramHeader {
+    DatagramKind kind;
+    
+    /// Token for hellos, sequence number for snapshots
+    uint32_t value;
+};
+
+/// Size of a datagram header, in bytes
+const size_t datagramHeaderSize = 5;
+
+/// Biggest message that is sent as a snapshot. Bigger ones go over TCP. With
+/// the header and the IP and UDP headers, it fits in the MTU of almost any
+/// path, so snapshots are never split into IP fragments; losing any fragment
+/// would lose the whole snapshot, and some NATs and firewalls drop them all
+const size_t maxSnapshotSize = 1200 - datagramHeaderSize;
+
+/// Create a hello datagram
+std::vector<uint8_t> helloDatagram(uint32_t token);
+
+/// Create a snapshot datagram from a message in bytes (see
+/// ClientMessage::toBytes)
+std::vector<uint8_t> snapshotDatagram(uint32_t sequence, const std::vector<uint8_t>& message);
+
+/// Pop the header of a datagram from a buffer holding the whole datagram.
+/// Returns false if the datagram is too short or of an unknown kind
+bool popDatagramHeader(Buffer& datagram, DatagramHeader& header);
+
+/// A player's end of the snapshot channel, as seen by the server
+struct SnapshotEndpoint {
+    /// Token given to the player. 0 if they didn't ask for a channel
+    uint32_t token = 0;
+    
+    /// Whether a hello arrived, so address and port are known
+    bool connected = false;
+    
+    /// Address and port hellos came from
+    IN_ADDR address;
+    uint16_t port = 0;
+    
+    /// Sequence number of the last snapshot sent
+    uint32_t sequence = 0;
+};
+
+/// Keeps the newest sequence number of each message type, so that snapshots
+/// arriving late or twice are dropped
+class SnapshotFilter {
+    std::unordered_map<uint16_t, uint32_t> newest;
+public:
+    /// Check if a snapshot of a message type should be used, and remember its
+    /// sequence number if so. Sequence numbers are compared with wrap-around
+    bool accept(GameMessageType type, uint32_t sequence);
+    
+    /// Forget all sequence numbers
+    void clear();
+};
+
+#endif
@@ -7,8 +7,69 @@
     #include <netdb.h> // getaddrinfo
     #include <fcntl.h> // fcntl, F_SETFL, O_NONBLOCK
     #include <signal.h> // signal, SIGPIPE, SIG_IGN
+    #include <sys/uio.h> // readv, writev, iovec
+    #include <errno.h> // ECONNABORTED
+    #include <netinet/tcp.h> // TCP_NODELAY, TCP_QUICKACK
 #endif
 
+#include <algorithm>
+
+// Out-of-class definitions, as std::min and std::max bind these by reference
+const size_t Socket::minReadSize;
+const size_t Socket::maxReadSize;
+const size_t Socket::maxDatagramSize;
+const size_t Socket::maxWriteSegments;
+
+/// Get the level and name of a socket option for setsockopt and getsockopt.
+/// Returns false if the option isn't supported on this platform
+static bool getNativeOption(SocketOption option, int& level, int& name) {
+    switch(option) {
+        case SocketOption::NoDelay:
+            level = IPPROTO_TCP;
+            name = TCP_NODELAY;
+            return true;
+        #ifdef __linux__
+        case SocketOption::QuickAck:
+            level = IPPROTO_TCP;
+            name = TCP_QUICKACK;
+            return true;
+        #endif
+        case SocketOption::SendBufferSize:
+            level = SOL_SOCKET;
+            name = SO_SNDBUF;
+            return true;
+        case SocketOption::ReceiveBufferSize:
+            level = SOL_SOCKET;
+            name = SO_RCVBUF;
+            return true;
+        #ifdef SO_BUSY_POLL
+        case SocketOption::BusyPoll:
+            level = SOL_SOCKET;
+            name = SO_BUSY_POLL;
+            return true;
+        #endif
+        default:
+            return false;
+    }
+}
+
+SocketProfile SocketProfile::lowLatency() {
+    SocketProfile profile;
+    profile.noDelay = SocketToggle::On;
+    profile.quickAck = SocketToggle::On;
+    profile.busyPollUs = 50;
+    return profile;
+}
+
+SocketProfile SocketProfile::bulk() {
+    SocketProfile profile;
+    profile.noDelay = SocketToggle::Off;
+    profile.quickAck = SocketToggle::Off;
+    profile.sendBufferSize = 1024 * 1024;
+    profile.receiveBufferSize = 1024 * 1024;
+    return profile;
+}
+
 void Socket::initSocketApi() {
     #ifndef ROGUELIKE_UNIX
     WSADATA wsaData;
@@ -20,7 +81,7 @@ void Socket::initSocketApi() {
     signal(SIGPIPE, SIG_IGN);
     #endif
 }
-    
+
 void Socket::cleanupSocketApi() {
     #ifndef ROGUELIKE_UNIX
     if(WSACleanup() == SOCKET_ERROR)
@@ -33,7 +94,14 @@ std::vector<IN_ADDR> Socket::resolve(std::string host) {
     std::vector<IN_ADDR> addressesVec;
     PADDRINFOA resolvedAddresses;
     
-    int gaiErrno = getaddrinfo(host.c_str(), nullptr, nullptr, &resolvedAddresses);
+    // Only ask for IPv4 stream addresses. Without hints, IPv6 addresses
+    // (which don't fit in IN_ADDR) and one copy of each address per socket
+    // type are returned too
+    ADDRINFOA hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    int gaiErrno = getaddrinfo(host.c_str(), nullptr, &hints, &resolvedAddresses);
     if(gaiErrno != 0)
         throw SocketException::fromGaiErrno("Socket::resolve: ", gaiErrno);
     
@@ -65,9 +133,44 @@ Socket::Socket() {
     invalidate();
 }
 
+std::pair<std::unique_ptr<Socket>, std::unique_ptr<Socket> > Socket::createPair() {
+    std::unique_ptr<Socket> first, second;
+    
+    #ifdef ROGUELIKE_UNIX
+    int rawSocks[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM, 0, rawSocks) == SOCKET_ERROR)
+        throw SocketException::fromErrno("Socket::createPair: ");
+    first = std::unique_ptr<Socket>(new Socket(rawSocks[0]));
+    second = std::unique_ptr<Socket>(new Socket(rawSocks[1]));
+    #else
+    // No socketpair on Windows. Connect through a loopback listener on a port
+    // picked by the system
+    IN_ADDR loopback;
+    loopback.s_addr = htonl(INADDR_LOOPBACK);
+    Socket listener(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    listener.bind(AF_INET, loopback, 0);
+    listener.listen(1);
+    
+    sockaddr_in sockAddr;
+    int sockAddrSize = sizeof(sockAddr);
+    if(::getsockname(listener.rawSock, (sockaddr*)&sockAddr, &sockAddrSize) == SOCKET_ERROR)
+        throw SocketException::fromErrno("Socket::createPair: ");
+    
+    first = std::unique_ptr<Socket>(new Socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+    first->connect(AF_INET, loopback, ntohs(sockAddr.sin_port));
+    second = listener.accept();
+    #endif
+    
+    first->setBlocking(false);
+    second->setBlocking(false);
+    return std::make_pair(std::move(first), std::move(second));
+}
+
 Socket::Socket(Socket&& other) {
     // Take ownership of other's raw socket
     rawSock = other.rawSock;
+    readSize = other.readSize;
+    quickAck = other.quickAck;
     
     // Invalidate other socket
     other.invalidate();
@@ -84,6 +187,8 @@ Socket& Socket::operator=(Socket&& other) {
         
         // Take ownership of other's raw socket
         rawSock = other.rawSock;
+        readSize = other.readSize;
+        quickAck = other.quickAck;
         
         // Invalidate other socket
         other.invalidate();
@@ -140,6 +245,81 @@ bool Socket::read(std::vector<uint8_t>& output) {
     return true;
 }
 
+bool Socket::readInto(Buffer& buffer) {
+    if(!isValid())
+        throw SocketException("Socket::readInto: Socket has already been invalidated");
+    
+    // Stop after maxReadSize bytes, even if more are waiting, so one busy
+    // connection can't keep the caller from its other sockets, or from
+    // checking what was read. Level-triggered selectors report the rest on
+    // the next wait
+    size_t totalRead = 0;
+    while(true) {
+        // Receive straight into the buffer's free space
+        BufferSpace space = buffer.prepare(readSize);
+        
+        // Never offer more than what is left of this call's cap
+        size_t left = maxReadSize - totalRead;
+        if(space.firstSize >= left) {
+            space.firstSize = left;
+            space.secondSize = 0;
+        }
+        else
+            space.secondSize = std::min(space.secondSize, left - space.firstSize);
+        
+        #ifdef ROGUELIKE_UNIX
+        // Fill both parts of the free space with a single call
+        iovec parts[2] = {
+            {space.first, space.firstSize},
+            {space.second, space.secondSize}
+        };
+        size_t offered = space.size();
+        ssize_t bytesRead = ::readv(rawSock, parts, space.secondSize > 0 ? 2 : 1);
+        #else
+        size_t offered = space.firstSize;
+        int bytesRead = ::recv(rawSock, reinterpret_cast<char*>(space.first), static_cast<int>(offered), 0);
+        #endif
+        
+        if(bytesRead == SOCKET_ERROR) {
+            buffer.commit(0);
+            
+            // If non-blocking, one of these errors are set, but the socket is
+            // still open, so, return true
+            int lastError = SOCKET_LAST_ERROR;
+            if(lastError == SOCKET_EAGAIN || lastError == SOCKET_EWOULDBLOCK)
+                return true;
+            throw SocketException::fromErrno("Socket::readInto: ");
+        }
+        
+        // If there was a 0-byte read, then the connection was closed, return
+        // false
+        buffer.commit(bytesRead);
+        if(bytesRead == 0)
+            return false;
+        
+        // Adapt the read size. A read that filled all the space offered means
+        // more data is probably waiting, so grow and read again, unless the
+        // cap was reached...
+        totalRead += bytesRead;
+        if(static_cast<size_t>(bytesRead) == offered) {
+            readSize = std::min(readSize * 2, maxReadSize);
+            if(totalRead < maxReadSize)
+                continue;
+        }
+        else if(static_cast<size_t>(bytesRead) < readSize / 4) {
+            // ... otherwise, the socket was drained. Shrink if the read was
+            // small
+            readSize = std::max(readSize / 2, minReadSize);
+        }
+        
+        // The kernel turns quick ACKs off by itself; keep them on
+        if(quickAck)
+            setOption(SocketOption::QuickAck, 1);
+        
+        return true;
+    }
+}
+
 size_t Socket::write(const uint8_t* data, size_t dataSize) {
     if(!isValid())
         throw SocketException("Socket::write: Socket has already been invalidated");
@@ -181,6 +361,133 @@ size_t Socket::write(const std::vector<uint8_t>::iterator begin, size_t dataSize
     return write(&(*begin), dataSize);
 }
 
+size_t Socket::writeFrom(Buffer& buffer) {
+    size_t totalWritten = 0;
+    while(buffer.size() > 0) {
+        size_t size = buffer.size();
+        size_t bytesWritten = writev(buffer);
+        totalWritten += bytesWritten;
+        
+        // Stop once the kernel's send buffer is full
+        if(bytesWritten < size)
+            break;
+    }
+    
+    return totalWritten;
+}
+
+size_t Socket::writev(Buffer& buffer) {
+    // Both contiguous parts of the data, without merging them
+    BufferView view = buffer.peek(buffer.size());
+    SocketSegment segments[2] = {
+        {view.first, view.firstSize},
+        {view.second, view.secondSize}
+    };
+    
+    size_t bytesWritten = writev(segments, view.secondSize > 0 ? 2 : 1);
+    buffer.erase(bytesWritten);
+    return bytesWritten;
+}
+
+size_t Socket::writev(const SocketSegment* segments, size_t segmentCount) {
+    if(!isValid())
+        throw SocketException("Socket::writev: Socket has already been invalidated");
+    
+    segmentCount = std::min(segmentCount, maxWriteSegments);
+    
+    #ifdef ROGUELIKE_UNIX
+    iovec parts[maxWriteSegments];
+    size_t partCount = 0;
+    for(size_t i = 0; i < segmentCount; i++) {
+        if(segments[i].size == 0)
+            continue;
+        parts[partCount].iov_base = const_cast<uint8_t*>(segments[i].data);
+        parts[partCount].iov_len = segments[i].size;
+        partCount++;
+    }
+    
+    // Abort on empty write
+    if(partCount == 0)
+        return 0;
+    
+    #ifdef __linux__
+    // A broken connection is reported as an error instead of a signal
+    msghdr message = {};
+    message.msg_iov = parts;
+    message.msg_iovlen = partCount;
+    ssize_t bytesWritten = ::sendmsg(rawSock, &message, MSG_NOSIGNAL);
+    #else
+    ssize_t bytesWritten = ::writev(rawSock, parts, static_cast<int>(partCount));
+    #endif
+    if(bytesWritten == SOCKET_ERROR) {
+        int lastError = SOCKET_LAST_ERROR;
+        if(lastError == SOCKET_EAGAIN || lastError == SOCKET_EWOULDBLOCK)
+            return 0;
+        throw SocketException::fromErrno("Socket::writev: ");
+    }
+    
+    return bytesWritten;
+    #else
+    // One segment at a time, stopping once the socket is full
+    size_t totalWritten = 0;
+    for(size_t i = 0; i < segmentCount; i++) {
+        size_t bytesWritten = write(segments[i].data, segments[i].size);
+        totalWritten += bytesWritten;
+        if(bytesWritten < segments[i].size)
+            break;
+    }
+    
+    return totalWritten;
+    #endif
+}
+
+bool Socket::sendTo(const std::vector<uint8_t>& datagram, IN_ADDR address, uint16_t port) {
+    if(!isValid())
+        throw SocketException("Socket::sendTo: Socket has already been invalidated");
+    
+    sockaddr_in sockAddr = {};
+    sockAddr.sin_family = AF_INET;
+    sockAddr.sin_port = htons(port);
+    sockAddr.sin_addr = address;
+    
+    if(::sendto(rawSock, reinterpret_cast<const char*>(datagram.data()), datagram.size(), 0, (sockaddr*)&sockAddr, sizeof(sockAddr)) == SOCKET_ERROR) {
+        int lastError = SOCKET_LAST_ERROR;
+        if(lastError == SOCKET_EAGAIN || lastError == SOCKET_EWOULDBLOCK)
+            return false;
+        throw SocketException::fromErrno("Socket::sendTo: ");
+    }
+    
+    return true;
+}
+
+bool Socket::receiveFrom(std::vector<uint8_t>& output, IN_ADDR& address, uint16_t& port) {
+    if(!isValid())
+        throw SocketException("Socket::receiveFrom: Socket has already been invalidated");
+    
+    // Receive straight into output, then shrink it to the datagram's size
+    output.resize(maxDatagramSize);
+    sockaddr_in sockAddr = {};
+    socklen_t sockAddrSize = sizeof(sockAddr);
+    #ifdef ROGUELIKE_UNIX
+    ssize_t bytesRead = ::recvfrom(rawSock, output.data(), output.size(), 0, (sockaddr*)&sockAddr, &sockAddrSize);
+    #else
+    int bytesRead = ::recvfrom(rawSock, reinterpret_cast<char*>(output.data()), static_cast<int>(output.size()), 0, (sockaddr*)&sockAddr, &sockAddrSize);
+    #endif
+    
+    if(bytesRead == SOCKET_ERROR) {
+        output.clear();
+        int lastError = SOCKET_LAST_ERROR;
+        if(lastError == SOCKET_EAGAIN || lastError == SOCKET_EWOULDBLOCK)
+            return false;
+        throw SocketException::fromErrno("Socket::receiveFrom: ");
+    }
+    
+    output.resize(bytesRead);
+    address = sockAddr.sin_addr;
+    port = ntohs(sockAddr.sin_port);
+    return true;
+}
+
 void Socket::bind(SOCKET_ADDRESS_FAMILY addressFamily, IN_ADDR address, uint16_t port) {
     if(!isValid())
         throw SocketException("Socket::bind: Socket has already been invalidated");
@@ -210,20 +517,42 @@ void Socket::listen(int backlog) {
         throw SocketException::fromErrno("Socket::listen: ");
 }
 
-std::unique_ptr<Socket> Socket::accept() {
+std::unique_ptr<Socket> Socket::accept(bool nonBlocking) {
     if(!isValid())
         throw SocketException("Socket::accept: Socket has already been invalidated");
     
-    // Accept one incoming connection
-    SOCKET acceptedRawSock = ::accept(rawSock, nullptr, nullptr);
-    
-    if(acceptedRawSock == SOCKET_ERROR) {
-        if(SOCKET_LAST_ERROR == SOCKET_EAGAIN || SOCKET_LAST_ERROR == SOCKET_EWOULDBLOCK)
-            return nullptr;
-        throw SocketException::fromErrno("Socket::accept: ");
+    while(true) {
+        // Accept one incoming connection. On Linux, the new socket can be made
+        // non-blocking in the same call
+        #ifdef __linux__
+        SOCKET acceptedRawSock = ::accept4(rawSock, nullptr, nullptr, nonBlocking ? SOCK_NONBLOCK : 0);
+        #else
+        SOCKET acceptedRawSock = ::accept(rawSock, nullptr, nullptr);
+        #endif
+        
+        if(acceptedRawSock == SOCKET_ERROR) {
+            int lastError = SOCKET_LAST_ERROR;
+            if(lastError == SOCKET_EAGAIN || lastError == SOCKET_EWOULDBLOCK)
+                return nullptr;
+            
+            #ifdef ROGUELIKE_UNIX
+            // The connection was reset while pending. Try the next one
+            if(lastError == ECONNABORTED)
+                continue;
+            #endif
+            
+            throw SocketException::fromErrno("Socket::accept: ");
+        }
+        
+        std::unique_ptr<Socket> acceptedSocket(new Socket(acceptedRawSock));
+        
+        #ifndef __linux__
+        if(nonBlocking)
+            acceptedSocket->setBlocking(false);
+        #endif
+        
+        return acceptedSocket;
     }
-    
-    return std::unique_ptr<Socket>(new Socket(acceptedRawSock));
 }
 
 bool Socket::connect(SOCKET_ADDRESS_FAMILY addressFamily, IN_ADDR address, uint16_t port) {
@@ -307,6 +636,62 @@ void Socket::setBlocking(bool blocking) {
     #endif
 }
 
+bool Socket::setOption(SocketOption option, int value) {
+    if(!isValid())
+        throw SocketException("Socket::setOption: Socket has already been invalidated");
+    
+    int level, name;
+    if(!getNativeOption(option, level, name))
+        return false;
+    
+    if(::setsockopt(rawSock, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) == SOCKET_ERROR)
+        throw SocketException::fromErrno("Socket::setOption: ");
+    
+    if(option == SocketOption::QuickAck)
+        quickAck = value != 0;
+    
+    return true;
+}
+
+int Socket::getOption(SocketOption option) const {
+    if(!isValid())
+        throw SocketException("Socket::getOption: Socket has already been invalidated");
+    
+    int level, name;
+    if(!getNativeOption(option, level, name))
+        throw SocketException("Socket::getOption: Option not supported on this platform");
+    
+    int value = 0;
+    socklen_t valueSize = sizeof(value);
+    if(::getsockopt(rawSock, level, name, reinterpret_cast<char*>(&value), &valueSize) == SOCKET_ERROR)
+        throw SocketException::fromErrno("Socket::getOption: ");
+    
+    return value;
+}
+
+void Socket::applyProfile(const SocketProfile& profile) {
+    // Options left at default keep what the system set, e.g. Linux's quick
+    // ACK heuristics
+    if(profile.noDelay != SocketToggle::Default)
+        setOption(SocketOption::NoDelay, profile.noDelay == SocketToggle::On);
+    if(profile.quickAck != SocketToggle::Default)
+        setOption(SocketOption::QuickAck, profile.quickAck == SocketToggle::On);
+    
+    if(profile.sendBufferSize > 0)
+        setOption(SocketOption::SendBufferSize, profile.sendBufferSize);
+    if(profile.receiveBufferSize > 0)
+        setOption(SocketOption::ReceiveBufferSize, profile.receiveBufferSize);
+    
+    // Busy polling is a bonus. Unprivileged processes may not be allowed to
+    // raise it
+    if(profile.busyPollUs > 0) {
+        try {
+            setOption(SocketOption::BusyPoll, profile.busyPollUs);
+        }
+        catch(SocketException) {};
+    }
+}
+
 bool Socket::isValid() const {
     // Check if socket is valid
     #ifdef ROGUELIKE_UNIX
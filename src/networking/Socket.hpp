@@ -1,9 +1,11 @@
 #ifndef ROGUELIKE_SOCKET_HPP_INCLUDED
 #define ROGUELIKE_SOCKET_HPP_INCLUDED
 #include "SocketException.hpp"
+#include "Buffer.hpp"
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <utility>
 
 #ifdef ROGUELIKE_UNIX
     #include <sys/socket.h> // socket, bind, AF_INET
@@ -20,10 +22,77 @@ enum SocketShutdownMode {
     ShutReadWrite
 };
 
+/// A contiguous piece of data to write with Socket::writev
+struct SocketSegment {
+    const uint8_t* data;
+    size_t size;
+};
+
+/// Socket options that can be set with Socket::setOption
+enum class SocketOption {
+    /// TCP_NODELAY. If non-zero, small writes are sent straight away instead
+    /// of being merged while earlier data is unacknowledged (Nagle's algorithm)
+    NoDelay,
+    /// TCP_QUICKACK. If non-zero, received data is acknowledged straight away
+    /// instead of delaying ACKs. Linux only. The kernel can turn this off by
+    /// itself, so readInto sets it again after each read while it is enabled
+    QuickAck,
+    /// SO_SNDBUF. Kernel send buffer size, in bytes
+    SendBufferSize,
+    /// SO_RCVBUF. Kernel receive buffer size, in bytes
+    ReceiveBufferSize,
+    /// SO_BUSY_POLL. Microseconds to busy poll the network device for data on
+    /// blocking reads. Linux only. Raising it may need CAP_NET_ADMIN
+    BusyPoll
+};
+
+/// Whether a socket profile turns an on/off option on or off, or leaves it as
+/// the system set it
+enum class SocketToggle {
+    Default,
+    Off,
+    On
+};
+
+/// A set of socket options applied together to a connection (see
+/// Socket::applyProfile). A default constructed profile changes nothing
+struct SocketProfile {
+    /// See SocketOption::NoDelay
+    SocketToggle noDelay = SocketToggle::Default;
+    
+    /// See SocketOption::QuickAck
+    SocketToggle quickAck = SocketToggle::Default;
+    
+    /// Kernel send and receive buffer sizes, in bytes. 0 keeps the system
+    /// default
+    int sendBufferSize = 0;
+    int receiveBufferSize = 0;
+    
+    /// Busy poll time, in microseconds. 0 keeps it off. Ignored if it can't be
+    /// set
+    int busyPollUs = 0;
+    
+    /// Profile for small messages that need answers quickly, like actions and
+    /// their acks: no Nagle, no delayed ACKs, and busy polling where allowed
+    static SocketProfile lowLatency();
+    
+    /// Profile for big transfers, like map data: writes are merged and kernel
+    /// buffers are enlarged
+    static SocketProfile bulk();
+};
+
 /// A cross platform socket object
 class Socket {
     SOCKET rawSock = INVALID_SOCKET;
     
+    /// Amount of space readInto makes in the buffer for each read. Adapts to
+    /// the traffic on this socket
+    size_t readSize = minReadSize;
+    
+    /// Whether SocketOption::QuickAck is enabled, so it can be set again after
+    /// reads
+    bool quickAck = false;
+    
     /// Create socket from raw socket. This is private for safety
     Socket(SOCKET rawSock);
     
@@ -35,6 +104,10 @@ class Socket {
     /// SocketSelector is a friend of Socket
     friend class SocketSelector;
 public:
+    /// Smallest and biggest read sizes used by readInto, in bytes
+    static const size_t minReadSize = 4096;
+    static const size_t maxReadSize = 256 * 1024;
+    
     /// Initialise socket API. Only used for winsock2 if on Windows
     static void initSocketApi();
     
@@ -42,13 +115,16 @@ public:
     static void cleanupSocketApi();
     
     /// Resolves a host to a list of addresses. If internet access is down,
-    /// this _WILL_ block forever
-    // TODO make this non-blocking using a dedicated thread
+    /// this _WILL_ block forever. Use Resolver to resolve with a timeout
     static std::vector<IN_ADDR> resolve(std::string host);
     
     /// Create socket with address family, socket type and protocol
     Socket(SOCKET_ADDRESS_FAMILY addressFamily, int type, int protocol);
     
+    /// Create a pair of connected, non-blocking stream sockets. Useful to wake
+    /// a selector from another thread
+    static std::pair<std::unique_ptr<Socket>, std::unique_ptr<Socket> > createPair();
+    
     /// Create invalid socket (default constructor)
     Socket();
     
@@ -71,6 +147,15 @@ public:
     /// Can block if the socket is not in non-blocking mode
     bool read(std::vector<uint8_t>& output);
     
+    /// Read available data straight into the end of a buffer, without
+    /// intermediate copies. Keeps reading until the socket would block or
+    /// maxReadSize bytes were read, so the socket should be non-blocking, and
+    /// data may be left for the next call. The read size grows while reads
+    /// fill it and shrinks when traffic is light. Returns whether the
+    /// connection is still connected. Data received before the connection was
+    /// closed is still added to the buffer
+    bool readInto(Buffer& buffer);
+    
     /// Same as write (see private write above), but for a whole byte vector
     size_t write(const std::vector<uint8_t>& data);
     
@@ -81,6 +166,43 @@ public:
     /// valid
     size_t write(const std::vector<uint8_t>::iterator begin, size_t dataSize);
     
+    /// Write the start of a buffer straight from its storage, erasing what was
+    /// written. Keeps writing until the buffer is empty or the socket would
+    /// block, so the socket should be non-blocking. Returns number of bytes
+    /// written
+    size_t writeFrom(Buffer& buffer);
+    
+    /// Write a buffer straight from its storage with a single writev (both
+    /// parts of the ring buffer at once), erasing what was written. After a
+    /// partial write, the rest stays in place for the next call. Returns
+    /// number of bytes written
+    size_t writev(Buffer& buffer);
+    
+    /// Most segments writev writes in a single call. The rest are left for
+    /// the next call
+    static const size_t maxWriteSegments = 64;
+    
+    /// Write several segments, in order, with a single call where the platform
+    /// allows it (scatter-gather), so they don't need to be merged first. On
+    /// Linux, this is a sendmsg that never signals SIGPIPE, so the socket
+    /// should be connected. Returns number of bytes written, which can end in
+    /// the middle of a segment. Can block if the socket is not in
+    /// non-blocking mode
+    size_t writev(const SocketSegment* segments, size_t segmentCount);
+    
+    /// Biggest datagram sendTo can send and receiveFrom can receive, in bytes
+    static const size_t maxDatagramSize = 65507;
+    
+    /// Send a datagram to an address and port (datagram sockets only). Returns
+    /// false if the socket is non-blocking and the datagram couldn't be
+    /// queued, in which case it is dropped
+    bool sendTo(const std::vector<uint8_t>& datagram, IN_ADDR address, uint16_t port);
+    
+    /// Receive a single datagram (datagram sockets only), replacing output,
+    /// and get the address and port it came from. Returns false if the socket
+    /// is non-blocking and there are no datagrams
+    bool receiveFrom(std::vector<uint8_t>& output, IN_ADDR& address, uint16_t& port);
+    
     /// Bind socket to address family, address and port
     void bind(SOCKET_ADDRESS_FAMILY addressFamily, IN_ADDR address, uint16_t port);
     
@@ -94,8 +216,9 @@ public:
     /// Accept a pending incoming connection. Returns nullptr if there is no
     /// pending connection and the socket is non-blocking, otherwise, a pointer
     /// to a new Socket instance. Note that this can block if the socket is not
-    /// non-blocking
-    std::unique_ptr<Socket> accept();
+    /// non-blocking. If nonBlocking is true, the new socket is already in
+    /// non-blocking mode (set atomically with accept4 on Linux)
+    std::unique_ptr<Socket> accept(bool nonBlocking = false);
     
     /// Connect to an address family, address and port. Returns true if the
     /// connection was successful, false otherwise, on non-blocking calls. On
@@ -111,6 +234,18 @@ public:
     /// default
     void setBlocking(bool blocking);
     
+    /// Set an option. Returns false if the option isn't supported on this
+    /// platform, in which case nothing happens
+    bool setOption(SocketOption option, int value);
+    
+    /// Get an option's value. Throws if the option isn't supported on this
+    /// platform. Note that Linux reports buffer sizes as double the size set,
+    /// to account for bookkeeping
+    int getOption(SocketOption option) const;
+    
+    /// Set all options in a profile, skipping unsupported ones
+    void applyProfile(const SocketProfile& profile);
+    
     /// Check if the socket is valid
     bool isValid() const;
     
@@ -27,4 +27,10 @@
     #error Unsupported platform. Unix-like and Windows only
 #endif
 
+// SocketSelector uses epoll on Linux, and select everywhere else. Define
+// ROGUELIKE_NO_EPOLL to force select
+#if defined(__linux__) && !defined(ROGUELIKE_NO_EPOLL)
+    #define ROGUELIKE_EPOLL
+#endif
+
 #endif
@@ -1,6 +1,10 @@
 #include "SocketSelector.hpp"
 
-#ifdef ROGUELIKE_UNIX
+#ifdef ROGUELIKE_EPOLL
+    #include <unistd.h>
+    #include <cerrno>
+    #include <algorithm>
+#elif defined(ROGUELIKE_UNIX)
     #include <sys/select.h>
 #endif
 
@@ -8,16 +12,179 @@ bool SelectedEvent::isOfType(SelectedEventType type) {
     return types & type;
 }
 
+#ifdef ROGUELIKE_EPOLL
+/// Converts SelectedEventType bits to epoll event bits
+static uint32_t toEpollEvents(int eventTypes, SelectorTrigger trigger) {
+    uint32_t events = 0;
+    if(eventTypes & SelectedEventType::Read)
+        events |= EPOLLIN;
+    if(eventTypes & SelectedEventType::Write)
+        events |= EPOLLOUT;
+    if(eventTypes & SelectedEventType::Exceptional)
+        events |= EPOLLPRI;
+    if(trigger == SelectorTrigger::Edge)
+        events |= EPOLLET;
+    return events;
+}
+
+SocketSelector::SocketSelector(SelectorTrigger trigger) :
+    trigger(trigger),
+    epollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if(epollFd == -1)
+        throw SocketException::fromErrno("SocketSelector: epoll_create1: ");
+}
+
+SocketSelector::~SocketSelector() {
+    ::close(epollFd);
+}
+
+void SocketSelector::addWait(int eventTypes, std::shared_ptr<Socket> socket, std::shared_ptr<void> userData) {
+    // Skip invalidated sockets
+    if(!socket->isValid())
+        return;
+    
+    auto rawSock = socket->rawSock;
+    epoll_event event;
+    event.data.fd = rawSock;
+    
+    auto it = eventWaitList.find(rawSock);
+    if(it != eventWaitList.end() && it->second.socket.get() == socket.get()) {
+        // The socket is already registered, update user data and event types.
+        // epoll only needs to be told if the event types changed
+        if(userData)
+            it->second.userData = std::move(userData);
+        
+        if((it->second.types | eventTypes) == it->second.types)
+            return;
+        
+        it->second.types |= eventTypes;
+        event.events = toEpollEvents(it->second.types, trigger);
+        if(epoll_ctl(epollFd, EPOLL_CTL_MOD, rawSock, &event) == -1)
+            throw SocketException::fromErrno("SocketSelector::addWait: epoll_ctl: ");
+        
+        return;
+    }
+    
+    // Else, register it. If the file descriptor belonged to a socket that was
+    // closed, epoll already forgot about it, so the old entry is replaced
+    event.events = toEpollEvents(eventTypes, trigger);
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, rawSock, &event) == -1) {
+        if(errno != EEXIST || epoll_ctl(epollFd, EPOLL_CTL_MOD, rawSock, &event) == -1)
+            throw SocketException::fromErrno("SocketSelector::addWait: epoll_ctl: ");
+    }
+    
+    if(it != eventWaitList.end())
+        it->second = SelectedEvent(eventTypes, socket, userData);
+    else
+        eventWaitList.emplace(rawSock, SelectedEvent(eventTypes, socket, userData));
+}
+
+void SocketSelector::removeWait(const std::shared_ptr<Socket>& socket) {
+    // Find the socket by file descriptor, or by pointer if it was already
+    // invalidated
+    auto it = eventWaitList.end();
+    if(socket->isValid())
+        it = eventWaitList.find(socket->rawSock);
+    else {
+        for(it = eventWaitList.begin(); it != eventWaitList.end(); it++) {
+            if(it->second.socket.get() == socket.get())
+                break;
+        }
+    }
+    
+    if(it == eventWaitList.end() || it->second.socket.get() != socket.get())
+        return;
+    
+    // Closed sockets were already removed from epoll
+    if(socket->isValid())
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, socket->rawSock, nullptr);
+    
+    eventWaitList.erase(it);
+}
+
+bool SocketSelector::isWaiting(const std::shared_ptr<Socket>& socket) const {
+    if(!socket->isValid())
+        return false;
+    
+    auto it = eventWaitList.find(socket->rawSock);
+    return it != eventWaitList.end() && it->second.socket.get() == socket.get();
+}
+
+std::vector<SelectedEvent> SocketSelector::wait(int timeoutMs) {
+    // Abort if there are no events to select
+    std::vector<SelectedEvent> selectedEvents;
+    if(eventWaitList.empty())
+        return selectedEvents;
+    
+    // Get at most 1024 events per wait. Events that don't fit are returned by
+    // the next wait
+    readyEvents.resize(std::min<size_t>(eventWaitList.size(), 1024));
+    int result = epoll_wait(epollFd, readyEvents.data(), readyEvents.size(), timeoutMs < 0 ? -1 : timeoutMs);
+    
+    // Throw exception on error. Being interrupted by a signal counts as a
+    // timeout
+    if(result == -1) {
+        if(errno == EINTR)
+            return selectedEvents;
+        
+        throw SocketException::fromErrno("SocketSelector::wait: ");
+    }
+    
+    // Parse events
+    selectedEvents.reserve(result);
+    for(int i = 0; i < result; i++) {
+        auto it = eventWaitList.find(readyEvents[i].data.fd);
+        if(it == eventWaitList.end())
+            continue;
+        
+        // Remove invalidated sockets from waiting list
+        if(!it->second.socket->isValid()) {
+            eventWaitList.erase(it);
+            continue;
+        }
+        
+        // Get event types. Errors and hang-ups are reported as whatever the
+        // socket was waiting for, like select does, so that the following
+        // read or write fails
+        uint32_t events = readyEvents[i].events;
+        int eventTypes = 0;
+        if(events & (EPOLLERR | EPOLLHUP))
+            eventTypes |= it->second.types;
+        if(events & (EPOLLIN | EPOLLRDHUP))
+            eventTypes |= SelectedEventType::Read;
+        if(events & EPOLLOUT)
+            eventTypes |= SelectedEventType::Write;
+        if(events & EPOLLPRI)
+            eventTypes |= SelectedEventType::Exceptional;
+        
+        // Add to selected events
+        eventTypes &= it->second.types;
+        if(eventTypes != 0)
+            selectedEvents.emplace_back(eventTypes, it->second.socket, it->second.userData);
+    }
+    
+    return selectedEvents;
+}
+#else
+SocketSelector::SocketSelector(SelectorTrigger trigger) :
+    trigger(trigger)
+{}
 
-void SocketSelector::addWait(int eventTypes, std::shared_ptr<Socket> socket) {
+SocketSelector::~SocketSelector() {}
+
+void SocketSelector::addWait(int eventTypes, std::shared_ptr<Socket> socket, std::shared_ptr<void> userData) {
     // Skip invalidated sockets
     if(!socket->isValid())
         return;
     
-    // If the socket is already in the wait list, update event types
+    // If the socket is already in the wait list, update event types and user
+    // data
     for(auto it = eventWaitList.begin(); it != eventWaitList.end(); it++) {
         if(it->socket.get() == socket.get()) {
             it->types |= eventTypes;
+            if(userData)
+                it->userData = std::move(userData);
             return;
         }
     }
@@ -26,8 +193,32 @@ void SocketSelector::addWait(int eventTypes, std::shared_ptr<Socket> socket) {
     if(eventWaitList.size() == FD_SETSIZE)
         throw SocketException("SocketSelector::addWait: socket select limit (" + std::to_string(FD_SETSIZE) + ") reached");
     
+    #ifdef ROGUELIKE_UNIX
+    // On Unix, fd_set can't hold file descriptors past the limit either
+    if(socket->rawSock >= FD_SETSIZE)
+        throw SocketException("SocketSelector::addWait: socket file descriptor " + std::to_string(socket->rawSock) + " is over the select limit (" + std::to_string(FD_SETSIZE) + ")");
+    #endif
+    
     // Else, insert into the wait list
-    eventWaitList.emplace_back(eventTypes, socket);
+    eventWaitList.emplace_back(eventTypes, socket, userData);
+}
+
+void SocketSelector::removeWait(const std::shared_ptr<Socket>& socket) {
+    for(auto it = eventWaitList.begin(); it != eventWaitList.end(); it++) {
+        if(it->socket.get() == socket.get()) {
+            eventWaitList.erase(it);
+            return;
+        }
+    }
+}
+
+bool SocketSelector::isWaiting(const std::shared_ptr<Socket>& socket) const {
+    for(auto it = eventWaitList.begin(); it != eventWaitList.end(); it++) {
+        if(it->socket.get() == socket.get())
+            return socket->isValid();
+    }
+    
+    return false;
 }
 
 std::vector<SelectedEvent> SocketSelector::wait(int timeoutMs) {
@@ -124,9 +315,11 @@ std::vector<SelectedEvent> SocketSelector::wait(int timeoutMs) {
         if(efdsPtr && FD_ISSET(rawSock, efdsPtr))
             eventTypes |= SelectedEventType::Exceptional;
         
-        // Add to selected events
-        selectedEvents.emplace_back(eventTypes, it->socket);
+        // Add to selected events, if any
+        if(eventTypes != 0)
+            selectedEvents.emplace_back(eventTypes, it->socket, it->userData);
     }
     
     return selectedEvents;
 }
+#endif
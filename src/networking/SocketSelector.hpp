@@ -3,6 +3,11 @@
 #include "Socket.hpp"
 #include <memory>
 
+#ifdef ROGUELIKE_EPOLL
+    #include <sys/epoll.h>
+    #include <unordered_map>
+#endif
+
 /// Type of event to be selected
 enum SelectedEventType {
     Read = 1,       // There is data to be read!
@@ -17,30 +22,87 @@ struct SelectedEvent {
     int types;
     // The socket affected by this event
     std::shared_ptr<Socket> socket;
+    // User data given to SocketSelector::addWait for this socket, if any
+    std::shared_ptr<void> userData;
     
-    SelectedEvent(int types, std::shared_ptr<Socket> socket) :
+    SelectedEvent(int types, std::shared_ptr<Socket> socket, std::shared_ptr<void> userData = nullptr) :
         types(types),
-        socket(socket)
+        socket(socket),
+        userData(userData)
     {}
     
     // Check if event is of the given type. Note that an event can be of
     // multiple types
     bool isOfType(SelectedEventType type);
+    
+    // Get the user data as a T. T must be the type the user data was created
+    // with; this is not checked
+    template<typename T> std::shared_ptr<T> getUserData() const {
+        return std::static_pointer_cast<T>(userData);
+    }
 };
 
-/// A wrapper for select(). Waits for an event to happen at at least one of the
-/// sockets provided. Can be re-used, assuming sockets remain valid
+/// How a SocketSelector reports events
+enum class SelectorTrigger {
+    /// Events are reported by every wait for as long as they apply, like
+    /// select(). This is the default
+    Level,
+    /// Events are only reported once when they happen, so the caller must read
+    /// or write until the socket would block. Only supported by the epoll
+    /// backend; the select backend is always level-triggered
+    Edge
+};
+
+/// Waits for an event to happen at at least one of the sockets provided. Can
+/// be re-used, assuming sockets remain valid. Uses epoll on Linux, where
+/// sockets are registered once and waiting doesn't depend on the amount of
+/// sockets, and select() elsewhere, which is limited to FD_SETSIZE sockets
 class SocketSelector {
+    /// Event trigger mode
+    SelectorTrigger trigger;
+    
+    #ifdef ROGUELIKE_EPOLL
+    /// epoll instance
+    int epollFd;
+    
+    /// Registered sockets and event types, by file descriptor
+    std::unordered_map<SOCKET, SelectedEvent> eventWaitList;
+    
+    /// Storage for events returned by epoll_wait. Re-used between waits
+    std::vector<epoll_event> readyEvents;
+    #else
     // Sockets to wait for specified event types
     std::vector<SelectedEvent> eventWaitList;
+    #endif
 public:
-    // Add an event to the waiting list. Invalidated sockets will be ignored
-    void addWait(int event_types, std::shared_ptr<Socket> socket);
+    /// Create a selector with a trigger mode
+    SocketSelector(SelectorTrigger trigger = SelectorTrigger::Level);
+    
+    /// Destructor
+    ~SocketSelector();
+    
+    /// Selectors cannot be copied or copy-assigned
+    SocketSelector(const SocketSelector&) = delete;
+    SocketSelector& operator=(const SocketSelector&) = delete;
+    
+    // Add an event to the waiting list, with optional user data that is
+    // returned with the socket's events. If the socket is already in the
+    // waiting list, the event types are added to its current ones and the user
+    // data is replaced (if given). Invalidated sockets will be ignored
+    void addWait(int eventTypes, std::shared_ptr<Socket> socket, std::shared_ptr<void> userData = nullptr);
+    
+    // Remove a socket from the waiting list, for all event types. Does nothing
+    // if the socket isn't in the waiting list
+    void removeWait(const std::shared_ptr<Socket>& socket);
+    
+    // Check if a socket is in the waiting list
+    bool isWaiting(const std::shared_ptr<Socket>& socket) const;
     
     // Wait for an event to happen, with a timeout in milliseconds. If negative
     // this will block until an event happens. If 0, this will immediately
     // return, else, it will wait up to timeoutMs milliseconds for any event.
-    // Invalidated sockets will be removed from the waiting list
+    // Only sockets with events are returned. Invalidated sockets will be
+    // removed from the waiting list
     std::vector<SelectedEvent> wait(int timeoutMs);
 };
 
@@ -0,0 +1,69 @@
+#ifndef ROGUELIKE_SPSC_QUEUE_HPP_INCLUDED
+#define ROGUELIKE_SPSC_QUEUE_HPP_INCLUDED
+#include <atomic>
+#include <utility>
+
+/// An unbounded lock-free queue for a single producer thread and a single
+/// consumer thread. Pushing allocates a node; popping frees one. Pushes from
+/// different threads (or pops) must be serialised by the caller, e.g. with a
+/// mutex
+template<typename T> class SpscQueue {
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+        
+        Node() :
+            next(nullptr)
+        {}
+    };
+    
+    /// Node before the first value (consumer side). Always a node whose value
+    /// was already popped, or the initial empty node
+    Node* head;
+    
+    /// Last node (producer side)
+    Node* tail;
+public:
+    SpscQueue() :
+        head(new Node),
+        tail(head)
+    {}
+    
+    /// Queues cannot be copied or copy-assigned
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    ~SpscQueue() {
+        while(head != nullptr) {
+            Node* next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+    
+    /// Add a value to the back. Producer only
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        
+        // Publish the node. Release so the consumer sees its value
+        tail->next.store(node, std::memory_order_release);
+        tail = node;
+    }
+    
+    /// Take the value at the front. Returns false if the queue is empty.
+    /// Consumer only
+    bool pop(T& value) {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if(next == nullptr)
+            return false;
+        
+        // next becomes the new empty head node
+        value = std::move(next->value);
+        delete head;
+        head = next;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include "Waker.hpp"
+#include <vector>
+
+Waker::Waker() :
+    pending(false)
+{
+    auto pair = Socket::createPair();
+    writer = std::move(pair.first);
+    reader = std::move(pair.second);
+}
+
+void Waker::wake() {
+    // Only write if the thread hasn't been woken up already. If the write
+    // would block, there are plenty of unread bytes anyway
+    if(!pending.exchange(true)) {
+        try {
+            writer->write(std::vector<uint8_t>{1});
+        }
+        catch(const SocketException&) {}
+    }
+}
+
+void Waker::clear() {
+    // Exchange rather than store, so that whatever was done before the last
+    // wake is visible to the caller afterwards
+    pending.exchange(false);
+    try {
+        std::vector<uint8_t> drained;
+        while(reader->read(drained) && !drained.empty())
+            drained.clear();
+    }
+    catch(const SocketException&) {}
+}
@@ -0,0 +1,31 @@
+#ifndef ROGUELIKE_WAKER_HPP_INCLUDED
+#define ROGUELIKE_WAKER_HPP_INCLUDED
+#include "Socket.hpp"
+#include <atomic>
+
+/// Wakes a thread waiting on a SocketSelector from other threads: the reader
+/// socket becomes readable when wake is called, so it can be waited on along
+/// with the thread's other sockets. Used to tell a thread that a queue has
+/// something new
+class Waker {
+    /// Whether a byte was written and not cleared yet. Keeps a burst of wakes
+    /// down to one write
+    std::atomic<bool> pending;
+    
+    /// Written to in order to wake the waiting thread
+    std::unique_ptr<Socket> writer;
+public:
+    /// Readable after a wake. Wait for read events on this
+    std::shared_ptr<Socket> reader;
+    
+    Waker();
+    
+    /// Wake the waiting thread. Can be called from any thread
+    void wake();
+    
+    /// Drain the reader. Waiting thread only. Call before checking for new
+    /// work, so that anything added after it wakes the thread again
+    void clear();
+};
+
+#endif
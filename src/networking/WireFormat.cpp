@@ -0,0 +1,75 @@
+#include "WireFormat.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+size_t headerSize(WireFormat format, uint16_t type, uint64_t bodySize) {
+    if(format == WireFormat::Compact)
+        return varintSize(type) + varintSize(bodySize);
+    
+    return 10;
+}
+
+bool peekHeader(Buffer& buffer, WireFormat format, MessageHeader& header) {
+    if(format == WireFormat::Fixed) {
+        // Abort if header not received yet (type and data size)
+        if(buffer.size() < 10)
+            return false;
+        
+        BufferCursor cursor(buffer.peek(10));
+        cursor.read(header.type);
+        cursor.read(header.bodySize);
+        header.size = 10;
+        return true;
+    }
+    
+    // Compact header: varint type and varint data size. Each is only parsed
+    // once all of its bytes were received
+    BufferCursor cursor(buffer.peek(std::min(buffer.size(), 2 * maxVarintSize)));
+    uint64_t type;
+    if(!cursor.hasVarint())
+        return false;
+    cursor.readVarint(type);
+    
+    if(type > UINT16_MAX)
+        throw std::invalid_argument("peekHeader: message type " + std::to_string(type) + " is out of range");
+    
+    if(!cursor.hasVarint())
+        return false;
+    cursor.readVarint(header.bodySize);
+    
+    header.type = static_cast<uint16_t>(type);
+    header.size = std::min(buffer.size(), 2 * maxVarintSize) - cursor.remaining();
+    return true;
+}
+
+size_t countSize(WireFormat format, uint64_t count) {
+    return format == WireFormat::Compact ? varintSize(count) : 8;
+}
+
+size_t coordinateSize(WireFormat format, int64_t coordinate) {
+    return format == WireFormat::Compact ? varintSize(zigzagEncode(coordinate)) : 8;
+}
+
+void readCount(BufferCursor& cursor, WireFormat format, uint64_t& count) {
+    if(format == WireFormat::Compact)
+        cursor.readVarint(count);
+    else
+        cursor.read(count);
+}
+
+void readCoordinate(BufferCursor& cursor, WireFormat format, int64_t& coordinate) {
+    if(format == WireFormat::Compact)
+        cursor.readVarint(coordinate);
+    else
+        cursor.read(coordinate);
+}
+
+void readCoordinates(BufferCursor& cursor, WireFormat format, int64_t* coordinates, size_t count) {
+    if(format == WireFormat::Compact) {
+        for(size_t i = 0; i < count; i++)
+            cursor.readVarint(coordinates[i]);
+    }
+    else
+        cursor.readArray(coordinates, count);
+}
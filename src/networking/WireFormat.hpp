@@ -0,0 +1,55 @@
+#ifndef ROGUELIKE_WIRE_FORMAT_HPP_INCLUDED
+#define ROGUELIKE_WIRE_FORMAT_HPP_INCLUDED
+#include "Buffer.hpp"
+#include <cstdint>
+
+/// How messages are encoded on a connection. Both ends of a connection must
+/// use the same format
+enum class WireFormat {
+    /// 10-byte header (2-byte type and 8-byte body size) and fixed-width
+    /// lengths, counts and coordinates. This is the original protocol
+    Fixed = 0,
+    /// Varint header, varint lengths and counts, and zigzag varint
+    /// coordinates. Much smaller for typical (small) values
+    Compact = 1
+};
+
+/// A message header
+struct MessageHeader {
+    /// Message type. See GameMessageType
+    uint16_t type;
+    
+    /// Size of the message body, in bytes
+    uint64_t bodySize;
+    
+    /// Size of the header itself, in bytes
+    size_t size;
+};
+
+/// Gets the size of a message header, in bytes
+size_t headerSize(WireFormat format, uint16_t type, uint64_t bodySize);
+
+/// Parses the header at the start of a buffer, without popping it. Returns
+/// false if the full header hasn't been received yet. Throws
+/// std::invalid_argument if the header is malformed, which is only possible
+/// in the Compact format
+bool peekHeader(Buffer& buffer, WireFormat format, MessageHeader& header);
+
+/// Gets the size of a count or length field, in bytes
+size_t countSize(WireFormat format, uint64_t count);
+
+/// Gets the size of a coordinate (or other small signed value) field, in
+/// bytes
+size_t coordinateSize(WireFormat format, int64_t coordinate);
+
+/// Reads count coordinate (or other small signed value) fields to a C array.
+/// In the Fixed format, they are read in a single copy
+void readCoordinates(BufferCursor& cursor, WireFormat format, int64_t* coordinates, size_t count);
+
+/// Reads a count or length field
+void readCount(BufferCursor& cursor, WireFormat format, uint64_t& count);
+
+/// Reads a coordinate (or other small signed value) field
+void readCoordinate(BufferCursor& cursor, WireFormat format, int64_t& coordinate);
+
+#endif
@@ -0,0 +1,257 @@
+#include "WriteQueue.hpp"
+#include "MessageWriter.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+Payload makePayload(std::vector<uint8_t> bytes) {
+    return std::make_shared<const std::vector<uint8_t> >(std::move(bytes));
+}
+
+MessagePriority priorityOf(GameMessageType type) {
+    switch(type) {
+        case GameMessageType::ActionAck:
+        case GameMessageType::SnapshotChannel:
+        case GameMessageType::Ping:
+        case GameMessageType::Pong:
+            return MessagePriority::Control;
+        case GameMessageType::Join:
+        case GameMessageType::Quit:
+        case GameMessageType::Chat:
+            return MessagePriority::Interactive;
+        default:
+            return MessagePriority::Bulk;
+    }
+}
+
+bool WriteQueue::checkCap() {
+    if(maxBytes == 0 || size() <= maxBytes)
+        return true;
+    
+    clear();
+    overflowed = true;
+    if(stats != nullptr)
+        stats->overflows++;
+    return false;
+}
+
+bool WriteQueue::refill() {
+    // Control and interactive messages are small, so a whole lane goes at
+    // once
+    std::deque<Payload>* lane = nullptr;
+    if(!control.empty()) {
+        lane = &control;
+        controlBytes = 0;
+    }
+    else if(!interactive.empty()) {
+        lane = &interactive;
+        interactiveBytes = 0;
+    }
+    
+    if(lane != nullptr) {
+        for(auto it = lane->begin(); it != lane->end(); it++) {
+            size_t size = (*it)->size();
+            writing.push_back(Segment{std::move(*it), 0, size});
+            writingBytes += size;
+        }
+        lane->clear();
+        return true;
+    }
+    
+    // Start the next bulk message: reliable ones first, then states
+    if(!fragmented) {
+        Payload next;
+        if(!bulk.empty()) {
+            next = std::move(bulk.front());
+            bulk.pop_front();
+            bulkBytes -= next->size();
+        }
+        else if(!states.empty()) {
+            next = std::move(states.front().payload);
+            states.pop_front();
+            stateBytes -= next->size();
+        }
+        else
+            return false;
+        
+        // Small enough to go whole
+        if(chunkSize == 0 || next->size() <= chunkSize) {
+            size_t size = next->size();
+            writing.push_back(Segment{std::move(next), 0, size});
+            writingBytes += size;
+            return true;
+        }
+        
+        fragmented = std::move(next);
+        fragmentedOffset = 0;
+    }
+    
+    // Next fragment: a flag telling whether it is the last one, then the
+    // piece of the message, written straight from the message's payload
+    size_t pieceSize = std::min(chunkSize, fragmented->size() - fragmentedOffset);
+    bool last = fragmentedOffset + pieceSize == fragmented->size();
+    MessageWriter writer(GameMessageType::Fragment, 1 + pieceSize, wireFormat);
+    writer.write(static_cast<uint8_t>(last));
+    Payload header = makePayload(writer.finishPrefix());
+    writingBytes += header->size() + pieceSize;
+    writing.push_back(Segment{header, 0, header->size()});
+    writing.push_back(Segment{fragmented, fragmentedOffset, pieceSize});
+    
+    fragmentedOffset += pieceSize;
+    if(last) {
+        fragmented.reset();
+        fragmentedOffset = 0;
+    }
+    
+    return true;
+}
+
+void WriteQueue::consume(size_t byteCount) {
+    writingBytes -= byteCount;
+    while(byteCount > 0) {
+        Segment& segment = writing.front();
+        if(byteCount < segment.size) {
+            segment.offset += byteCount;
+            segment.size -= byteCount;
+            return;
+        }
+        
+        byteCount -= segment.size;
+        writing.pop_front();
+    }
+}
+
+bool WriteQueue::push(GameMessageType type, Payload payload) {
+    if(!payload)
+        throw std::invalid_argument("WriteQueue::push: Attempt to push a null payload");
+    
+    if(overflowed)
+        return false;
+    
+    size_t size = payload->size();
+    switch(priorityOf(type)) {
+        case MessagePriority::Control:
+            control.push_back(std::move(payload));
+            controlBytes += size;
+            break;
+        case MessagePriority::Interactive:
+            interactive.push_back(std::move(payload));
+            interactiveBytes += size;
+            break;
+        case MessagePriority::Bulk:
+            bulk.push_back(std::move(payload));
+            bulkBytes += size;
+            break;
+    }
+    
+    return checkCap();
+}
+
+bool WriteQueue::push(GameMessageType type, std::vector<uint8_t> bytes) {
+    return push(type, makePayload(std::move(bytes)));
+}
+
+bool WriteQueue::pushState(GameMessageType type, Payload payload) {
+    if(!payload)
+        throw std::invalid_argument("WriteQueue::pushState: Attempt to push a null payload");
+    
+    if(overflowed)
+        return false;
+    
+    // Latest wins. The new copy goes to the back, after whatever was queued
+    // since the old one
+    for(auto it = states.begin(); it != states.end(); it++) {
+        if(it->type == type) {
+            stateBytes -= it->payload->size();
+            states.erase(it);
+            droppedStates++;
+            if(stats != nullptr)
+                stats->droppedStates++;
+            break;
+        }
+    }
+    
+    stateBytes += payload->size();
+    states.push_back(State{type, std::move(payload)});
+    return checkCap();
+}
+
+bool WriteQueue::append(WriteQueue& other) {
+    if(!other.writing.empty() || other.fragmented)
+        throw std::invalid_argument("WriteQueue::append: Attempt to append a queue that started writing");
+    
+    if(overflowed) {
+        other.clear();
+        return false;
+    }
+    
+    // Lanes are moved whole, keeping their order. Only references to the
+    // payloads are moved
+    for(auto it = other.control.begin(); it != other.control.end(); it++)
+        control.push_back(std::move(*it));
+    controlBytes += other.controlBytes;
+    for(auto it = other.interactive.begin(); it != other.interactive.end(); it++)
+        interactive.push_back(std::move(*it));
+    interactiveBytes += other.interactiveBytes;
+    for(auto it = other.bulk.begin(); it != other.bulk.end(); it++)
+        bulk.push_back(std::move(*it));
+    bulkBytes += other.bulkBytes;
+    
+    bool appended = checkCap();
+    for(auto it = other.states.begin(); appended && it != other.states.end(); it++)
+        appended = pushState(it->type, std::move(it->payload));
+    
+    other.clear();
+    return appended;
+}
+
+size_t WriteQueue::writeTo(Socket& socket) {
+    // Keep writing until the socket is full. The lane is picked again after
+    // every refill, so control and interactive messages never wait behind
+    // more than one bulk message or fragment
+    size_t written = 0;
+    SocketSegment segments[Socket::maxWriteSegments];
+    while(writingBytes > 0 || refill()) {
+        // Hand as many segments as possible to the socket at once
+        size_t segmentCount = 0, offered = 0;
+        for(auto it = writing.begin(); it != writing.end() && segmentCount < Socket::maxWriteSegments; it++) {
+            segments[segmentCount++] = SocketSegment{it->payload->data() + it->offset, it->size};
+            offered += it->size;
+        }
+        
+        size_t bytesWritten = socket.writev(segments, segmentCount);
+        consume(bytesWritten);
+        written += bytesWritten;
+        if(bytesWritten < offered)
+            break;
+    }
+    
+    return written;
+}
+
+size_t WriteQueue::size() {
+    return writingBytes + controlBytes + interactiveBytes + bulkBytes + stateBytes + (fragmented ? fragmented->size() - fragmentedOffset : 0);
+}
+
+bool WriteQueue::empty() {
+    return size() == 0;
+}
+
+bool WriteQueue::isOverflowed() const {
+    return overflowed;
+}
+
+void WriteQueue::clear() {
+    writing.clear();
+    writingBytes = 0;
+    control.clear();
+    controlBytes = 0;
+    interactive.clear();
+    interactiveBytes = 0;
+    bulk.clear();
+    bulkBytes = 0;
+    states.clear();
+    stateBytes = 0;
+    fragmented.reset();
+    fragmentedOffset = 0;
+}
@@ -0,0 +1,169 @@
+#ifndef ROGUELIKE_WRITE_QUEUE_HPP_INCLUDED
+#define ROGUELIKE_WRITE_QUEUE_HPP_INCLUDED
+#include "GameMessageType.hpp"
+#include "Socket.hpp"
+#include "WireFormat.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/// Counters shared by the write queues of a server. Can be updated and read
+/// from any thread
+struct WriteQueueStats {
+    /// State messages dropped because a newer copy was queued before they
+    /// were sent
+    std::atomic<uint64_t> droppedStates;
+    
+    /// Queues that went over their byte cap
+    std::atomic<uint64_t> overflows;
+    
+    WriteQueueStats() :
+        droppedStates(0),
+        overflows(0)
+    {}
+};
+
+/// A serialized message, shared by the write queues of all its recipients.
+/// Never changed once made, so a message sent to every player is stored once
+/// and written to each socket straight from the same bytes
+typedef std::shared_ptr<const std::vector<uint8_t> > Payload;
+
+/// Make a payload out of serialized bytes
+Payload makePayload(std::vector<uint8_t> bytes);
+
+/// How urgent a message is. Lower values are written first
+enum class MessagePriority {
+    /// Small messages that are waited on: acks, pings and pongs
+    Control = 0,
+    /// Messages players read as they come: joins, quits and chat
+    Interactive = 1,
+    /// Big game state: map, object and player data. Can be split into
+    /// fragments, so more urgent messages can be written in between
+    Bulk = 2
+};
+
+/// Gets the priority of a message type
+MessagePriority priorityOf(GameMessageType type);
+
+/// Outgoing messages of one connection, as payloads, in three lanes by priority
+/// (see MessagePriority). Each lane is in order, and a lane is only written
+/// when the lanes before it are empty. There are two classes of bulk
+/// messages:
+/// - Reliable messages are all sent, in order.
+/// - State messages (object and player data) are superseded by the next copy
+///   of the same type. Only the newest unsent copy of each type is kept, and
+///   they are sent once all reliable bulk messages queued before were
+///   written, so a connection that can't keep up gets fewer of them instead
+///   of a growing backlog.
+/// Messages are never cut short once they start being written. Bulk messages
+/// bigger than the chunk size are sent as Fragment messages instead, so at
+/// most a chunk is written before more urgent messages get their turn. A
+/// queue can have a byte cap; going over it marks the queue as overflowed and
+/// drops everything, since the connection can't keep up anyway. Payloads are
+/// never copied: queues only hold references to them, and the segments being
+/// written are handed to the socket together (see Socket::writev)
+class WriteQueue {
+    struct State {
+        GameMessageType type;
+        Payload payload;
+    };
+    
+    /// The part of a payload that is left to write
+    struct Segment {
+        Payload payload;
+        size_t offset;
+        size_t size;
+    };
+    
+    /// Segments being written, and their total size. Only refilled, from the
+    /// most urgent lane, once empty
+    std::deque<Segment> writing;
+    size_t writingBytes = 0;
+    
+    /// Control and interactive lanes, and their total sizes
+    std::deque<Payload> control, interactive;
+    size_t controlBytes = 0, interactiveBytes = 0;
+    
+    /// Reliable bulk messages, and their total size
+    std::deque<Payload> bulk;
+    size_t bulkBytes = 0;
+    
+    /// Newest unsent copy of each state message type, in the order they were
+    /// queued, and their total size
+    std::deque<State> states;
+    size_t stateBytes = 0;
+    
+    /// Bulk message being sent as fragments, and how much of it was sent
+    Payload fragmented;
+    size_t fragmentedOffset = 0;
+    
+    /// Whether the queue went over its cap
+    bool overflowed = false;
+    
+    /// Check the cap after adding bytes. Returns false, and drops everything,
+    /// if it was exceeded
+    bool checkCap();
+    
+    /// Move the next segments to write to the writing list: a whole lane of
+    /// control or interactive messages, or the next bulk message or fragment.
+    /// Returns false if nothing is queued
+    bool refill();
+    
+    /// Remove byteCount written bytes from the start of the writing list
+    void consume(size_t byteCount);
+public:
+    /// Maximum bytes queued. 0 for no cap
+    size_t maxBytes = 0;
+    
+    /// Bulk messages bigger than this are sent as fragments of this size.
+    /// The other end must reassemble them (see ClientMessageFragment). 0 to
+    /// never fragment
+    size_t chunkSize = 0;
+    
+    /// Wire format of fragment headers. Must be the connection's
+    WireFormat wireFormat = WireFormat::Fixed;
+    
+    /// State messages this queue dropped
+    uint64_t droppedStates = 0;
+    
+    /// Counters to update along with this queue's. Not owned; may be nullptr
+    WriteQueueStats* stats = nullptr;
+    
+    /// Queue a reliable message in the lane of its type. Returns false if the
+    /// queue overflowed, now or before, in which case the message is dropped.
+    /// Throws std::invalid_argument if the payload is null
+    bool push(GameMessageType type, Payload payload);
+    
+    /// Same as above, but for bytes that aren't shared yet
+    bool push(GameMessageType type, std::vector<uint8_t> bytes);
+    
+    /// Queue a state message, replacing the unsent copy of the same type if
+    /// there is one. Returns false if the queue overflowed. Throws
+    /// std::invalid_argument if the payload is null
+    bool pushState(GameMessageType type, Payload payload);
+    
+    /// Move everything queued in another queue to the end of this one's
+    /// lanes, as if it was pushed here. The other queue is left empty, and
+    /// must not have started writing. Returns false if this queue overflowed.
+    /// Throws std::invalid_argument if the other queue started writing
+    bool append(WriteQueue& other);
+    
+    /// Write as much as the socket takes without blocking. Returns number of
+    /// bytes written. Throws SocketException if the connection broke
+    size_t writeTo(Socket& socket);
+    
+    /// Bytes queued
+    size_t size();
+    
+    /// Check if nothing is queued
+    bool empty();
+    
+    /// Check if the queue went over its cap. Nothing is queued afterwards
+    bool isOverflowed() const;
+    
+    /// Drop everything queued
+    void clear();
+};
+
+#endif
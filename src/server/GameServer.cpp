@@ -9,6 +9,7 @@ Map& GameServer::getLevel(int n) {
         LevelGeneration2D generator;
         Map newLevel = generator.create_random_map();
         levels.emplace_back(std::move(newLevel));
+        objectHistories.emplace_back();
     }
     
     return levels[n];
@@ -75,16 +76,38 @@ void GameServer::doTurn() {
         for(auto player : levelPlayers)
             levels[l].objects.push_back(player);
         
+        // Give new objects an id, and remember the objects of this turn
+        for(auto& object : levels[l].objects) {
+            if(object->get_id() == 0)
+                object->set_id(nextObjectId++);
+        }
+        objectHistories[l].record(levels[l].objects, ++objectSequence);
+        
+        // Players on the same baseline get the same delta
         ClientMessageMapTileData tileDataMessage(levels[l]);
-        ClientMessageMapObjectData objectUpdateMessage(levels[l].objects);
+        std::map<uint64_t, std::unique_ptr<ClientMessageObjectDelta> > deltas;
         for(auto player : levelPlayers) {
             if(player->level != l)
                 addMessage(tileDataMessage, player);
-            addMessage(objectUpdateMessage, player);
+            
+            // Baselines the history doesn't have (never acked, acked as 0, too
+            // old, or from another level, since sequences are shared by all
+            // levels) give a delta holding the whole level
+            auto& delta = deltas[player->objectBaseline];
+            if(!delta)
+                delta.reset(new ClientMessageObjectDelta(objectHistories[l].deltaFrom(player->objectBaseline)));
+            
+            // Whole levels are how players recover, and are too big for one
+            // datagram, so they go reliably. Changes since an acknowledged
+            // baseline are snapshots, since the next one replaces a lost one
+            if(delta->delta.baseSequence == 0)
+                addMessage(*delta, player);
+            else
+                addSnapshot(*delta, player);
         }
     }
     
-    addMessageAll(ClientMessagePlayerData(players));
+    addSnapshotAll(ClientMessagePlayerData(players));
 }
 
 void GameServer::logic() {
@@ -152,6 +175,16 @@ void GameServer::logic() {
                         addMessage(ClientMessageActionAck(true), doActionEvent->sender);
                     }
                     break;
+                case GameMessageType::DoObjectAck:
+                    {
+                        // Newer baselines only, since acks can arrive out of
+                        // order. 0 asks for the whole level
+                        auto ackEvent = std::dynamic_pointer_cast<ServerMessageDoObjectAck>(*it);
+                        uint64_t& baseline = ackEvent->sender->objectBaseline;
+                        if(ackEvent->sequence == 0 || ackEvent->sequence > baseline)
+                            baseline = ackEvent->sequence;
+                    }
+                    break;
                 // TODO parse message types
             }
             
@@ -191,9 +224,10 @@ void GameServer::logic() {
             lastTurnTime = thisTurnStart;
         }
         
-        // Send buffered messages
+        // Send buffered messages, without waiting for slow players. Whatever
+        // their socket doesn't take is sent on later calls
         try {
-            sendMessages(250);
+            sendMessages(0);
         }
         catch(SocketException e) {}; // Ignore socket exceptions, broken pipe
         
@@ -208,8 +242,37 @@ void GameServer::logic() {
         close();
 }
 
-GameServer::GameServer(uint16_t port) :
-    Server(port),
+/// Default config for a game server. Actions and turn updates are small and
+/// need to arrive quickly, so players get the low latency socket profile, and
+/// per-turn state can go over the snapshot channel. Socket I/O runs on a
+/// reactor thread so it doesn't eat into turn time, and players that fall too
+/// far behind are dropped
+static ServerConfig gameServerConfig(uint16_t port, WireFormat wireFormat) {
+    ServerConfig config(port, wireFormat);
+    config.profile = SocketProfile::lowLatency();
+    config.snapshotChannel = true;
+    config.reactorThreads = 1;
+    config.maxQueuedBytes = 1024 * 1024;
+    config.chunkSize = 16 * 1024;
+    config.pingIntervalMs = 1000;
+    config.idleTimeoutMs = 10000;
+    
+    // Players only send names, chat lines and actions, a few per turn
+    config.inputLimits.maxBodySize = 1024;
+    config.inputLimits.maxBodySizes[static_cast<uint16_t>(GameMessageType::DoChat)] = 4096;
+    config.inputLimits.messagesPerSecond = 50;
+    config.inputLimits.messageBurst = 100;
+    config.inputLimits.bytesPerSecond = 16 * 1024;
+    config.inputLimits.byteBurst = 64 * 1024;
+    return config;
+}
+
+GameServer::GameServer(uint16_t port, WireFormat wireFormat) :
+    GameServer(gameServerConfig(port, wireFormat))
+{}
+
+GameServer::GameServer(const ServerConfig& config) :
+    Server(config),
     running(false)
 {}
 
@@ -2,6 +2,7 @@
 #define ROGUELIKE_GAME_SERVER_HPP_INCLUDED
 #include "Server.hpp"
 #include "Map.h"
+#include "../networking/ObjectDelta.hpp"
 #include <atomic>
 #include <thread>
 
@@ -12,6 +13,17 @@ class GameServer : private Server {
     // Levels in the game
     std::vector<Map> levels;
     
+    /// Recent object baselines of each level, to send deltas against
+    std::vector<ObjectHistory> objectHistories;
+    
+    /// Sequence of the last object baseline, of any level. Unique across
+    /// levels, so a baseline from another level is never mistaken for one of
+    /// the player's current level
+    uint64_t objectSequence = 0;
+    
+    /// Id for the next object that needs one
+    uint64_t nextObjectId = 1;
+    
     // Server thread
     std::thread thread;
     
@@ -25,7 +37,11 @@ class GameServer : private Server {
     void logic();
 public:
     /// Create a new server. Still needs to be started with GameServer::start
-    GameServer(uint16_t port);
+    GameServer(uint16_t port, WireFormat wireFormat = WireFormat::Fixed);
+    
+    /// Create a new server with a config, e.g. to set the backlog or use an
+    /// acceptor thread
+    GameServer(const ServerConfig& config);
     
     /// Destructor. Automatically stops the server but does not wait for the
     /// thread
@@ -36,6 +52,9 @@ public:
     
     /// Stop the server and wait for the thread to die
     void stop();
+    
+    /// Connect a client in the same process (see Server::connectLocal)
+    using Server::connectLocal;
 };
 
 #endif
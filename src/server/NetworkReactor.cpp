@@ -0,0 +1,241 @@
+#include "NetworkReactor.hpp"
+#include <chrono>
+#include <stdexcept>
+
+// Definition for the stop timeout, which is bound by reference
+const int NetworkReactor::stopTimeoutMs;
+
+NetworkReactor::NetworkReactor(WireFormat wireFormat, ReactorEvents& events, size_t maxQueuedBytes, size_t chunkSize, WriteQueueStats& writeStats) :
+    wireFormat(wireFormat),
+    events(events),
+    maxQueuedBytes(maxQueuedBytes),
+    chunkSize(chunkSize),
+    writeStats(writeStats),
+    running(true),
+    stopping(false),
+    playerCount(0)
+{
+    selector.addWait(SelectedEventType::Read, waker.reader);
+    thread = std::thread(&NetworkReactor::loop, this);
+}
+
+NetworkReactor::~NetworkReactor() {
+    stop();
+}
+
+void NetworkReactor::loop() {
+    std::chrono::steady_clock::time_point stopDeadline;
+    while(true) {
+        // When stopping, run the last commands and keep writing until
+        // everything is out or the deadline passes
+        if(!running) {
+            if(!stopping) {
+                runCommands();
+                beginStop();
+                stopDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(stopTimeoutMs);
+            }
+            if(outgoing.empty() || std::chrono::steady_clock::now() >= stopDeadline)
+                break;
+        }
+        
+        auto selected = selector.wait(stopping ? 100 : throttled.timeout(-1));
+        bool pushed = resumeThrottled();
+        for(auto it = selected.begin(); it != selected.end(); it++) {
+            if(it->socket == waker.reader) {
+                runCommands();
+                continue;
+            }
+            
+            // Players are their own user data. Skip players removed by a
+            // command earlier in this iteration
+            std::shared_ptr<Player> player = it->getUserData<Player>();
+            if(players.count(player) == 0)
+                continue;
+            
+            // Writes go first, so that a player disconnecting still gets what
+            // was queued for them
+            bool connected = true;
+            if(it->isOfType(SelectedEventType::Write))
+                connected = flush(player);
+            if(connected && it->isOfType(SelectedEventType::Read)) {
+                connected = receive(player);
+                pushed = true;
+            }
+            
+            // Let the game thread know, so it can forget the player
+            if(!connected) {
+                disconnect(player);
+                pushed = true;
+            }
+        }
+        
+        // One wake for everything pushed this iteration
+        if(pushed)
+            events.waker.wake();
+    }
+}
+
+void NetworkReactor::pushCommand(Command command) {
+    commands.push(std::move(command));
+    waker.wake();
+}
+
+void NetworkReactor::runCommands() {
+    // Clear before popping, so commands pushed from now on wake the reactor
+    // again
+    waker.clear();
+    
+    Command command;
+    while(commands.pop(command)) {
+        switch(command.type) {
+            case CommandType::Add:
+                players.insert(command.player);
+                selector.addWait(SelectedEventType::Read, command.player, command.player);
+                break;
+            case CommandType::Send:
+                {
+                    // Ignore players that disconnected in the meantime
+                    if(players.count(command.player) == 0)
+                        break;
+                    
+                    // Drop players that can't keep up, or whose connection broke
+                    WriteQueue& queue = outgoingQueue(command.player);
+                    if(!queue.append(command.queue) || !flush(command.player)) {
+                        disconnect(command.player);
+                        events.waker.wake();
+                    }
+                }
+                break;
+            case CommandType::Remove:
+                drop(command.player);
+                break;
+        }
+    }
+}
+
+WriteQueue& NetworkReactor::outgoingQueue(const std::shared_ptr<Player>& player) {
+    WriteQueue& queue = outgoing[player];
+    queue.maxBytes = maxQueuedBytes;
+    queue.chunkSize = chunkSize;
+    queue.wireFormat = wireFormat;
+    queue.stats = &writeStats;
+    return queue;
+}
+
+bool NetworkReactor::receive(const std::shared_ptr<Player>& player) {
+    std::deque<std::shared_ptr<ServerMessage> > messages;
+    WriteQueue pongs;
+    PlayerInput input = receivePlayerInput(player, wireFormat, messages, pongs);
+    for(auto it = messages.begin(); it != messages.end(); it++)
+        events.queue.push(ReactorEvent{player, std::move(*it)});
+    
+    // Send pongs without waiting for the next hand-off
+    if(input.answered && input.connected) {
+        if(!outgoingQueue(player).append(pongs) || !flush(player))
+            return false;
+    }
+    
+    // Stop reading from players over their rate limits until they can send
+    // again
+    if(input.throttleMs > 0 && input.connected) {
+        throttled.pause(player, input.throttleMs);
+        watch(player);
+    }
+    
+    return input.connected;
+}
+
+bool NetworkReactor::resumeThrottled() {
+    bool pushed = false;
+    std::vector<std::shared_ptr<Player> > resumed = throttled.popResumed();
+    for(auto it = resumed.begin(); it != resumed.end(); it++) {
+        watch(*it);
+        if(stopping)
+            continue;
+        
+        if(!receive(*it))
+            disconnect(*it);
+        pushed = true;
+    }
+    
+    return pushed;
+}
+
+void NetworkReactor::watch(const std::shared_ptr<Player>& player) {
+    int types = 0;
+    if(!stopping && !throttled.isPaused(player))
+        types |= SelectedEventType::Read;
+    if(outgoing.count(player) != 0)
+        types |= SelectedEventType::Write;
+    
+    selector.removeWait(player);
+    if(types != 0)
+        selector.addWait(types, player, player);
+}
+
+bool NetworkReactor::flush(const std::shared_ptr<Player>& player) {
+    auto it = outgoing.find(player);
+    if(it != outgoing.end()) {
+        // Write as much as the socket takes
+        WriteQueue& queue = it->second;
+        try {
+            player->link.bytesOut += queue.writeTo(*player);
+        }
+        catch(const SocketException&) {
+            return false;
+        }
+        
+        // Only wait for write events while bytes are left
+        if(queue.empty())
+            outgoing.erase(it);
+    }
+    
+    watch(player);
+    return true;
+}
+
+void NetworkReactor::drop(const std::shared_ptr<Player>& player) {
+    selector.removeWait(player);
+    players.erase(player);
+    outgoing.erase(player);
+    throttled.erase(player);
+}
+
+void NetworkReactor::disconnect(const std::shared_ptr<Player>& player) {
+    drop(player);
+    events.queue.push(ReactorEvent{player, nullptr});
+}
+
+void NetworkReactor::beginStop() {
+    stopping = true;
+    for(auto it = players.begin(); it != players.end(); it++)
+        watch(*it);
+}
+
+void NetworkReactor::add(const std::shared_ptr<Player>& player) {
+    playerCount++;
+    pushCommand(Command{CommandType::Add, player, WriteQueue()});
+}
+
+void NetworkReactor::send(const std::shared_ptr<Player>& player, WriteQueue& queue) {
+    Command command{CommandType::Send, player, WriteQueue()};
+    command.queue.append(queue);
+    pushCommand(std::move(command));
+}
+
+void NetworkReactor::remove(const std::shared_ptr<Player>& player) {
+    playerCount--;
+    pushCommand(Command{CommandType::Remove, player, WriteQueue()});
+}
+
+size_t NetworkReactor::size() const {
+    return playerCount;
+}
+
+void NetworkReactor::stop() {
+    if(thread.joinable()) {
+        running = false;
+        waker.wake();
+        thread.join();
+    }
+}
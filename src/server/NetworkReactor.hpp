@@ -0,0 +1,166 @@
+#ifndef ROGUELIKE_NETWORK_REACTOR_HPP_INCLUDED
+#define ROGUELIKE_NETWORK_REACTOR_HPP_INCLUDED
+#include "../networking/MpscQueue.hpp"
+#include "../networking/ServerMessage.hpp"
+#include "../networking/SocketSelector.hpp"
+#include "../networking/SpscQueue.hpp"
+#include "../networking/Waker.hpp"
+#include "Player.hpp"
+#include "PlayerInput.hpp"
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Something a reactor tells the game thread: a message from a player, or
+/// that the player disconnected
+struct ReactorEvent {
+    /// The player this event is about
+    std::shared_ptr<Player> player;
+    
+    /// Message received from the player, or nullptr if they disconnected
+    std::shared_ptr<ServerMessage> message;
+};
+
+/// Events from all reactors of a server, for the game thread. The waker is
+/// woken after events are pushed
+struct ReactorEvents {
+    MpscQueue<ReactorEvent> queue;
+    Waker waker;
+};
+
+/// A network thread that owns a subset of a server's player connections. It
+/// reads and parses their messages, pushing them to the game thread, and
+/// writes the bytes the game thread hands back. Only the game thread may call
+/// the public methods
+class NetworkReactor {
+    /// What the game thread asks a reactor to do
+    enum class CommandType {
+        /// Start handling a player
+        Add,
+        /// Write bytes to a player
+        Send,
+        /// Stop handling a player, dropping unsent bytes
+        Remove
+    };
+    
+    struct Command {
+        CommandType type;
+        std::shared_ptr<Player> player;
+        WriteQueue queue;
+    };
+    
+    /// Wire format used to parse messages
+    const WireFormat wireFormat;
+    
+    /// Where events go
+    ReactorEvents& events;
+    
+    /// Byte cap and fragment size of player write queues, and their counters
+    const size_t maxQueuedBytes, chunkSize;
+    WriteQueueStats& writeStats;
+    
+    /// Commands from the game thread, and the waker for them. The waker's
+    /// reader is in the selector without user data
+    SpscQueue<Command> commands;
+    Waker waker;
+    
+    /// Read events of the players of this reactor that aren't paused, and
+    /// write events of those with bytes left to write. Players are their own user data
+    SocketSelector selector;
+    
+    /// Players handled by this reactor, and messages not written yet per
+    /// player. Reactor thread only
+    std::unordered_set<std::shared_ptr<Player> > players;
+    std::unordered_map<std::shared_ptr<Player>, WriteQueue> outgoing;
+    
+    /// Players whose reading is paused by their rate limits. Reactor thread
+    /// only
+    ThrottledPlayers throttled;
+    
+    /// Reactor thread and whether it should keep running
+    std::thread thread;
+    std::atomic<bool> running;
+    
+    /// Whether the reactor stopped reading and is only writing what's left.
+    /// Reactor thread only
+    bool stopping;
+    
+    /// Amount of players handled, for balancing. Game thread only
+    size_t playerCount;
+    
+    /// Reactor thread loop
+    void loop();
+    
+    /// Push a command and wake the reactor
+    void pushCommand(Command command);
+    
+    /// Run all pending commands
+    void runCommands();
+    
+    /// Gets a player's outgoing queue, creating it if needed
+    WriteQueue& outgoingQueue(const std::shared_ptr<Player>& player);
+    
+    /// Read and parse what a player sent (see receivePlayerInput), pushing
+    /// their messages to the game thread and writing pongs straight away.
+    /// Players over their rate limits are paused. Returns false if they
+    /// disconnected
+    bool receive(const std::shared_ptr<Player>& player);
+    
+    /// Receive from players whose pause is over. Returns true if anything was
+    /// pushed to the game thread
+    bool resumeThrottled();
+    
+    /// Wait for the events a player needs: reads unless stopping or paused,
+    /// and writes while bytes are left
+    void watch(const std::shared_ptr<Player>& player);
+    
+    /// Write as much of a player's outgoing bytes as possible, waiting for
+    /// write events only while bytes are left. Returns false if the
+    /// connection broke
+    bool flush(const std::shared_ptr<Player>& player);
+    
+    /// Stop handling a player
+    void drop(const std::shared_ptr<Player>& player);
+    
+    /// Stop handling a player and tell the game thread they disconnected
+    void disconnect(const std::shared_ptr<Player>& player);
+    
+    /// Stop reading from all players, only waiting to write outgoing bytes
+    void beginStop();
+public:
+    /// Maximum time a stopping reactor keeps writing outgoing bytes
+    static const int stopTimeoutMs = 10000;
+    
+    /// Create a reactor and start its thread. Write queues get a byte cap and
+    /// fragment size (see ServerConfig::maxQueuedBytes and chunkSize) and
+    /// update the given counters
+    NetworkReactor(WireFormat wireFormat, ReactorEvents& events, size_t maxQueuedBytes, size_t chunkSize, WriteQueueStats& writeStats);
+    
+    /// Destructor. Stops the reactor
+    ~NetworkReactor();
+    
+    /// Reactors cannot be copied or copy-assigned
+    NetworkReactor(const NetworkReactor&) = delete;
+    NetworkReactor& operator=(const NetworkReactor&) = delete;
+    
+    /// Hand a player's connection to this reactor. The socket must be
+    /// non-blocking and must not be used by other threads from now on
+    void add(const std::shared_ptr<Player>& player);
+    
+    /// Move everything in a write queue to the reactor's queue for a player
+    /// of this reactor. A player going over the byte cap is disconnected
+    void send(const std::shared_ptr<Player>& player, WriteQueue& queue);
+    
+    /// Stop handling a player of this reactor
+    void remove(const std::shared_ptr<Player>& player);
+    
+    /// Amount of players handled by this reactor
+    size_t size() const;
+    
+    /// Stop the thread, after writing outgoing bytes for at most
+    /// stopTimeoutMs, and wait for it to die
+    void stop();
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include "Object.h"
 
 
-char Object::get_char()
+char Object::get_char() const
 {
 	return m_character;
 }
@@ -16,7 +16,7 @@ bool Object::get_visibility() const
 	return m_visibility;
 }
 
-Texture Object::get_texture() const
+const Texture& Object::get_texture() const
 {
 	return m_texture;
 }
@@ -36,6 +36,16 @@ ObjectType Object::get_type() const
     return m_type;
 }
 
+uint64_t Object::get_id() const
+{
+    return m_id;
+}
+
+void Object::set_id(uint64_t id)
+{
+    m_id = id;
+}
+
 
 void Object::move(const Direction dir)
 {
@@ -1,5 +1,6 @@
 #ifndef ROGUELIKE_OBJECT_H_INCLUDED
 #define ROGUELIKE_OBJECT_H_INCLUDED
+#include <cstdint>
 #include <utility>
 #include "../client/Formatting.hpp"
 #include "../client/Texture.h"
@@ -40,7 +41,7 @@ public:
 	Object() : 
 		Object('x') {}
 
-	char get_char();
+	char get_char() const;
 
 	Formating get_formating() const;
 
@@ -48,11 +49,17 @@ public:
 
 	std::pair<long, long> get_position() const;
 
-	Texture get_texture() const;
+	const Texture& get_texture() const;
     
     Direction get_direction() const;
     
     ObjectType get_type() const;
+    
+    // Id used to tell objects apart over the network. 0 until the server
+    // gives the object one
+    uint64_t get_id() const;
+    
+    void set_id(uint64_t id);
 
 	virtual void move(const Direction dir);
 
@@ -78,6 +85,8 @@ protected:
 	Texture m_texture;
     // Type of object
     ObjectType m_type;
+    // Network id of object
+    uint64_t m_id = 0;
 };
 
 #endif
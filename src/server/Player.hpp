@@ -3,20 +3,48 @@
 #include "../networking/Socket.hpp"
 #include "../networking/Buffer.hpp"
 #include "../networking/Action.hpp"
+#include "../networking/InputLimiter.hpp"
+#include "../networking/LinkStats.hpp"
+#include "../networking/SnapshotChannel.hpp"
+#include "../networking/WriteQueue.hpp"
 #include "Inventory.h"
 #include "Object.h"
 #include "Map.h"
 #include <vector>
 
+// LocalChannel.hpp and NetworkReactor.hpp include this file
+class LocalChannel;
+class NetworkReactor;
+
 /// A player that is connected to a server. A player _IS_ a socket, since it
 /// cannot exist without a connection
 struct Player : Socket, Object {
-    /// Read/write buffers for network messages
-    Buffer rBuffer, wBuffer;
+    /// Read buffer for network messages
+    Buffer rBuffer;
+    
+    /// Messages waiting to be written to the player
+    WriteQueue writeQueue;
+    
+    /// Limits on what the player may send, and how often they went over them
+    InputLimiter inputLimiter;
+    
+    /// Traffic and round trip times of the player's connection
+    LinkStats link;
     
     /// The player's name. If empty, they haven't joined yet
     std::string name;
     
+    /// The player's end of the snapshot channel, if they asked for one
+    SnapshotEndpoint snapshotEndpoint;
+    
+    /// In-process connection of a local player (see Server::connectLocal).
+    /// Local players have an invalid socket and empty buffers
+    std::shared_ptr<LocalChannel> localChannel;
+    
+    /// Reactor thread that owns this player's socket and read buffer, if the
+    /// server has reactor threads. nullptr once disconnected
+    NetworkReactor* reactor = nullptr;
+    
     /// Constructor. Needs a socket. The socket is moved to the player, so the
     /// original instance is invalidated (as in, the source Socket's raw socket
     /// is invalidated, the source Socket instance is not destroyed)
@@ -27,6 +55,10 @@ struct Player : Socket, Object {
     
     /// Action the player will take this turn
     std::unique_ptr<Action> action = nullptr;
+    
+    /// Sequence of the last object baseline the player confirmed having (see
+    /// ObjectHistory). 0 for none, so they get the whole level
+    uint64_t objectBaseline = 0;
 
 	
     int health;
@@ -0,0 +1,124 @@
+#include "PlayerInput.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+PlayerInput receivePlayerInput(const std::shared_ptr<Player>& player, WireFormat wireFormat, std::deque<std::shared_ptr<ServerMessage> >& messages, WriteQueue& pongs) {
+    PlayerInput input;
+    try {
+        // While throttled, the messages already buffered go first, so the
+        // buffer doesn't grow while reading is paused
+        Buffer& rBuffer = player->rBuffer;
+        InputLimiter& limiter = player->inputLimiter;
+        if(!limiter.isThrottled()) {
+            // Read available data straight into the player's read buffer
+            size_t buffered = rBuffer.size();
+            input.connected = player->readInto(rBuffer);
+            player->link.received(rBuffer.size() - buffered);
+        }
+        
+        // Build as many messages as possible
+        while(true) {
+            // Messages bigger than allowed are refused as soon as their header
+            // arrives, instead of waiting for their body
+            if(!limiter.checkHeader(rBuffer, wireFormat)) {
+                input.connected = false;
+                break;
+            }
+            
+            // Stop once there is no full message left
+            MessageHeader header;
+            if(!peekHeader(rBuffer, wireFormat, header) || rBuffer.size() < header.size + header.bodySize)
+                break;
+            
+            // Messages over the rate limits stay in the buffer until the
+            // limits let them through, or disconnect the player
+            if(!limiter.admit(header.size + header.bodySize)) {
+                if(limiter.getAction() == InputLimitAction::Disconnect)
+                    input.connected = false;
+                else
+                    input.throttleMs = limiter.waitMs();
+                break;
+            }
+            
+            size_t available = rBuffer.size();
+            std::unique_ptr<ServerMessage> message = ServerMessage::fromBuffer(rBuffer, player, wireFormat);
+            if(rBuffer.size() == available)
+                break;
+            player->link.messagesIn++;
+            
+            // Unknown or invalid messages are skipped
+            if(!message)
+                continue;
+            
+            switch(message->type) {
+                case GameMessageType::DoPing:
+                    player->link.messagesOut++;
+                    if(!pongs.push(GameMessageType::Pong, ClientMessagePong(static_cast<ServerMessageDoPing*>(message.get())->timestamp).toBytes(wireFormat))) {
+                        input.connected = false;
+                        return input;
+                    }
+                    input.answered = true;
+                    break;
+                case GameMessageType::DoPong:
+                    player->link.addPong(static_cast<ServerMessageDoPong*>(message.get())->timestamp);
+                    break;
+                default:
+                    messages.push_back(std::move(message));
+                    break;
+            }
+        }
+    }
+    catch(const SocketException&) {
+        input.connected = false;
+    }
+    catch(const std::invalid_argument&) {
+        // Malformed header, the stream can't be framed anymore
+        input.connected = false;
+    }
+    
+    return input;
+}
+
+void ThrottledPlayers::pause(const std::shared_ptr<Player>& player, int delayMs) {
+    resumeTimes[player] = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+}
+
+void ThrottledPlayers::erase(const std::shared_ptr<Player>& player) {
+    resumeTimes.erase(player);
+}
+
+bool ThrottledPlayers::isPaused(const std::shared_ptr<Player>& player) const {
+    return resumeTimes.count(player) != 0;
+}
+
+std::vector<std::shared_ptr<Player> > ThrottledPlayers::popResumed() {
+    std::vector<std::shared_ptr<Player> > resumed;
+    auto now = std::chrono::steady_clock::now();
+    for(auto it = resumeTimes.begin(); it != resumeTimes.end();) {
+        if(it->second <= now) {
+            resumed.push_back(it->first);
+            it = resumeTimes.erase(it);
+        }
+        else
+            it++;
+    }
+    
+    return resumed;
+}
+
+int ThrottledPlayers::timeout(int timeoutMs) const {
+    if(resumeTimes.empty())
+        return timeoutMs;
+    
+    auto first = resumeTimes.begin()->second;
+    for(auto it = resumeTimes.begin(); it != resumeTimes.end(); it++)
+        first = std::min(first, it->second);
+    
+    // Rounded up, so the pause is over when the wait ends
+    auto now = std::chrono::steady_clock::now();
+    int untilFirst = 0;
+    if(first > now)
+        untilFirst = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(first - now).count()) + 1;
+    
+    return timeoutMs < 0 ? untilFirst : std::min(timeoutMs, untilFirst);
+}
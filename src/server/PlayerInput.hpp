@@ -0,0 +1,62 @@
+#ifndef ROGUELIKE_PLAYER_INPUT_HPP_INCLUDED
+#define ROGUELIKE_PLAYER_INPUT_HPP_INCLUDED
+#include "../networking/ServerMessage.hpp"
+#include "../networking/WriteQueue.hpp"
+#include "Player.hpp"
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/// What receivePlayerInput did with a player's input
+struct PlayerInput {
+    /// Whether the player is still connected. False if their connection
+    /// closed or broke, their stream can't be framed anymore, or they went
+    /// over their input limits in a way that disconnects them
+    bool connected = true;
+    
+    /// Whether pongs were queued, so they should be written without waiting
+    /// for the game loop
+    bool answered = false;
+    
+    /// If the player went over their rate limits, the time until they let the
+    /// next message through, in milliseconds. Reading should pause for that
+    /// long; the message is left in the player's read buffer. 0 otherwise
+    int throttleMs = 0;
+};
+
+/// Read what a player sent and parse as many messages as possible, enforcing
+/// the player's input limits. While the player is throttled, only messages
+/// already in their read buffer are parsed, and nothing is read. Used by
+/// Server and NetworkReactor alike, on the thread that owns the player's
+/// socket. Pings are answered by pushing pongs to pongs, and pongs are
+/// measured, so round trip times don't include the game loop; neither is
+/// added to messages. Everything else, including DoSnapshotChannel, is.
+/// Messages sent just before the player disconnected are still added
+PlayerInput receivePlayerInput(const std::shared_ptr<Player>& player, WireFormat wireFormat, std::deque<std::shared_ptr<ServerMessage> >& messages, WriteQueue& pongs);
+
+/// Players whose reading is paused because they went over their rate limits,
+/// and when to resume it. While paused, their unread data stays in the
+/// kernel's buffers, so TCP slows them down. Used by the thread that owns
+/// their sockets
+class ThrottledPlayers {
+    std::unordered_map<std::shared_ptr<Player>, std::chrono::steady_clock::time_point> resumeTimes;
+public:
+    /// Pause reading from a player for delayMs milliseconds
+    void pause(const std::shared_ptr<Player>& player, int delayMs);
+    
+    /// Forget a player, e.g. when they disconnect
+    void erase(const std::shared_ptr<Player>& player);
+    
+    /// Check if reading from a player is paused
+    bool isPaused(const std::shared_ptr<Player>& player) const;
+    
+    /// Take out the players whose pause is over
+    std::vector<std::shared_ptr<Player> > popResumed();
+    
+    /// Get the timeout for waiting on a selector: timeoutMs, or less if a
+    /// pause ends before. Negative timeouts wait forever
+    int timeout(int timeoutMs) const;
+};
+
+#endif
@@ -1,161 +1,540 @@
-#include "../networking/SocketSelector.hpp"
 #include "Server.hpp"
 #include <unordered_map>
 #include <chrono>
+#include <stdexcept>
 
-Server::Server(uint16_t port) :
+Server::Server(uint16_t port, WireFormat wireFormat) :
+    Server(ServerConfig(port, wireFormat))
+{}
+
+Server::Server(const ServerConfig& config) :
     // Create socket
-    listenSocket(AF_INET, SOCK_STREAM, 0)
+    listenSocket(new Socket(AF_INET, SOCK_STREAM, 0)),
+    tokenGenerator(std::random_device()()),
+    profile(config.profile),
+    maxQueuedBytes(config.maxQueuedBytes),
+    chunkSize(config.chunkSize),
+    inputLimits(config.inputLimits),
+    pingIntervalMs(config.pingIntervalMs),
+    idleTimeoutMs(config.idleTimeoutMs),
+    acceptorRunning(false),
+    wireFormat(config.wireFormat)
 {
     // Bind socket to all addresses and given port
-    listenSocket.bind(AF_INET, port);
+    listenSocket->bind(AF_INET, config.port);
     
-    // Mark socket as a passive listening socket, using a maximum of 16 pending
-    // connections
-    listenSocket.listen(16);
+    // Mark socket as a passive listening socket, with the configured maximum
+    // of pending connections
+    listenSocket->listen(config.backlog);
     
     // Mark listening socket as non-blocking
-    listenSocket.setBlocking(false);
+    listenSocket->setBlocking(false);
+    
+    // Accept either in a dedicated thread, or when the listening socket is
+    // selected in receive
+    if(config.acceptorThread) {
+        acceptorRunning = true;
+        acceptor = std::thread(&Server::acceptLoop, this);
+    }
+    else
+        readSelector.addWait(SelectedEventType::Read, listenSocket);
+    readSelector.addWait(SelectedEventType::Read, acceptedWaker.reader);
+    
+    // Open the snapshot channel's UDP socket on the same port
+    if(config.snapshotChannel) {
+        snapshotSocket = std::shared_ptr<Socket>(new Socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+        snapshotSocket->bind(AF_INET, config.port);
+        snapshotSocket->setBlocking(false);
+        readSelector.addWait(SelectedEventType::Read, snapshotSocket);
+    }
+    
+    // Start reactor threads. The game thread waits for their events along
+    // with everything else
+    for(int i = 0; i < config.reactorThreads; i++)
+        reactors.emplace_back(new NetworkReactor(wireFormat, reactorEvents, maxQueuedBytes, chunkSize, writeStats));
+    if(!reactors.empty())
+        readSelector.addWait(SelectedEventType::Read, reactorEvents.waker.reader);
 }
 
 Server::~Server() {
     close();
 }
 
-std::deque<std::shared_ptr<ServerMessage> > Server::receive(int timeoutMs) {
-    // Accept connections from listening socket. New socket is blocking
-    auto newSocket = listenSocket.accept();
+void Server::acceptPending(std::deque<std::unique_ptr<Socket> >& sockets) {
+    try {
+        // Drain the backlog. New sockets are already non-blocking
+        while(true) {
+            auto newSocket = listenSocket->accept(true);
+            if(newSocket == nullptr)
+                break;
+            sockets.push_back(std::move(newSocket));
+        }
+    }
+    catch(const SocketException&) {
+        // Out of file descriptors or the listening socket was closed. Keep
+        // what was accepted; anything left is retried on the next call
+    }
+}
+
+void Server::acceptLoop() {
+    // Wait for connections with a selector of its own, so the game thread's
+    // selectors are never touched from here. The timeout bounds how long
+    // stopping the acceptor takes
+    SocketSelector acceptSelector;
+    acceptSelector.addWait(SelectedEventType::Read, listenSocket);
     
-    if(newSocket != nullptr) {
-        // Mark new socket as non-blocking
-        newSocket->setBlocking(false);
+    std::deque<std::unique_ptr<Socket> > sockets;
+    while(acceptorRunning) {
+        if(acceptSelector.wait(100).empty())
+            continue;
+        
+        acceptPending(sockets);
+        if(sockets.empty())
+            continue;
         
+        // Hand the new sockets to the game thread, and wake it
+        {
+            std::lock_guard<std::mutex> lock(acceptedLock);
+            for(auto it = sockets.begin(); it != sockets.end(); it++)
+                acceptedSockets.push_back(std::move(*it));
+            sockets.clear();
+        }
+        acceptedWaker.wake();
+    }
+}
+
+void Server::addAccepted() {
+    // Clear before taking, so anything added from now on wakes the game thread
+    // again
+    acceptedWaker.clear();
+    
+    std::deque<std::unique_ptr<Socket> > newSockets;
+    std::deque<std::shared_ptr<LocalChannel> > newChannels;
+    {
+        std::lock_guard<std::mutex> lock(acceptedLock);
+        newSockets.swap(acceptedSockets);
+        newChannels.swap(acceptedChannels);
+    }
+    addPlayers(newSockets);
+    addLocalPlayers(newChannels);
+}
+
+void Server::addPlayers(std::deque<std::unique_ptr<Socket> >& sockets) {
+    for(auto it = sockets.begin(); it != sockets.end(); it++) {
         // Create new player. Move ownership of socket to new player
-        players.emplace_back(new Player(newSocket.get()));
+        std::shared_ptr<Player> player(new Player(it->get()));
+        player->writeQueue.maxBytes = maxQueuedBytes;
+        player->writeQueue.chunkSize = chunkSize;
+        player->writeQueue.wireFormat = wireFormat;
+        player->writeQueue.stats = &writeStats;
+        player->inputLimiter.setLimits(inputLimits);
+        players.push_back(player);
+        
+        // Apply socket options. If this fails, the player keeps the default
+        // ones
+        try {
+            player->applyProfile(profile);
+        }
+        catch(SocketException) {};
+        
+        // Hand the connection to the reactor with the fewest players, or wait
+        // for reads from this player here until they disconnect
+        if(!reactors.empty()) {
+            NetworkReactor* reactor = reactors.front().get();
+            for(auto reactorIt = reactors.begin(); reactorIt != reactors.end(); reactorIt++) {
+                if((*reactorIt)->size() < reactor->size())
+                    reactor = reactorIt->get();
+            }
+            
+            player->reactor = reactor;
+            reactor->add(player);
+        }
+        else
+            readSelector.addWait(SelectedEventType::Read, player, player);
     }
+    sockets.clear();
+}
+
+void Server::receiveReactorEvents(std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    // Clear before popping, so events pushed from now on wake this thread
+    // again
+    reactorEvents.waker.clear();
     
-    // Select read events from players
-    SocketSelector selector;
-    for(auto it = players.begin(); it != players.end(); it++)
-        selector.addWait(SelectedEventType::Read, *it);
+    ReactorEvent event;
+    while(reactorEvents.queue.pop(event)) {
+        // Drop events of players that were disconnected in the meantime
+        std::shared_ptr<Player>& player = event.player;
+        if(player->reactor == nullptr)
+            continue;
+        
+        if(event.message == nullptr) {
+            if(!player->name.empty())
+                messages.push_back(std::shared_ptr<ServerMessage>(new ServerMessageDoQuit(player)));
+            disconnectPlayer(player);
+        }
+        else
+            handleMessage(event.message, messages);
+    }
+}
+
+void Server::handleMessage(const std::shared_ptr<ServerMessage>& message, std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    // Snapshot channels are handled here, not by the game
+    if(message->type == GameMessageType::DoSnapshotChannel)
+        openSnapshotChannel(message->sender);
+    else
+        messages.push_back(message);
+}
+
+void Server::addLocalPlayers(std::deque<std::shared_ptr<LocalChannel> >& channels) {
+    for(auto it = channels.begin(); it != channels.end(); it++) {
+        // Local players have no socket
+        Socket noSocket;
+        std::shared_ptr<Player> player(new Player(&noSocket));
+        player->localChannel = *it;
+        players.push_back(player);
+        
+        // Wait for messages from this player until they disconnect
+        readSelector.addWait(SelectedEventType::Read, (*it)->toServer.waker.reader, player);
+    }
+    channels.clear();
+}
+
+bool Server::receiveLocal(const std::shared_ptr<Player>& player, std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    // Check before popping, so messages queued just before closing aren't
+    // lost
+    bool open = !player->localChannel->isClosed();
     
-    auto events = selector.wait(timeoutMs);
+    std::deque<std::unique_ptr<ClientMessage> > received;
+    player->localChannel->toServer.pop(received);
+    for(auto it = received.begin(); it != received.end(); it++) {
+        std::shared_ptr<ServerMessage> message = ServerMessage::fromClient(**it, player);
+        
+        // Local players have no use for a snapshot channel
+        if(message && message->type != GameMessageType::DoSnapshotChannel)
+            messages.push_back(message);
+    }
     
-    // Parse events for players
-    std::deque<std::shared_ptr<ServerMessage> > messages;
-    if(events.empty())
-        return messages;
+    return open;
+}
+
+void Server::connectLocal(std::shared_ptr<LocalChannel> channel) {
+    {
+        std::lock_guard<std::mutex> lock(acceptedLock);
+        acceptedChannels.push_back(channel);
+    }
+    acceptedWaker.wake();
+}
+
+void Server::stopAcceptor() {
+    if(acceptor.joinable()) {
+        acceptorRunning = false;
+        acceptor.join();
+    }
+}
+
+void Server::openSnapshotChannel(const std::shared_ptr<Player>& player) {
+    uint32_t token = 0;
+    if(snapshotSocket != nullptr && snapshotSocket->isValid()) {
+        // Tokens are random, so hellos can't easily be forged, and unique
+        // among players, so hellos are never ambiguous
+        bool unique;
+        do {
+            token = tokenGenerator();
+            unique = token != 0;
+            for(auto it = players.begin(); unique && it != players.end(); it++)
+                unique = (*it)->snapshotEndpoint.token != token;
+        } while(!unique);
+    }
     
-    for(auto it = events.begin(); it != events.end(); it++) {
-        // We know we passed players to the selector, so this is safe
-        std::shared_ptr<Player> thisPlayer = std::dynamic_pointer_cast<Player>(it->socket);
-        
-        // Add data to player's read buffer
-        std::vector<uint8_t> readBuf;
-        if(!thisPlayer->read(readBuf)) {
-            // Disconnect player if read tells it should
-            if(!thisPlayer->name.empty())
-                messages.push_back(std::shared_ptr<ServerMessage>(new ServerMessageDoQuit(thisPlayer)));
-            disconnectPlayer(thisPlayer);
-        }
-        else if(!readBuf.empty()) {
-            // Append read data to buffer
-            Buffer& rBuffer = thisPlayer->rBuffer;
-            rBuffer.insert(readBuf);
+    player->snapshotEndpoint = SnapshotEndpoint();
+    player->snapshotEndpoint.token = token;
+    addMessage(ClientMessageSnapshotChannel(token), player);
+}
+
+void Server::receiveHellos() {
+    std::vector<uint8_t> datagram;
+    IN_ADDR address;
+    uint16_t port;
+    try {
+        while(snapshotSocket->receiveFrom(datagram, address, port)) {
+            // Ignore anything that isn't a hello
+            Buffer buffer;
+            buffer.insert(datagram);
+            DatagramHeader header;
+            if(!popDatagramHeader(buffer, header) || header.kind != DatagramKind::Hello || header.value == 0)
+                continue;
             
-            // Check if a message can be built from the current read buffer.
-            // Try to build as many messages as possible
-            while(true) {
-                std::unique_ptr<ServerMessage> message = ServerMessage::fromBuffer(rBuffer, thisPlayer);
-                
-                if(!message)
-                    break;
+            // Connect the player with this token. The address is updated if it
+            // changes, e.g. when a NAT picks a new port
+            for(auto it = players.begin(); it != players.end(); it++) {
+                SnapshotEndpoint& endpoint = (*it)->snapshotEndpoint;
+                if(endpoint.token != header.value)
+                    continue;
                 
-                // std::move used to transfer ownership to vector
-                messages.push_back(std::move(message));
+                endpoint.connected = true;
+                endpoint.address = address;
+                endpoint.port = port;
+                snapshotSocket->sendTo(helloDatagram(header.value), address, port);
+                break;
             }
         }
     }
+    catch(const SocketException&) {
+        // Errors on a UDP socket (e.g. ICMP errors from an earlier datagram)
+        // don't affect other datagrams. Try again next time
+    }
+}
+
+void Server::receivePlayer(const std::shared_ptr<Player>& player, std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    // Local players pass messages as objects
+    bool disconnect;
+    if(player->localChannel != nullptr)
+        disconnect = !receiveLocal(player, messages);
+    else {
+        // Parse what the player sent. Pongs are written straight away, so
+        // round trip times don't include the wait for sendMessages
+        std::deque<std::shared_ptr<ServerMessage> > received;
+        PlayerInput input = receivePlayerInput(player, wireFormat, received, player->writeQueue);
+        for(auto it = received.begin(); it != received.end(); it++)
+            handleMessage(*it, messages);
+        
+        disconnect = !input.connected;
+        if(input.answered && !disconnect && !writeSelector.isWaiting(player))
+            flushPlayer(player);
+        
+        // Stop reading from players over their rate limits until they can
+        // send again
+        if(input.throttleMs > 0 && !disconnect) {
+            readSelector.removeWait(player);
+            throttled.pause(player, input.throttleMs);
+        }
+    }
+    
+    // Disconnect player if read tells it should, or if their stream is broken
+    if(disconnect) {
+        if(!player->name.empty())
+            messages.push_back(std::shared_ptr<ServerMessage>(new ServerMessageDoQuit(player)));
+        disconnectPlayer(player);
+    }
+}
+
+void Server::resumeThrottled(std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    std::vector<std::shared_ptr<Player> > resumed = throttled.popResumed();
+    for(auto it = resumed.begin(); it != resumed.end(); it++) {
+        readSelector.addWait(SelectedEventType::Read, *it, *it);
+        receivePlayer(*it, messages);
+    }
+}
+
+std::deque<std::shared_ptr<ServerMessage> > Server::receive(int timeoutMs) {
+    // Add players accepted by the acceptor thread or connected locally since
+    // the last call
+    addAccepted();
+    
+    // Drop players that couldn't keep up since the last call, or went quiet,
+    // and ping the rest
+    std::deque<std::shared_ptr<ServerMessage> > messages;
+    disconnectOverflowed(messages);
+    checkLinks(messages);
+    
+    // Select read events from players, waking up in time for throttled
+    // players
+    auto events = readSelector.wait(throttled.timeout(timeoutMs));
+    resumeThrottled(messages);
+    
+    // Parse events for players
+    for(auto it = events.begin(); it != events.end(); it++) {
+        // Accept every pending connection at once, instead of one per call.
+        // New players are read from on the next call
+        if(it->socket == listenSocket) {
+            std::deque<std::unique_ptr<Socket> > newSockets;
+            acceptPending(newSockets);
+            addPlayers(newSockets);
+            continue;
+        }
+        
+        // Players accepted or connected locally while waiting. Read from on
+        // the next call
+        if(it->socket == acceptedWaker.reader) {
+            addAccepted();
+            continue;
+        }
+        
+        // Snapshot channel hellos
+        if(it->socket == snapshotSocket) {
+            receiveHellos();
+            continue;
+        }
+        
+        // Messages and disconnections from reactor threads
+        if(it->socket == reactorEvents.waker.reader) {
+            receiveReactorEvents(messages);
+            continue;
+        }
+        
+        // Players are their own user data
+        receivePlayer(it->getUserData<Player>(), messages);
+    }
     
     return messages;
 }
 
+void Server::queueMessage(const ClientMessage& message, Payload& payload, const std::shared_ptr<Player>& player, bool state) {
+    if(player->localChannel != nullptr) {
+        player->localChannel->toClient.push(message.clone());
+        return;
+    }
+    
+    // Overflowing queues are disconnected on the next receive
+    player->link.messagesOut++;
+    if(!payload)
+        payload = makePayload(message.toBytes(wireFormat));
+    if(state)
+        player->writeQueue.pushState(message.type, payload);
+    else
+        player->writeQueue.push(message.type, payload);
+}
+
+void Server::disconnectOverflowed(std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    std::vector<std::shared_ptr<Player> > overflowed;
+    for(auto it = players.begin(); it != players.end(); it++) {
+        if((*it)->writeQueue.isOverflowed())
+            overflowed.push_back(*it);
+    }
+    
+    for(auto it = overflowed.begin(); it != overflowed.end(); it++) {
+        if(!(*it)->name.empty())
+            messages.push_back(std::shared_ptr<ServerMessage>(new ServerMessageDoQuit(*it)));
+        disconnectPlayer(*it);
+    }
+}
+
+void Server::checkLinks(std::deque<std::shared_ptr<ServerMessage> >& messages) {
+    if(pingIntervalMs <= 0 && idleTimeoutMs <= 0)
+        return;
+    
+    uint64_t now = monotonicMicroseconds();
+    std::vector<std::shared_ptr<Player> > idle;
+    for(auto it = players.begin(); it != players.end(); it++) {
+        // Local players have no link to check
+        if((*it)->localChannel != nullptr)
+            continue;
+        
+        LinkStats& link = (*it)->link;
+        if(idleTimeoutMs > 0 && link.idleTime(now) > static_cast<uint64_t>(idleTimeoutMs) * 1000)
+            idle.push_back(*it);
+        else if(pingIntervalMs > 0 && link.pingDue(now, pingIntervalMs)) {
+            addMessage(ClientMessagePing(now), *it);
+            
+            // Send it straight away, along with anything queued before, so
+            // the round trip time doesn't include the wait for sendMessages
+            if((*it)->reactor != nullptr)
+                (*it)->reactor->send(*it, (*it)->writeQueue);
+            else if(!writeSelector.isWaiting(*it))
+                flushPlayer(*it);
+        }
+    }
+    
+    for(auto it = idle.begin(); it != idle.end(); it++) {
+        if(!(*it)->name.empty())
+            messages.push_back(std::shared_ptr<ServerMessage>(new ServerMessageDoQuit(*it)));
+        disconnectPlayer(*it);
+    }
+}
+
 void Server::addMessage(const ClientMessage& message, std::shared_ptr<Player> player) {
-    auto bytes = message.toBytes();
-    player->wBuffer.insert(bytes);
+    Payload payload;
+    queueMessage(message, payload, player);
 }
 
 void Server::addMessageAllExcept(const ClientMessage& message, std::shared_ptr<Player> player) {
-    auto bytes = message.toBytes();
+    Payload payload;
     for(auto it = players.begin(); it != players.end(); it++) {
         if(*it != player) // TODO is the socket comparison operator called here?
-            (*it)->wBuffer.insert(bytes);
+            queueMessage(message, payload, *it);
     }
 }
 
 void Server::addMessageAll(const ClientMessage& message) {
-    auto bytes = message.toBytes();
+    Payload payload;
     for(auto it = players.begin(); it != players.end(); it++)
-        (*it)->wBuffer.insert(bytes);
+        queueMessage(message, payload, *it);
+}
+
+void Server::sendSnapshot(const ClientMessage& message, Payload& payload, const std::shared_ptr<Player>& player) {
+    SnapshotEndpoint& endpoint = player->snapshotEndpoint;
+    if(!endpoint.connected) {
+        queueMessage(message, payload, player, true);
+        return;
+    }
+    
+    if(!payload)
+        payload = makePayload(message.toBytes(wireFormat));
+    if(payload->size() > maxSnapshotSize) {
+        queueMessage(message, payload, player, true);
+        return;
+    }
+    
+    // Snapshots are unreliable, so a full send queue or a send error just
+    // loses this one
+    try {
+        snapshotSocket->sendTo(snapshotDatagram(++endpoint.sequence, *payload), endpoint.address, endpoint.port);
+    }
+    catch(const SocketException&) {}
+}
+
+void Server::addSnapshot(const ClientMessage& message, std::shared_ptr<Player> player) {
+    Payload payload;
+    sendSnapshot(message, payload, player);
+}
+
+void Server::addSnapshotAll(const ClientMessage& message) {
+    Payload payload;
+    for(auto it = players.begin(); it != players.end(); it++)
+        sendSnapshot(message, payload, *it);
 }
 
 bool Server::sendMessages(int timeoutMs) {
-    // Merge buffers. Map players to merged buffers and sent bytes total
-    std::unordered_map<std::shared_ptr<Player>, size_t> allSent;
-    std::unordered_map<std::shared_ptr<Player>, std::vector<uint8_t>> allBytes;
-    for(auto it = players.begin(); it != players.end(); it++) {
-        if((*it)->wBuffer.size() == 0)
-            continue;
+    // With reactor threads, hand the buffered bytes to each player's reactor,
+    // which writes them as soon as the socket allows
+    if(!reactors.empty()) {
+        for(auto it = players.begin(); it != players.end(); it++) {
+            if((*it)->reactor != nullptr && !(*it)->writeQueue.empty())
+                (*it)->reactor->send(*it, (*it)->writeQueue);
+        }
         
-        // Add to bytes to send
-        std::vector<uint8_t> thisBuffer;
-        (*it)->wBuffer.get(thisBuffer, (*it)->wBuffer.size());
-        allSent[*it] = 0;
-        allBytes[*it] = std::move(thisBuffer);
+        return true;
+    }
+    
+    // Write to every player straight away, except those whose socket was
+    // full last time; those are only written to once it is writable again
+    for(auto it = players.begin(); it != players.end(); it++) {
+        if(!(*it)->writeQueue.empty() && !writeSelector.isWaiting(*it))
+            flushPlayer(*it);
     }
     
-    // Abort if all buffers were empty
-    if(allBytes.empty())
-        return true;
-        
     // Setup timer
     std::chrono::time_point<std::chrono::high_resolution_clock> start;
     if(timeoutMs > 0)
         start = std::chrono::high_resolution_clock::now();
     int elapsed = 0;
     
-    // Poll for the ability to write and then send, for ALL buffered sockets
-    while(!allBytes.empty()) {
-        // Select write events
-        SocketSelector selector;
-        for(auto it = allBytes.begin(); it != allBytes.end(); it++)
-            selector.addWait(SelectedEventType::Write, it->first);
+    // Write to waiting players as their sockets become writable. With a
+    // timeout of 0, this only checks once
+    bool allSent;
+    while(true) {
+        auto events = writeSelector.wait(timeoutMs < 0 ? -1 : timeoutMs - elapsed);
         
-        auto events = selector.wait(timeoutMs - elapsed);
+        // Players are their own user data
+        for(auto it = events.begin(); it != events.end(); it++)
+            flushPlayer(it->getUserData<Player>());
         
-        // Start sending
-        for(auto it = events.begin(); it != events.end(); it++) {
-            // We know we passed players to the selector, so this is safe
-            std::shared_ptr<Player> thisPlayer = std::dynamic_pointer_cast<Player>(it->socket);
-            
-            // Send data
-            size_t& sent = allSent[thisPlayer];
-            std::vector<uint8_t>& bytes = allBytes[thisPlayer];
-            size_t bytesWritten = thisPlayer->write(bytes.begin() + sent, bytes.size() - sent);
-            sent += bytesWritten;
-            
-            // Erase written bytes
-            thisPlayer->wBuffer.erase(bytesWritten);
-            
-            // Remove from bytes list if all sent
-            if(bytes.size() == sent) {
-                allBytes.erase(thisPlayer);
-                allSent.erase(thisPlayer);
-            }
-        }
+        allSent = true;
+        for(auto it = players.begin(); allSent && it != players.end(); it++)
+            allSent = (*it)->writeQueue.empty();
         
-        // Stop sending if timeout exceeded
-        if(timeoutMs == 0)
+        // Stop sending if all sent or timeout exceeded
+        if(allSent || timeoutMs == 0)
             break;
         else if(timeoutMs != -1) {
             auto end = std::chrono::high_resolution_clock::now();
@@ -165,10 +544,44 @@ bool Server::sendMessages(int timeoutMs) {
         }
     }
     
-    return allBytes.empty();
+    return allSent;
+}
+
+void Server::flushPlayer(const std::shared_ptr<Player>& player) {
+    try {
+        player->link.bytesOut += player->writeQueue.writeTo(*player);
+    }
+    catch(const SocketException&) {
+        // Broken connection. Nothing more can be sent; reading from the player
+        // reports the disconnection
+        player->writeQueue.clear();
+    }
+    
+    // Wait for the socket to be writable only while data is left
+    if(!player->writeQueue.empty())
+        writeSelector.addWait(SelectedEventType::Write, player, player);
+    else
+        writeSelector.removeWait(player);
 }
 
 void Server::disconnectPlayer(std::shared_ptr<Player> player) {
+    readSelector.removeWait(player);
+    writeSelector.removeWait(player);
+    throttled.erase(player);
+    
+    // Local players are waited on through their channel, which is closed so
+    // the client knows
+    if(player->localChannel != nullptr) {
+        readSelector.removeWait(player->localChannel->toServer.waker.reader);
+        player->localChannel->close();
+    }
+    
+    // Reactors stop reading and writing, and drop the player's socket
+    if(player->reactor != nullptr) {
+        player->reactor->remove(player);
+        player->reactor = nullptr;
+    }
+    
     for(auto it = players.begin(); it != players.end(); it++) {
         if(*it == player) {
             players.erase(it);
@@ -177,20 +590,46 @@ void Server::disconnectPlayer(std::shared_ptr<Player> player) {
     }
 }
 
+const WriteQueueStats& Server::getWriteStats() const {
+    return writeStats;
+}
+
+const InputLimiterStats& Server::getInputStats(const std::shared_ptr<Player>& player) const {
+    return player->inputLimiter.stats;
+}
+
 bool Server::isSocketOpen() {
-    return listenSocket.isValid();
+    return listenSocket->isValid();
 }
 
 void Server::close() {
-    if(listenSocket.isValid()) {
+    // Stop accepting before closing the listening socket
+    stopAcceptor();
+    
+    if(listenSocket->isValid()) {
         try {
             // Shutdown listening socket completely
-            listenSocket.shutdown(SocketShutdownMode::ShutReadWrite);
+            readSelector.removeWait(listenSocket);
+            listenSocket->shutdown(SocketShutdownMode::ShutReadWrite);
+            
+            // Stop the snapshot channel. Remaining state goes over TCP
+            if(snapshotSocket != nullptr) {
+                readSelector.removeWait(snapshotSocket);
+                snapshotSocket->close();
+                for(auto player : players)
+                    player->snapshotEndpoint.connected = false;
+            }
+            
+            // Shutdown player socket reads. Local players have no socket; their
+            // channel is closed instead. Reactors stop reading by themselves
+            // when stopped below
+            for(auto player : players) {
+                if(player->localChannel != nullptr)
+                    player->localChannel->close();
+                else if(player->reactor == nullptr)
+                    player->shutdown(SocketShutdownMode::ShutRead);
+            }
             
-            // Shutdown player socket reads
-            for(auto player : players)
-                player->shutdown(SocketShutdownMode::ShutRead);
-        
             // Send all buffered data. Abort after, at most, 10 seconds
             auto quarters = 0;
             while(!sendMessages(250)) {
@@ -200,5 +639,9 @@ void Server::close() {
         }
         catch(SocketException e) {}; // Ignore network exceptions
     }
+    
+    // Let reactors write what was handed to them, then stop them
+    for(auto it = reactors.begin(); it != reactors.end(); it++)
+        (*it)->stop();
 }
 
@@ -1,23 +1,234 @@
 #ifndef ROGUELIKE_SERVER_HPP_INCLUDED
 #define ROGUELIKE_SERVER_HPP_INCLUDED
+#include "../networking/LocalChannel.hpp"
 #include "../networking/ServerMessage.hpp"
 #include "../networking/Socket.hpp"
+#include "../networking/SocketSelector.hpp"
+#include "../networking/Waker.hpp"
+#include "NetworkReactor.hpp"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+
+/// Settings for creating a Server
+struct ServerConfig {
+    /// Port to listen on
+    uint16_t port;
+    
+    /// Wire format used to talk to all players
+    WireFormat wireFormat;
+    
+    /// Maximum amount of pending connections the OS keeps for the listening
+    /// socket. Connections past this are refused or retried by the client,
+    /// so this should fit the amount of players reconnecting at once, e.g.
+    /// after a restart
+    int backlog = SOMAXCONN;
+    
+    /// If true, connections are accepted by a dedicated thread and handed to
+    /// the server on the next receive, so accepting never waits for the game
+    /// loop. Otherwise, receive accepts them itself
+    bool acceptorThread = false;
+    
+    /// Socket options applied to every player's connection. Changes nothing
+    /// by default
+    SocketProfile profile;
+    
+    /// If true, players can ask for a UDP snapshot channel, and snapshots
+    /// (see Server::addSnapshot) are sent over it. Uses a UDP socket on the
+    /// same port
+    bool snapshotChannel = false;
+    
+    /// Amount of network reactor threads. Each owns a share of the players'
+    /// connections, reading and parsing their messages and writing what
+    /// sendMessages hands them, so socket I/O never runs on the thread calling
+    /// receive. If 0, receive and sendMessages do the I/O themselves
+    int reactorThreads = 0;
+    
+    /// Maximum bytes queued for a player (see WriteQueue). A player whose
+    /// connection can't keep up with their reliable messages is disconnected
+    /// once they go over it. 0 for no cap
+    size_t maxQueuedBytes = 0;
+    
+    /// Bulk messages (see MessagePriority) bigger than this are sent in
+    /// fragments of this size, so acks and chat queued after them don't wait
+    /// for the whole message. 0 to send them whole
+    size_t chunkSize = 0;
+    
+    /// Limits on the size and rate of messages each player may send (see
+    /// InputLimits). Unlimited by default. Local players are not limited
+    InputLimits inputLimits;
+    
+    /// Time between pings to each player, which measure round trip times
+    /// (see LinkStats). 0 for no pings
+    int pingIntervalMs = 0;
+    
+    /// Players that send nothing for this long are disconnected, even if
+    /// their connection never reports being closed. Should be a few ping
+    /// intervals, since pongs count. 0 for no timeout
+    int idleTimeoutMs = 0;
+    
+    /// Create config with port number and wire format. Everything else is the
+    /// default
+    ServerConfig(uint16_t port, WireFormat wireFormat = WireFormat::Fixed) :
+        port(port),
+        wireFormat(wireFormat)
+    {}
+};
 
 class Server {
     /// Listening socket for accepting connections
-    Socket listenSocket;
+    std::shared_ptr<Socket> listenSocket;
+    
+    /// Selector with read events of all players. Players are added when they
+    /// connect and removed when they disconnect. Each player is its own user
+    /// data. Also has the listening socket, without user data, if there is no
+    /// acceptor thread
+    SocketSelector readSelector;
+    
+    /// Selector with write events of players whose kernel send buffer filled
+    /// up, so they still have data left to send. Other players are written to
+    /// without waiting
+    SocketSelector writeSelector;
+    
+    /// UDP socket for the snapshot channel, in the read selector without user
+    /// data. nullptr if there is no snapshot channel
+    std::shared_ptr<Socket> snapshotSocket;
+    
+    /// Generates snapshot channel tokens
+    std::mt19937 tokenGenerator;
+    
+    /// Socket options applied to new players
+    const SocketProfile profile;
+    
+    /// Byte cap and fragment size of player write queues, and their counters
+    const size_t maxQueuedBytes, chunkSize;
+    WriteQueueStats writeStats;
+    
+    /// Limits on what each player may send
+    const InputLimits inputLimits;
+    
+    /// Time between pings, and time without input after which players are
+    /// disconnected. 0 if disabled
+    const int pingIntervalMs, idleTimeoutMs;
+    
+    /// Acceptor thread and whether it should keep running
+    std::thread acceptor;
+    std::atomic<bool> acceptorRunning;
+    
+    /// Sockets accepted by the acceptor thread and local channels from
+    /// connectLocal that haven't been turned into players yet, and their lock
+    std::deque<std::unique_ptr<Socket> > acceptedSockets;
+    std::deque<std::shared_ptr<LocalChannel> > acceptedChannels;
+    std::mutex acceptedLock;
+    
+    /// Woken after something is added to the accepted sockets or channels, so
+    /// a receive waiting for messages adds the new players straight away. Its
+    /// reader is in the read selector without user data
+    Waker acceptedWaker;
+    
+    /// Events from the reactor threads. The waker's reader is in the read
+    /// selector without user data
+    ReactorEvents reactorEvents;
+    
+    /// Reactor threads. Empty if there are none
+    std::vector<std::unique_ptr<NetworkReactor> > reactors;
+    
+    /// Players whose reading is paused by their rate limits. They are out of
+    /// the read selector until then
+    ThrottledPlayers throttled;
+    
+    /// Accept all pending connections into sockets. Returns once the
+    /// listening socket would block
+    void acceptPending(std::deque<std::unique_ptr<Socket> >& sockets);
+    
+    /// Acceptor thread loop
+    void acceptLoop();
+    
+    /// Add players for the sockets accepted by the acceptor thread and the
+    /// local channels from connectLocal
+    void addAccepted();
+    
+    /// Create a player for each accepted socket, applying the socket profile
+    void addPlayers(std::deque<std::unique_ptr<Socket> >& sockets);
+    
+    /// Handle all pending reactor events: queue their messages, and
+    /// disconnect players whose connection broke
+    void receiveReactorEvents(std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Handle a message parsed from a player: snapshot channel requests are
+    /// answered here, and everything else is queued for the game
+    void handleMessage(const std::shared_ptr<ServerMessage>& message, std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Read and handle what a connected player sent, disconnecting them if
+    /// their connection broke
+    void receivePlayer(const std::shared_ptr<Player>& player, std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Resume reading from throttled players whose rate limits let them
+    /// through again. Their buffered messages are handled first
+    void resumeThrottled(std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Create a local player for each local channel
+    void addLocalPlayers(std::deque<std::shared_ptr<LocalChannel> >& channels);
+    
+    /// Get messages from a local player. Returns false if they disconnected
+    bool receiveLocal(const std::shared_ptr<Player>& player, std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Queue a message for a player: a copy of it for local players, or its
+    /// payload otherwise. The payload is built on first use, so pass the same
+    /// (initially null) payload when queueing one message for many players;
+    /// their write queues then share it. If state is true, the message is
+    /// queued as a state message (see WriteQueue)
+    void queueMessage(const ClientMessage& message, Payload& payload, const std::shared_ptr<Player>& player, bool state = false);
+    
+    /// Disconnect players whose write queue overflowed, adding quit messages
+    /// for those that joined
+    void disconnectOverflowed(std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Queue pings for players that are due one, and disconnect players that
+    /// went quiet for longer than the idle timeout, adding quit messages for
+    /// those that joined
+    void checkLinks(std::deque<std::shared_ptr<ServerMessage> >& messages);
+    
+    /// Write as much of a player's write buffer as their socket takes without
+    /// blocking, and wait for write events only while data is left. If the
+    /// connection broke, the data is dropped; the next read notices
+    void flushPlayer(const std::shared_ptr<Player>& player);
+    
+    /// Stop the acceptor thread, if running, and wait for it to die
+    void stopAcceptor();
+    
+    /// Give a player a snapshot channel token, or token 0 if there is no
+    /// snapshot channel
+    void openSnapshotChannel(const std::shared_ptr<Player>& player);
+    
+    /// Read all pending hello datagrams, connecting players' snapshot
+    /// channels and echoing the hellos back
+    void receiveHellos();
+    
+    /// Send a message to a player as a snapshot, or queue it as a state
+    /// message if they have no snapshot channel or the message is bigger than
+    /// maxSnapshotSize. payload is used like in queueMessage
+    void sendSnapshot(const ClientMessage& message, Payload& payload, const std::shared_ptr<Player>& player);
 public:
     /// Connected players
     std::vector<std::shared_ptr<Player> > players;
     
-    /// Create server with port number
-    Server(uint16_t port);
+    /// Wire format used to talk to all players. Clients must use the same one
+    const WireFormat wireFormat;
+    
+    /// Create server with port number and wire format
+    Server(uint16_t port, WireFormat wireFormat = WireFormat::Fixed);
+    
+    /// Create server with a config
+    Server(const ServerConfig& config);
     
     /// Destructor
     virtual ~Server();
     
-    /// Receive messages, with a timeout. Automatically accepts connections. If
-    /// there are no players connected, then this will immediately return
+    /// Receive messages, with a timeout. Automatically accepts all pending
+    /// connections, or adds the ones accepted by the acceptor thread
     std::deque<std::shared_ptr<ServerMessage> > receive(int timeoutMs);
     
     /// Add a message to be sent to a player. Call sendMessages to send all
@@ -32,15 +243,42 @@ public:
     /// all buffered messages
     void addMessageAll(const ClientMessage& message);
     
+    /// Send state that will be obsolete next turn, like object or player data,
+    /// to a player. Goes over the player's snapshot channel straight away if
+    /// they have one and it fits in a datagram (see maxSnapshotSize), where
+    /// it may be lost. Otherwise, it is added like addMessage, but replaces
+    /// the unsent copy of the same message type, if any
+    void addSnapshot(const ClientMessage& message, std::shared_ptr<Player> player);
+    
+    /// Same as addSnapshot, but for all players
+    void addSnapshotAll(const ClientMessage& message);
+    
     /// Attempt to send buffered messages. Returns true if all data has
-    /// been sent. Stops sending even if not all data was sent if after
-    /// timeoutMs milliseconds, unless timeout is negative where it tries
-    /// forever
+    /// been sent. Each player gets what their socket takes straight away;
+    /// players whose socket is full keep their data and get more once it is
+    /// writable. With a timeout of 0 this never waits, so it can be called
+    /// after every turn. Otherwise, it waits for those players for up to
+    /// timeoutMs milliseconds, or forever if negative. With reactor threads,
+    /// buffered messages are handed to them instead, which always succeeds
     bool sendMessages(int timeoutMs);
     
     /// Disconnects a player. Their socket is automatically closed
     void disconnectPlayer(std::shared_ptr<Player> player);
     
+    /// Connect a client in the same process through a local channel. The
+    /// client should be created with the same channel. Can be called from any
+    /// thread; the player is added on the next receive
+    void connectLocal(std::shared_ptr<LocalChannel> channel);
+    
+    /// Get the counters of the players' write queues: state messages dropped
+    /// for newer ones, and players that went over the byte cap
+    const WriteQueueStats& getWriteStats() const;
+    
+    /// Get the counters of a player's input limiter: messages refused for
+    /// their size, and messages that went over the rate limits. Safe to call
+    /// while a reactor thread reads from the player
+    const InputLimiterStats& getInputStats(const std::shared_ptr<Player>& player) const;
+    
     /// Check if listening socket is still open
     bool isSocketOpen();
     